@@ -17,6 +17,7 @@
 #include <skirmish/util/path.h>
 #include <skirmish/util/perlin.h>
 #include <skirmish/util/tga.h>
+#include <skirmish/util/thread_pool.h>
 #include <skirmish/obj/obj.h>
 #include <skirmish/md3/md3.h>
 #include <skirmish/win32/win32_main_window.h>
@@ -92,7 +93,15 @@ int main()
 {
     try {
         util::native_file_system data_fs{"../../data/"};
-        
+
+        // Start decoding the player model while the window and renderer are set up
+        const std::string model_name = "mario";
+        auto pk3_cache = std::make_shared<zip::entry_cache>(16 << 20);
+        zip::in_zip_archive pk3_arc{data_fs.open("md3-"+model_name+".pk3"), pk3_cache};
+        // Declared after everything the loading tasks use so it's destroyed (and joined) first
+        util::thread_pool loader_pool;
+        auto q3player_assets = q3_player_render_obj::load_async(loader_pool, pk3_arc, "models/players/"+model_name);
+
         win32_main_window w{640, 480};
 
         d3d11_renderer renderer{w};
@@ -107,9 +116,7 @@ int main()
         terrain_obj->set_texture(tex);
         renderer.add_renderable(*terrain_obj);
 
-        const std::string model_name = "mario";
-        zip::in_zip_archive pk3_arc{data_fs.open("md3-"+model_name+".pk3")};
-        q3_player_render_obj q3player{renderer, pk3_arc, "models/players/"+model_name};
+        q3_player_render_obj q3player{renderer, q3player_assets.get()};
 
         std::map<key, bool> key_down;
         w.on_key_down([&](key k) {
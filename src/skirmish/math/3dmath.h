@@ -2,6 +2,7 @@
 #define SKIRMISH_MATH_3DMATH_H
 
 #include "mat.h"
+#include "quat.h"
 #include <math.h>
 
 namespace skirmish {
@@ -47,6 +48,30 @@ struct matrix_factory {
         return res;
     }
 
+    // Rotation by the unit quaternion q
+    template<typename quat_tag>
+    static mat_type rotation(const quat<T, quat_tag>& q) {
+        auto res = mat<Rows, Columns, T, tag>::identity();
+        const T xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        const T xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        const T wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+        res[0][0] = 1 - 2 * (yy + zz); res[0][1] = 2 * (xy - wz);     res[0][2] = 2 * (xz + wy);
+        res[1][0] = 2 * (xy + wz);     res[1][1] = 1 - 2 * (xx + zz); res[1][2] = 2 * (yz - wx);
+        res[2][0] = 2 * (xz - wy);     res[2][1] = 2 * (yz + wx);     res[2][2] = 1 - 2 * (xx + yy);
+        return res;
+    }
+
+    // Rotation by the unit quaternion q followed by translation by v
+    template<typename quat_tag>
+    static mat_type rotation_translation(const quat<T, quat_tag>& q, const vec<3, T, tag>& v) {
+        static_assert(Columns > 3, "Matrix too small");
+        auto res = rotation(q);
+        for (unsigned r = 0; r < 3; ++r) {
+            res[r][3] = v[r];
+        }
+        return res;
+    }
+
     static mat_type translation(const vec<Rows - 1, T, tag>& v) {
         static_assert(Columns > 3, "Matrix too small");
         auto res = mat<Rows, Columns, T, tag>::identity();
@@ -83,6 +108,29 @@ struct matrix_factory {
     }
 };
 
+// The (unit) quaternion of the rotation in the upper left 3x3 part of m, which must be orthonormal
+template<unsigned Rows, unsigned Columns, typename T, typename tag>
+quat<T, tag> make_quat(const mat<Rows, Columns, T, tag>& m) {
+    static_assert(Rows >= 3 && Columns >= 3, "Matrix is too small");
+    // Divide by the largest of the four possible pivots for numerical stability
+    const T trace = m[0][0] + m[1][1] + m[2][2];
+    quat<T, tag> q;
+    if (trace > 0) {
+        const T s = T(sqrt(trace + 1)) * 2;
+        q = {(m[2][1] - m[1][2]) / s, (m[0][2] - m[2][0]) / s, (m[1][0] - m[0][1]) / s, s / 4};
+    } else if (m[0][0] > m[1][1] && m[0][0] > m[2][2]) {
+        const T s = T(sqrt(1 + m[0][0] - m[1][1] - m[2][2])) * 2;
+        q = {s / 4, (m[0][1] + m[1][0]) / s, (m[0][2] + m[2][0]) / s, (m[2][1] - m[1][2]) / s};
+    } else if (m[1][1] > m[2][2]) {
+        const T s = T(sqrt(1 + m[1][1] - m[0][0] - m[2][2])) * 2;
+        q = {(m[0][1] + m[1][0]) / s, s / 4, (m[1][2] + m[2][1]) / s, (m[0][2] - m[2][0]) / s};
+    } else {
+        const T s = T(sqrt(1 + m[2][2] - m[0][0] - m[1][1])) * 2;
+        q = {(m[0][2] + m[2][0]) / s, (m[1][2] + m[2][1]) / s, s / 4, (m[1][0] - m[0][1]) / s};
+    }
+    return normalized(q);
+}
+
 } // namespace skirmish
 
 #endif
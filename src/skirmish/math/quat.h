@@ -0,0 +1,95 @@
+#ifndef SKIRMISH_QUAT_H
+#define SKIRMISH_QUAT_H
+
+#include "vec.h"
+#include <math.h>
+
+namespace skirmish {
+
+// Rotation quaternion (x, y, z) + w
+template<typename T, typename tag>
+struct quat {
+    T x, y, z, w;
+
+    constexpr static quat identity() {
+        return {0, 0, 0, 1};
+    }
+};
+
+template<typename T, typename tag>
+bool operator==(const quat<T, tag>& l, const quat<T, tag>& r) {
+    return l.x == r.x && l.y == r.y && l.z == r.z && l.w == r.w;
+}
+
+template<typename T, typename tag>
+bool operator!=(const quat<T, tag>& l, const quat<T, tag>& r) {
+    return !(l == r);
+}
+
+// Rotation by r followed by rotation by l
+template<typename T, typename tag>
+quat<T, tag> operator*(const quat<T, tag>& l, const quat<T, tag>& r) {
+    return {
+        l.w * r.x + l.x * r.w + l.y * r.z - l.z * r.y,
+        l.w * r.y - l.x * r.z + l.y * r.w + l.z * r.x,
+        l.w * r.z + l.x * r.y - l.y * r.x + l.z * r.w,
+        l.w * r.w - l.x * r.x - l.y * r.y - l.z * r.z
+    };
+}
+
+template<typename T, typename tag>
+quat<T, tag> conjugate(const quat<T, tag>& q) {
+    return {-q.x, -q.y, -q.z, q.w};
+}
+
+template<typename T, typename tag>
+T dot(const quat<T, tag>& l, const quat<T, tag>& r) {
+    return l.x * r.x + l.y * r.y + l.z * r.z + l.w * r.w;
+}
+
+template<typename T, typename tag>
+quat<T, tag> normalized(const quat<T, tag>& q) {
+    const T s = T(1) / T(sqrt(dot(q, q)));
+    return {q.x * s, q.y * s, q.z * s, q.w * s};
+}
+
+// Rotates v by the unit quaternion q
+template<typename T, typename tag, typename vector_tag>
+vec<3, T, vector_tag> rotate(const quat<T, tag>& q, const vec<3, T, vector_tag>& v) {
+    const quat<T, tag> p{v[0], v[1], v[2], 0};
+    const auto r = q * p * conjugate(q);
+    return {r.x, r.y, r.z};
+}
+
+// Normalized linear interpolation between unit quaternions along the shortest arc. Not constant
+// speed, but close to slerp when a and b are near each other (e.g. consecutive animation frames).
+template<typename T, typename tag>
+quat<T, tag> nlerp(const quat<T, tag>& a, const quat<T, tag>& b, T t) {
+    const T tb = dot(a, b) < 0 ? -t : t;
+    const T ta = T(1) - t;
+    return normalized(quat<T, tag>{ta * a.x + tb * b.x, ta * a.y + tb * b.y, ta * a.z + tb * b.z, ta * a.w + tb * b.w});
+}
+
+// Spherical linear interpolation between unit quaternions along the shortest arc
+template<typename T, typename tag>
+quat<T, tag> slerp(const quat<T, tag>& a, const quat<T, tag>& b, T t) {
+    T cos_theta = dot(a, b);
+    T sign = 1;
+    if (cos_theta < 0) {
+        cos_theta = -cos_theta;
+        sign = -1;
+    }
+    if (cos_theta > T(0.9995)) {
+        // sin(theta) is too close to zero, nlerp is indistinguishable anyway
+        return nlerp(a, b, t);
+    }
+    const T theta = T(acos(cos_theta));
+    const T inv_sin_theta = T(1) / T(sin(theta));
+    const T ta = T(sin((1 - t) * theta)) * inv_sin_theta;
+    const T tb = T(sin(t * theta)) * inv_sin_theta * sign;
+    return {ta * a.x + tb * b.x, ta * a.y + tb * b.y, ta * a.z + tb * b.z, ta * a.w + tb * b.w};
+}
+
+} // namespace skirmish
+
+#endif
@@ -0,0 +1,16 @@
+#include "animation.h"
+#include <cmath>
+
+namespace skirmish { namespace md3 {
+
+animation_instant calc_animation_instant(const animation_info& info, double seconds_since_start)
+{
+    // XXX: We don't respect the fact that many animations don't actually loop
+    const auto animation_pos = std::fmod(seconds_since_start * info.frames_per_second, info.num_frames);
+    const auto frame = static_cast<uint32_t>(animation_pos);
+    assert(frame < info.num_frames);
+    const auto next_frame = (frame + 1) % info.num_frames;
+    return { info.first_frame + frame, info.first_frame + next_frame, static_cast<float>(std::fmod(animation_pos, 1.0)) };
+}
+
+} } // skirmish::md3
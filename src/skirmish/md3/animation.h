@@ -0,0 +1,76 @@
+#ifndef SKIRMISH_MD3_ANIMATION_H
+#define SKIRMISH_MD3_ANIMATION_H
+
+#include "md3.h"
+#include "mesh.h"
+#include "morph.h"
+#include <skirmish/util/array_view.h>
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+#include <cassert>
+
+namespace skirmish { namespace md3 {
+
+// A point in time between two frames of an animation
+struct animation_instant {
+    animation_instant(uint32_t start_frame, uint32_t end_frame, float sub_time) : start_frame(start_frame), end_frame(end_frame), sub_time(sub_time) {
+        assert(sub_time >= 0.0f && sub_time <= 1.0f);
+    }
+
+    uint32_t start_frame, end_frame;
+    float sub_time;
+};
+
+animation_instant calc_animation_instant(const animation_info& info, double seconds_since_start);
+
+// The animated vertices of a model, one persistent buffer of Vertex per surface mesh. Vertex must start with
+// the three float components of its position and consist solely of floats. The buffers are sized and initialized
+// (using make_vertex(mesh, index)) at construction, update() only rewrites the positions and never allocates.
+template<typename Vertex>
+class animated_model {
+public:
+    template<typename MakeVertex>
+    explicit animated_model(std::vector<surface_mesh> meshes, MakeVertex make_vertex) : meshes_(std::move(meshes)) {
+        static_assert(std::is_standard_layout<Vertex>::value && sizeof(Vertex) % sizeof(float) == 0 && sizeof(Vertex) >= 3 * sizeof(float), "Invalid vertex type");
+        vertices_.reserve(meshes_.size());
+        for (const auto& mesh : meshes_) {
+            std::vector<Vertex> vs;
+            vs.reserve(mesh.num_vertices());
+            for (uint32_t i = 0; i < mesh.num_vertices(); ++i) {
+                vs.push_back(make_vertex(mesh, i));
+            }
+            vertices_.push_back(std::move(vs));
+        }
+        update(animation_instant{0, 0, 0.0f});
+    }
+
+    size_t surface_count() const {
+        return meshes_.size();
+    }
+
+    const surface_mesh& mesh(size_t surface) const {
+        return meshes_[surface];
+    }
+
+    util::array_view<Vertex> vertices(size_t surface) const {
+        return util::make_array_view(vertices_[surface]);
+    }
+
+    void update(const animation_instant& ai) {
+        for (size_t i = 0; i < meshes_.size(); ++i) {
+            assert(ai.start_frame < meshes_[i].num_frames() && ai.end_frame < meshes_[i].num_frames());
+            auto& vs = vertices_[i];
+            if (vs.empty()) continue;
+            morph(meshes_[i], ai.start_frame, ai.end_frame, ai.sub_time, morph_output{reinterpret_cast<float*>(&vs[0]), nullptr, sizeof(Vertex) / sizeof(float)});
+        }
+    }
+
+private:
+    std::vector<surface_mesh>        meshes_;
+    std::vector<std::vector<Vertex>> vertices_;
+};
+
+} } // skirmish::md3
+
+#endif
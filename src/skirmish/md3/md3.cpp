@@ -1,8 +1,9 @@
 #include "md3.h"
 #include <skirmish/util/text.h>
 #include <cassert>
+#include <cstddef>
 #include <algorithm>
-#include <sstream>
+#include <stdexcept>
 
 namespace skirmish { namespace md3 {
 
@@ -19,6 +20,45 @@ bool read_to_vec(util::in_stream& in, std::vector<T>& v, uint64_t abs_stream_off
     return !in.error();
 }
 
+// Elements that consist solely of scalars of the same type are laid out exactly as in the file and can be read in bulk
+template<typename T, typename Scalar>
+bool read_to_vec_bulk(util::in_stream& in, std::vector<T>& v, uint64_t abs_stream_offset, uint32_t count)
+{
+    static_assert(std::is_standard_layout<T>::value && sizeof(T) % sizeof(Scalar) == 0, "Invalid element type");
+    in.seek(abs_stream_offset, util::seekdir::beg);
+    v.resize(count);
+    in.read_array_le(reinterpret_cast<Scalar*>(v.data()), v.size() * (sizeof(T) / sizeof(Scalar)));
+    return !in.error();
+}
+
+bool read_to_vec(util::in_stream& in, std::vector<triangle>& v, uint64_t abs_stream_offset, uint32_t count)
+{
+    static_assert(sizeof(triangle) == 3 * sizeof(uint32_t), "");
+    return read_to_vec_bulk<triangle, uint32_t>(in, v, abs_stream_offset, count);
+}
+
+bool read_to_vec(util::in_stream& in, std::vector<texcoord>& v, uint64_t abs_stream_offset, uint32_t count)
+{
+    static_assert(sizeof(texcoord) == 2 * sizeof(float), "");
+    return read_to_vec_bulk<texcoord, float>(in, v, abs_stream_offset, count);
+}
+
+bool read_to_vec(util::in_stream& in, std::vector<vertex>& v, uint64_t abs_stream_offset, uint32_t count)
+{
+    static_assert(sizeof(vertex) == 4 * sizeof(int16_t) && offsetof(vertex, nz) == 3 * sizeof(int16_t) && offsetof(vertex, na) == offsetof(vertex, nz) + 1, "");
+    in.seek(abs_stream_offset, util::seekdir::beg);
+    v.resize(count);
+    in.read(v.data(), v.size() * sizeof(vertex));
+#if SKIRMISH_BIG_ENDIAN
+    for (auto& e : v) {
+        for (auto c : { &e.x, &e.y, &e.z }) {
+            *c = static_cast<int16_t>((static_cast<uint16_t>(*c) >> 8) | (static_cast<uint16_t>(*c) << 8));
+        }
+    }
+#endif
+    return !in.error();
+}
+
 template<size_t Size>
 void read(util::in_stream& in, char (&name)[Size])
 {
@@ -32,59 +72,68 @@ void read(util::in_stream& in, char (&name)[Size])
 
 void read(util::in_stream& in, header& h)
 {
-    h.ident        = in.get_u32_le();
-    h.version      = in.get_u32_le();
+    uint32_t ident_version[2], fields[9];
+    in.read_array_le(ident_version, 2);
     read(in, h.name);
-    h.flags        = in.get_u32_le();
-    h.num_frames   = in.get_u32_le();
-    h.num_tags     = in.get_u32_le();
-    h.num_surfaces = in.get_u32_le();
-    h.num_skins    = in.get_u32_le();
-    h.ofs_frames   = in.get_u32_le();
-    h.ofs_tags     = in.get_u32_le();
-    h.ofs_surfaces = in.get_u32_le();
-    h.ofs_end      = in.get_u32_le();
+    in.read_array_le(fields, 9);
+    h.ident        = ident_version[0];
+    h.version      = ident_version[1];
+    h.flags        = fields[0];
+    h.num_frames   = fields[1];
+    h.num_tags     = fields[2];
+    h.num_surfaces = fields[3];
+    h.num_skins    = fields[4];
+    h.ofs_frames   = fields[5];
+    h.ofs_tags     = fields[6];
+    h.ofs_surfaces = fields[7];
+    h.ofs_end      = fields[8];
 }
 
 void read(util::in_stream& in, vec3& v)
 {
-    v.x = in.get_float_le();
-    v.y = in.get_float_le();
-    v.z = in.get_float_le();
+    float values[3];
+    in.read_array_le(values, 3);
+    v = vec3{values[0], values[1], values[2]};
 }
 
 void read(util::in_stream& in, frame& f)
 {
-    read(in, f.min_bounds);
-    read(in, f.max_bounds);
-    read(in, f.local_origin);
-    f.radius = in.get_float_le();
+    float values[10];
+    in.read_array_le(values, 10);
+    f.min_bounds   = vec3{values[0], values[1], values[2]};
+    f.max_bounds   = vec3{values[3], values[4], values[5]};
+    f.local_origin = vec3{values[6], values[7], values[8]};
+    f.radius       = values[9];
     read(in, f.name);
 }
 
 void read(util::in_stream& in, tag& t)
 {
     read(in, t.name);
-    read(in, t.origin);
-    read(in, t.x_axis);
-    read(in, t.y_axis);
-    read(in, t.z_axis);
+    float values[12];
+    in.read_array_le(values, 12);
+    t.origin = vec3{values[0], values[1], values[2]};
+    t.x_axis = vec3{values[3], values[4], values[5]};
+    t.y_axis = vec3{values[6], values[7], values[8]};
+    t.z_axis = vec3{values[9], values[10], values[11]};
 }
 
 void read(util::in_stream& in, surface& s)
 {
     s.ident          = in.get_u32_le();
     read(in, s.name);
-    s.flags          = in.get_u32_le();
-    s.num_frames     = in.get_u32_le();
-    s.num_shaders    = in.get_u32_le();
-    s.num_vertices   = in.get_u32_le();
-    s.num_triangles  = in.get_u32_le();
-    s.ofs_triangles  = in.get_u32_le();
-    s.ofs_shaders    = in.get_u32_le();
-    s.ofs_st         = in.get_u32_le();
-    s.ofs_xyznormals = in.get_u32_le();
-    s.ofs_end        = in.get_u32_le();
+    uint32_t fields[10];
+    in.read_array_le(fields, 10);
+    s.flags          = fields[0];
+    s.num_frames     = fields[1];
+    s.num_shaders    = fields[2];
+    s.num_vertices   = fields[3];
+    s.num_triangles  = fields[4];
+    s.ofs_triangles  = fields[5];
+    s.ofs_shaders    = fields[6];
+    s.ofs_st         = fields[7];
+    s.ofs_xyznormals = fields[8];
+    s.ofs_end        = fields[9];
 }
 
 void read(util::in_stream& in, shader& s)
@@ -206,14 +255,15 @@ bool read(util::in_stream& in, file& f)
 skin_info_type read_skin(util::in_stream& in)
 {
     skin_info_type res;
-    for (std::string line; !in.error() && in.tell() < in.stream_size();) {
-        read_line(in, line);
-        const auto comma_pos = line.find_first_of(',');
-        if (comma_pos == 0 || comma_pos == std::string::npos) throw std::runtime_error("Invalid skin line: '" + line +"'");        
-        auto mesh_name = util::trim(line.substr(0, comma_pos));
-        auto texture_filename = util::trim(line.substr(comma_pos + 1));
-
-        const auto insert_result = res.insert({std::move(mesh_name), std::move(texture_filename)});
+    util::line_tokenizer<> tokenizer{in};
+    while (tokenizer.next_line()) {
+        const auto line = tokenizer.line();
+        const auto comma = std::find(line.begin(), line.end(), ',');
+        if (comma == line.begin() || comma == line.end()) throw std::runtime_error("Invalid skin line: '" + tokenizer.line_string() +"'");
+        const auto mesh_name = util::trim(util::make_array_view(line.begin(), comma));
+        const auto texture_filename = util::trim(util::make_array_view(comma + 1, line.end()));
+
+        const auto insert_result = res.insert({std::string(mesh_name.begin(), mesh_name.end()), std::string(texture_filename.begin(), texture_filename.end())});
         if (!insert_result.second) {
             throw std::runtime_error("Invalid skin file: '" + insert_result.first->first + "' defined more than once");
         }
@@ -225,17 +275,18 @@ animation_info_array read_animation_cfg(util::in_stream& in)
 {
     std::array<animation_info, MAX_ANIMATION> animations{};
     unsigned index = 0;
-    for (std::string line; !in.error() && in.tell() < in.stream_size(); ) {
-        read_line(in, line);
-        line = util::trim(line);
-        if (line.empty() || line[0] < '0' || line[0] > '9') continue;
+    util::line_tokenizer<> tokenizer{in};
+    while (tokenizer.next_line()) {
+        // Only lines starting with a number describe animations
+        uint32_t first_frame;
+        if (!tokenizer.next_number(first_frame)) continue;
         if (index == MAX_ANIMATION) {
             throw std::runtime_error("Invalid number of animations in animation.cfg");
         }
         animation_info& a = animations[index++];
-        std::istringstream iss{line};
-        if (!(iss >> a.first_frame >> a.num_frames >> a.looping_frames >> a.frames_per_second)) {
-            throw std::runtime_error("Invalid line in animation.cfg: '" + line + "'");
+        a.first_frame = first_frame;
+        if (!tokenizer.next_number(a.num_frames) || !tokenizer.next_number(a.looping_frames) || !tokenizer.next_number(a.frames_per_second)) {
+            throw std::runtime_error("Invalid line in animation.cfg: '" + tokenizer.line_string() + "'");
         }
     }
     if (index != MAX_ANIMATION) {
@@ -0,0 +1,80 @@
+#include "mesh.h"
+#include <skirmish/math/constants.h>
+#include <cassert>
+#include <cmath>
+
+namespace skirmish { namespace md3 {
+
+namespace {
+
+// The normal only depends on the sines and cosines of the two angles, so two small tables are
+// enough rather than one entry per (nz, na) pair
+struct normal_tables {
+    float sin[256];
+    float cos[256];
+
+    normal_tables() {
+        for (int i = 0; i < 256; ++i) {
+            // 255 corresponds to 2 pi
+            const auto angle = static_cast<double>(i) * (2 * pi_v<double>) / 255.0;
+            sin[i] = static_cast<float>(std::sin(angle));
+            cos[i] = static_cast<float>(std::cos(angle));
+        }
+    }
+};
+
+const normal_tables& tables()
+{
+    static const normal_tables instance;
+    return instance;
+}
+
+} // unnamed namespace
+
+vec3 decode_normal(uint8_t nz, uint8_t na)
+{
+    const auto& t = tables();
+    return vec3{t.cos[na] * t.sin[nz], t.sin[na] * t.sin[nz], t.cos[nz]};
+}
+
+surface_mesh::surface_mesh(const surface_with_data& surf, float position_scale)
+    : num_vertices_(surf.hdr.num_vertices)
+    , num_frames_(surf.hdr.num_frames)
+    , positions_(3 * static_cast<size_t>(num_vertices_) * num_frames_)
+    , normals_(positions_.size())
+    , s_(num_vertices_)
+    , t_(num_vertices_) {
+    assert(surf.frames.size() == static_cast<size_t>(num_vertices_) * num_frames_);
+    assert(surf.texcoords.size() == num_vertices_);
+
+    const auto n = static_cast<size_t>(num_vertices_);
+    const float xyz_scale = position_scale / 64.0f;
+    for (uint32_t frame = 0; frame < num_frames_; ++frame) {
+        const vertex* src = surf.frames.data() + frame * n;
+        float* px = positions_.data() + 3 * frame * n;
+        float* nx = normals_.data() + 3 * frame * n;
+        for (size_t i = 0; i < n; ++i) {
+            px[i]         = xyz_scale * src[i].x;
+            px[n + i]     = xyz_scale * src[i].y;
+            px[2 * n + i] = xyz_scale * src[i].z;
+            const auto normal = decode_normal(src[i].nz, src[i].na);
+            nx[i]         = normal.x;
+            nx[n + i]     = normal.y;
+            nx[2 * n + i] = normal.z;
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        s_[i] = surf.texcoords[i].s;
+        t_[i] = surf.texcoords[i].t;
+    }
+}
+
+surface_mesh::components surface_mesh::frame_components(const std::vector<float>& v, uint32_t frame) const
+{
+    assert(frame < num_frames_);
+    const float* base = v.data() + 3 * static_cast<size_t>(frame) * num_vertices_;
+    return components{base, base + num_vertices_, base + 2 * num_vertices_};
+}
+
+} } // skirmish::md3
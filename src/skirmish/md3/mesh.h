@@ -0,0 +1,53 @@
+#ifndef SKIRMISH_MD3_MESH_H
+#define SKIRMISH_MD3_MESH_H
+
+#include "md3.h"
+
+namespace skirmish { namespace md3 {
+
+// Unit vector for the packed zenith/azimuth normal of a vertex
+vec3 decode_normal(uint8_t nz, uint8_t na);
+
+// Surface data decoded once at load time into the layout used when animating. Every frame stores the x, y and z
+// components of all vertices as separate contiguous arrays (structure of arrays) so animating is a streaming
+// pass over memory. Positions are scaled by position_scale (e.g. quake_to_meters_f) and normals are decoded.
+class surface_mesh {
+public:
+    // Component arrays of one frame, each num_vertices() long
+    struct components {
+        const float* x;
+        const float* y;
+        const float* z;
+    };
+
+    explicit surface_mesh(const surface_with_data& surf, float position_scale = 1.0f);
+
+    uint32_t num_vertices() const { return num_vertices_; }
+    uint32_t num_frames() const { return num_frames_; }
+
+    components positions(uint32_t frame) const {
+        return frame_components(positions_, frame);
+    }
+
+    components normals(uint32_t frame) const {
+        return frame_components(normals_, frame);
+    }
+
+    // Texture coordinates (the same for all frames)
+    const float* s() const { return s_.data(); }
+    const float* t() const { return t_.data(); }
+
+private:
+    uint32_t           num_vertices_;
+    uint32_t           num_frames_;
+    std::vector<float> positions_; // Per frame: x of all vertices, then y, then z
+    std::vector<float> normals_;   // Same layout as positions_
+    std::vector<float> s_;
+    std::vector<float> t_;
+
+    components frame_components(const std::vector<float>& v, uint32_t frame) const;
+};
+
+} } // skirmish::md3
+
+#endif
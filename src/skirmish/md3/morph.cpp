@@ -0,0 +1,159 @@
+#include "morph.h"
+#include <skirmish/util/cpu.h>
+#include <cassert>
+
+#if SKIRMISH_X86
+#include <immintrin.h>
+#endif
+
+namespace skirmish { namespace md3 {
+
+namespace {
+
+// Interpolates vertices [first, count) of one set of components
+void morph_scalar(const surface_mesh::components& a, const surface_mesh::components& b, float t, float* out, size_t stride, size_t first, size_t count)
+{
+    for (size_t i = first; i < count; ++i) {
+        float* o = out + i * stride;
+        o[0] = a.x[i] + (b.x[i] - a.x[i]) * t;
+        o[1] = a.y[i] + (b.y[i] - a.y[i]) * t;
+        o[2] = a.z[i] + (b.z[i] - a.z[i]) * t;
+    }
+}
+
+#if SKIRMISH_X86
+SKIRMISH_TARGET("sse2")
+inline __m128 lerp4(const float* a, const float* b, __m128 t)
+{
+    const __m128 va = _mm_loadu_ps(a);
+    return _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b), va), t));
+}
+
+// Stores the first three elements of v
+SKIRMISH_TARGET("sse2")
+inline void store3(float* out, __m128 v)
+{
+    _mm_storel_pi(reinterpret_cast<__m64*>(out), v);
+    _mm_store_ss(out + 2, _mm_movehl_ps(v, v));
+}
+
+// Stores (x[k], y[k], z[k]) at out + k * stride for k = 0..3
+SKIRMISH_TARGET("sse2")
+inline void store_transposed(float* out, size_t stride, __m128 x, __m128 y, __m128 z)
+{
+    __m128 w = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    store3(out, x);
+    store3(out + stride, y);
+    store3(out + 2 * stride, z);
+    store3(out + 3 * stride, w);
+}
+
+SKIRMISH_TARGET("sse2")
+void morph_sse(const surface_mesh::components& a, const surface_mesh::components& b, float t, float* out, size_t stride, size_t count)
+{
+    const __m128 vt = _mm_set1_ps(t);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 x = lerp4(a.x + i, b.x + i, vt);
+        const __m128 y = lerp4(a.y + i, b.y + i, vt);
+        const __m128 z = lerp4(a.z + i, b.z + i, vt);
+        store_transposed(out + i * stride, stride, x, y, z);
+    }
+    morph_scalar(a, b, t, out, stride, i, count);
+}
+
+SKIRMISH_TARGET("avx")
+inline __m256 lerp8(const float* a, const float* b, __m256 t)
+{
+    const __m256 va = _mm256_loadu_ps(a);
+    return _mm256_add_ps(va, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(b), va), t));
+}
+
+// Only the interpolation is done 8 wide, the interleaved stores are the same as for SSE
+SKIRMISH_TARGET("avx")
+void morph_avx(const surface_mesh::components& a, const surface_mesh::components& b, float t, float* out, size_t stride, size_t count)
+{
+    const __m256 vt = _mm256_set1_ps(t);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 x = lerp8(a.x + i, b.x + i, vt);
+        const __m256 y = lerp8(a.y + i, b.y + i, vt);
+        const __m256 z = lerp8(a.z + i, b.z + i, vt);
+        store_transposed(out + i * stride, stride, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z));
+        store_transposed(out + (i + 4) * stride, stride, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1));
+    }
+    morph_scalar(a, b, t, out, stride, i, count);
+}
+#endif
+
+using morph_function = void (*)(const surface_mesh::components&, const surface_mesh::components&, float, float*, size_t, size_t);
+
+void morph_scalar_all(const surface_mesh::components& a, const surface_mesh::components& b, float t, float* out, size_t stride, size_t count)
+{
+    morph_scalar(a, b, t, out, stride, 0, count);
+}
+
+morph_function function_for(morph_implementation impl)
+{
+    switch (impl) {
+    case morph_implementation::scalar:
+        return &morph_scalar_all;
+#if SKIRMISH_X86
+    case morph_implementation::sse:
+        return &morph_sse;
+    case morph_implementation::avx:
+        return &morph_avx;
+#else
+    default:
+        break;
+#endif
+    }
+    assert(false);
+    return &morph_scalar_all;
+}
+
+void morph(morph_function f, const surface_mesh& mesh, uint32_t frame_a, uint32_t frame_b, float t, const morph_output& out)
+{
+    assert(out.positions && out.stride >= 3);
+    f(mesh.positions(frame_a), mesh.positions(frame_b), t, out.positions, out.stride, mesh.num_vertices());
+    if (out.normals) {
+        f(mesh.normals(frame_a), mesh.normals(frame_b), t, out.normals, out.stride, mesh.num_vertices());
+    }
+}
+
+} // unnamed namespace
+
+bool morph_supported(morph_implementation impl)
+{
+    switch (impl) {
+    case morph_implementation::scalar:
+        return true;
+    case morph_implementation::sse:
+        return SKIRMISH_X86 != 0;
+    case morph_implementation::avx:
+        return SKIRMISH_X86 && util::cpu().avx;
+    }
+    return false;
+}
+
+morph_implementation morph_best_implementation()
+{
+    if (morph_supported(morph_implementation::avx)) return morph_implementation::avx;
+    if (morph_supported(morph_implementation::sse)) return morph_implementation::sse;
+    return morph_implementation::scalar;
+}
+
+void morph(const surface_mesh& mesh, uint32_t frame_a, uint32_t frame_b, float t, const morph_output& out)
+{
+    static const morph_function best = function_for(morph_best_implementation());
+    morph(best, mesh, frame_a, frame_b, t, out);
+}
+
+void morph(morph_implementation impl, const surface_mesh& mesh, uint32_t frame_a, uint32_t frame_b, float t, const morph_output& out)
+{
+    assert(morph_supported(impl));
+    morph(function_for(impl), mesh, frame_a, frame_b, t, out);
+}
+
+} } // skirmish::md3
@@ -0,0 +1,37 @@
+#ifndef SKIRMISH_MD3_MORPH_H
+#define SKIRMISH_MD3_MORPH_H
+
+#include "mesh.h"
+
+namespace skirmish { namespace md3 {
+
+// Interleaved destination vertices: the position (and normal) of vertex i starts at positions + i * stride
+// (normals + i * stride)
+struct morph_output {
+    float* positions;
+    float* normals;   // May be nullptr if normals aren't needed
+    size_t stride;    // In floats
+};
+
+enum class morph_implementation {
+    scalar,
+    sse,    // x86
+    avx,    // x86 with AVX
+};
+
+// Returns true if impl can be used on this machine
+bool morph_supported(morph_implementation impl);
+
+// The fastest supported implementation (used by morph below)
+morph_implementation morph_best_implementation();
+
+// Writes a + (b - a) * t for the position (and normal) of every vertex of mesh between frames a and b into out.
+// Normals aren't renormalized. Doesn't allocate.
+void morph(const surface_mesh& mesh, uint32_t frame_a, uint32_t frame_b, float t, const morph_output& out);
+
+// As above, using a specific implementation (which must be supported)
+void morph(morph_implementation impl, const surface_mesh& mesh, uint32_t frame_a, uint32_t frame_b, float t, const morph_output& out);
+
+} } // skirmish::md3
+
+#endif
@@ -0,0 +1,182 @@
+#include "tags.h"
+#include <skirmish/math/3dmath.h>
+#include <skirmish/util/cpu.h>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+
+#if SKIRMISH_X86
+#include <immintrin.h>
+#endif
+
+namespace skirmish { namespace md3 {
+
+static_assert(sizeof(tag_frame) == 8 * sizeof(float) && offsetof(tag_frame, origin) == 4 * sizeof(float), "tag_frame must be 8 packed floats");
+
+tag_table::tag_table(const file& f, float position_scale) : num_frames_(f.hdr.num_frames)
+{
+    const auto num_tags = f.hdr.num_tags;
+    if (f.tags.size() != static_cast<size_t>(num_tags) * num_frames_) {
+        throw std::runtime_error("Invalid number of tags in md3 file");
+    }
+
+    // The file stores all tags of the first frame followed by all tags of the next frame and so on
+    names_.reserve(num_tags);
+    frames_.resize(f.tags.size());
+    for (uint32_t tag = 0; tag < num_tags; ++tag) {
+        names_.emplace_back(f.tags[tag].name);
+        for (uint32_t frame = 0; frame < num_frames_; ++frame) {
+            const auto& t = f.tags[frame * num_tags + tag];
+            assert(names_.back() == t.name);
+            // The axes are the columns of the rotation matrix
+            const mat<3, 3, float, model_space> axes{
+                t.x_axis.x, t.y_axis.x, t.z_axis.x,
+                t.x_axis.y, t.y_axis.y, t.z_axis.y,
+                t.x_axis.z, t.y_axis.z, t.z_axis.z,
+            };
+            auto& tf = frames_[static_cast<size_t>(tag) * num_frames_ + frame];
+            tf.rotation = make_quat(axes);
+            tf.origin   = vec3{position_scale * t.origin.x, position_scale * t.origin.y, position_scale * t.origin.z};
+            tf.unused   = 0;
+        }
+    }
+}
+
+uint32_t tag_table::index(const char* name) const
+{
+    for (uint32_t tag = 0; tag < num_tags(); ++tag) {
+        if (names_[tag] == name) {
+            return tag;
+        }
+    }
+    throw std::runtime_error("Tag " + std::string(name) + " not found");
+}
+
+namespace {
+
+void interpolate_tags_scalar(const tag_sample* samples, size_t first, size_t count, tag_frame* out)
+{
+    for (size_t i = first; i < count; ++i) {
+        const auto& a = *samples[i].a;
+        const auto& b = *samples[i].b;
+        const auto  t = samples[i].t;
+        out[i].rotation = nlerp(a.rotation, b.rotation, t);
+        out[i].origin   = vec3{a.origin.x + (b.origin.x - a.origin.x) * t, a.origin.y + (b.origin.y - a.origin.y) * t, a.origin.z + (b.origin.z - a.origin.z) * t};
+        out[i].unused   = 0;
+    }
+}
+
+#if SKIRMISH_X86
+// Four samples at a time: the rotations and origins of the four are transposed so each register holds one
+// component of all of them. The normalization uses rsqrt refined by a Newton-Raphson step instead of sqrt and
+// division (after taking the shortest arc the squared length is at least 1/2, so rsqrt is never passed zero).
+SKIRMISH_TARGET("sse2")
+void interpolate_tags_sse(const tag_sample* samples, size_t count, tag_frame* out)
+{
+    const __m128 one       = _mm_set1_ps(1.0f);
+    const __m128 half      = _mm_set1_ps(0.5f);
+    const __m128 three     = _mm_set1_ps(3.0f);
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const tag_sample* s = samples + i;
+        __m128 ax = _mm_loadu_ps(&s[0].a->rotation.x), ay = _mm_loadu_ps(&s[1].a->rotation.x), az = _mm_loadu_ps(&s[2].a->rotation.x), aw = _mm_loadu_ps(&s[3].a->rotation.x);
+        __m128 bx = _mm_loadu_ps(&s[0].b->rotation.x), by = _mm_loadu_ps(&s[1].b->rotation.x), bz = _mm_loadu_ps(&s[2].b->rotation.x), bw = _mm_loadu_ps(&s[3].b->rotation.x);
+        __m128 aox = _mm_loadu_ps(&s[0].a->origin.x), aoy = _mm_loadu_ps(&s[1].a->origin.x), aoz = _mm_loadu_ps(&s[2].a->origin.x), aou = _mm_loadu_ps(&s[3].a->origin.x);
+        __m128 box = _mm_loadu_ps(&s[0].b->origin.x), boy = _mm_loadu_ps(&s[1].b->origin.x), boz = _mm_loadu_ps(&s[2].b->origin.x), bou = _mm_loadu_ps(&s[3].b->origin.x);
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+        _MM_TRANSPOSE4_PS(aox, aoy, aoz, aou);
+        _MM_TRANSPOSE4_PS(box, boy, boz, bou);
+        const __m128 t = _mm_setr_ps(s[0].t, s[1].t, s[2].t, s[3].t);
+
+        // Negate t for b where the quaternions are more than 90 degrees apart
+        const __m128 d  = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+        const __m128 tb = _mm_xor_ps(t, _mm_and_ps(d, sign_mask));
+        const __m128 ta = _mm_sub_ps(one, t);
+        __m128 qx = _mm_add_ps(_mm_mul_ps(ax, ta), _mm_mul_ps(bx, tb));
+        __m128 qy = _mm_add_ps(_mm_mul_ps(ay, ta), _mm_mul_ps(by, tb));
+        __m128 qz = _mm_add_ps(_mm_mul_ps(az, ta), _mm_mul_ps(bz, tb));
+        __m128 qw = _mm_add_ps(_mm_mul_ps(aw, ta), _mm_mul_ps(bw, tb));
+
+        const __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw)));
+        const __m128 r    = _mm_rsqrt_ps(len2);
+        const __m128 inv  = _mm_mul_ps(_mm_mul_ps(half, r), _mm_sub_ps(three, _mm_mul_ps(_mm_mul_ps(len2, r), r)));
+        qx = _mm_mul_ps(qx, inv);
+        qy = _mm_mul_ps(qy, inv);
+        qz = _mm_mul_ps(qz, inv);
+        qw = _mm_mul_ps(qw, inv);
+
+        __m128 ox = _mm_add_ps(aox, _mm_mul_ps(_mm_sub_ps(box, aox), t));
+        __m128 oy = _mm_add_ps(aoy, _mm_mul_ps(_mm_sub_ps(boy, aoy), t));
+        __m128 oz = _mm_add_ps(aoz, _mm_mul_ps(_mm_sub_ps(boz, aoz), t));
+        __m128 ou = _mm_setzero_ps();
+
+        _MM_TRANSPOSE4_PS(qx, qy, qz, qw);
+        _MM_TRANSPOSE4_PS(ox, oy, oz, ou);
+        tag_frame* o = out + i;
+        _mm_storeu_ps(&o[0].rotation.x, qx); _mm_storeu_ps(&o[0].origin.x, ox);
+        _mm_storeu_ps(&o[1].rotation.x, qy); _mm_storeu_ps(&o[1].origin.x, oy);
+        _mm_storeu_ps(&o[2].rotation.x, qz); _mm_storeu_ps(&o[2].origin.x, oz);
+        _mm_storeu_ps(&o[3].rotation.x, qw); _mm_storeu_ps(&o[3].origin.x, ou);
+    }
+    interpolate_tags_scalar(samples, i, count, out);
+}
+#endif
+
+using interpolate_tags_function = void (*)(const tag_sample*, size_t, tag_frame*);
+
+void interpolate_tags_scalar_all(const tag_sample* samples, size_t count, tag_frame* out)
+{
+    interpolate_tags_scalar(samples, 0, count, out);
+}
+
+interpolate_tags_function function_for(interpolate_tags_implementation impl)
+{
+    switch (impl) {
+    case interpolate_tags_implementation::scalar:
+        return &interpolate_tags_scalar_all;
+#if SKIRMISH_X86
+    case interpolate_tags_implementation::sse:
+        return &interpolate_tags_sse;
+#else
+    default:
+        break;
+#endif
+    }
+    assert(false);
+    return &interpolate_tags_scalar_all;
+}
+
+} // unnamed namespace
+
+bool interpolate_tags_supported(interpolate_tags_implementation impl)
+{
+    switch (impl) {
+    case interpolate_tags_implementation::scalar:
+        return true;
+    case interpolate_tags_implementation::sse:
+        return SKIRMISH_X86 != 0;
+    }
+    return false;
+}
+
+interpolate_tags_implementation interpolate_tags_best_implementation()
+{
+    if (interpolate_tags_supported(interpolate_tags_implementation::sse)) return interpolate_tags_implementation::sse;
+    return interpolate_tags_implementation::scalar;
+}
+
+void interpolate_tags(const tag_sample* samples, size_t count, tag_frame* out)
+{
+    static const interpolate_tags_function best = function_for(interpolate_tags_best_implementation());
+    best(samples, count, out);
+}
+
+void interpolate_tags(interpolate_tags_implementation impl, const tag_sample* samples, size_t count, tag_frame* out)
+{
+    assert(interpolate_tags_supported(impl));
+    function_for(impl)(samples, count, out);
+}
+
+} } // skirmish::md3
@@ -0,0 +1,88 @@
+#ifndef SKIRMISH_MD3_TAGS_H
+#define SKIRMISH_MD3_TAGS_H
+
+#include "md3.h"
+#include <skirmish/math/quat.h>
+#include <cassert>
+#include <string>
+#include <vector>
+
+namespace skirmish { namespace md3 {
+
+// Coordinate system of a model
+struct model_space;
+using model_quat = quat<float, model_space>;
+
+// The transform of a tag in one frame (or between two frames): rotation followed by translation by origin.
+// Padded to 32 bytes so it can be moved with two 16 byte loads/stores.
+struct tag_frame {
+    model_quat rotation;
+    vec3       origin;
+    float      unused;
+};
+
+// One tag interpolated between two of its frames by t
+struct tag_sample {
+    const tag_frame* a;
+    const tag_frame* b;
+    float            t;
+};
+
+// The tags of a model rearranged so all frames of a tag are contiguous and looked up by index. Names are
+// resolved to indices once (at load time) instead of being searched for every frame. The axes of the tags
+// are converted to quaternions and the origins are scaled by position_scale (e.g. quake_to_meters_f).
+class tag_table {
+public:
+    explicit tag_table(const file& f, float position_scale = 1.0f);
+
+    uint32_t num_tags() const { return static_cast<uint32_t>(names_.size()); }
+    uint32_t num_frames() const { return num_frames_; }
+
+    const std::string& name(uint32_t tag) const {
+        return names_[tag];
+    }
+
+    // Returns the index of the named tag, throws std::runtime_error if there's no such tag
+    uint32_t index(const char* name) const;
+
+    // All num_frames() frames of a tag
+    const tag_frame* frames(uint32_t tag) const {
+        return &frames_[static_cast<size_t>(tag) * num_frames_];
+    }
+
+    const tag_frame& frame(uint32_t tag, uint32_t frame) const {
+        assert(tag < num_tags() && frame < num_frames_);
+        return frames(tag)[frame];
+    }
+
+    tag_sample sample(uint32_t tag, uint32_t frame_a, uint32_t frame_b, float t) const {
+        return tag_sample{&frame(tag, frame_a), &frame(tag, frame_b), t};
+    }
+
+private:
+    uint32_t                 num_frames_;
+    std::vector<std::string> names_;
+    std::vector<tag_frame>   frames_; // num_frames_ per tag
+};
+
+enum class interpolate_tags_implementation {
+    scalar,
+    sse,    // x86
+};
+
+// Returns true if impl can be used on this machine
+bool interpolate_tags_supported(interpolate_tags_implementation impl);
+
+// The fastest supported implementation (used by interpolate_tags below)
+interpolate_tags_implementation interpolate_tags_best_implementation();
+
+// Interpolates count samples (of any number of tags and models) in one pass, writing the result for samples[i]
+// to out[i]. Rotations are nlerped along the shortest arc and origins are interpolated linearly. Doesn't allocate.
+void interpolate_tags(const tag_sample* samples, size_t count, tag_frame* out);
+
+// As above, using a specific implementation (which must be supported)
+void interpolate_tags(interpolate_tags_implementation impl, const tag_sample* samples, size_t count, tag_frame* out);
+
+} } // skirmish::md3
+
+#endif
@@ -1,43 +1,42 @@
 #include "obj.h"
 #include <skirmish/util/stream.h>
 #include <skirmish/util/text.h>
-#include <sstream>
+#include <stdexcept>
 
 namespace skirmish { namespace obj {
 
 bool read(util::in_stream& in, file& f)
 {
-    for (std::string line; !in.error() && in.tell() < in.stream_size();) {
-        read_line(in, line);
-        std::istringstream iss{line};
-
+    util::line_tokenizer<> tokenizer{in};
+    while (tokenizer.next_line()) {
         auto err = [&] (const std::string& msg) {
-            throw std::runtime_error("Invalid obj file. Line: '" + line + "'. Error: " + msg);
+            throw std::runtime_error("Invalid obj file. Line: '" + tokenizer.line_string() + "'. Error: " + msg);
         };
 
-        char element;
-        if (!(iss >> element)) {
+        const auto token = tokenizer.next_token();
+        if (!token.size()) {
             err("Empty line");
         }
+        const char element = token.size() == 1 || token[0] == '#' ? token[0] : '\0';
         if (element == '#') { // comment
             continue;
         } else if (element == 'v') { // geometric vertex 
             float x, y, z;
-            if (!(iss >> x >> y >> z)) {
+            if (!tokenizer.next_number(x) || !tokenizer.next_number(y) || !tokenizer.next_number(z)) {
                 err("Incomplete vertex line");
             }
             float w;
-            if ((iss >> w) && w != 1.0f) {
+            if (tokenizer.next_number(w) && w != 1.0f) {
                 err("w != 1 not supported");
             }
             f.vertices.push_back({x, y, z});
         } else if (element == 'f') { // Polygonal face element
             unsigned long long a, b, c;
-            if (!(iss >> a >> b >> c)) {
+            if (!tokenizer.next_number(a) || !tokenizer.next_number(b) || !tokenizer.next_number(c)) {
                 err("Incomplete polygonal face line");
             }
             unsigned long long d;
-            if (iss >> d) {
+            if (tokenizer.next_number(d)) {
                 err("Only triangles supported");
             }
 
@@ -60,7 +59,7 @@ bool read(util::in_stream& in, file& f)
         }
     }
 
-    return !in.error();
+    return !tokenizer.error();
 }
 
 } } // namespace skirmish::obj
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "buffer_pool.h"
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <cassert>
+
+namespace skirmish { namespace util {
+
+class buffer_pool::impl {
+public:
+    explicit impl(size_t max_free_per_size) : max_free_per_size_(max_free_per_size), stats_() {
+    }
+
+    std::unique_ptr<uint8_t[]> acquire(size_t size) {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            auto it = free_.find(size);
+            if (it != free_.end() && !it->second.empty()) {
+                auto data = std::move(it->second.back());
+                it->second.pop_back();
+                ++stats_.reuses;
+                return data;
+            }
+            ++stats_.allocations;
+        }
+        return std::unique_ptr<uint8_t[]>(new uint8_t[size]);
+    }
+
+    void release(std::unique_ptr<uint8_t[]> data, size_t size) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto& free = free_[size];
+        if (free.size() < max_free_per_size_) {
+            free.push_back(std::move(data));
+        }
+    }
+
+    statistics stats() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return stats_;
+    }
+
+private:
+    const size_t                                                         max_free_per_size_;
+    mutable std::mutex                                                   mutex_;
+    std::unordered_map<size_t, std::vector<std::unique_ptr<uint8_t[]>>> free_;
+    statistics                                                           stats_;
+};
+
+buffer_pool::buffer::buffer(buffer&& other) : pool_(std::move(other.pool_)), data_(std::move(other.data_)), size_(other.size_)
+{
+    other.size_ = 0;
+}
+
+buffer_pool::buffer& buffer_pool::buffer::operator=(buffer&& other)
+{
+    if (this != &other) {
+        release();
+        pool_ = std::move(other.pool_);
+        data_ = std::move(other.data_);
+        size_ = other.size_;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+buffer_pool::buffer::~buffer()
+{
+    release();
+}
+
+void buffer_pool::buffer::release()
+{
+    if (data_) {
+        assert(pool_);
+        pool_->release(std::move(data_), size_);
+    }
+    pool_.reset();
+    size_ = 0;
+}
+
+buffer_pool::buffer_pool(size_t max_free_per_size) : impl_(std::make_shared<impl>(max_free_per_size))
+{
+}
+
+buffer_pool::~buffer_pool() = default;
+
+buffer_pool::buffer buffer_pool::acquire(size_t size)
+{
+    buffer b;
+    b.pool_ = impl_;
+    b.data_ = impl_->acquire(size);
+    b.size_ = size;
+    return b;
+}
+
+buffer_pool::statistics buffer_pool::stats() const
+{
+    return impl_->stats();
+}
+
+buffer_pool& buffer_pool::shared()
+{
+    static buffer_pool pool;
+    return pool;
+}
+
+} } // namespace skirmish::util
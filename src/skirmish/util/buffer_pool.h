@@ -0,0 +1,59 @@
+#ifndef SKIRMISH_UTIL_BUFFER_POOL_H
+#define SKIRMISH_UTIL_BUFFER_POOL_H
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace skirmish { namespace util {
+
+// Keeps released byte buffers (per size) so streams that are opened and closed in quick succession reuse
+// the same memory instead of allocating it again. Safe to use from multiple threads.
+class buffer_pool {
+public:
+    class impl;
+
+    // Buffer borrowed from a pool, it's given back when destroyed (the pool may be destroyed first)
+    class buffer {
+    public:
+        buffer() = default;
+        buffer(buffer&& other);
+        buffer& operator=(buffer&& other);
+        ~buffer();
+
+        uint8_t* data() const { return data_.get(); }
+        size_t size() const { return size_; }
+
+    private:
+        friend class buffer_pool;
+        std::shared_ptr<impl>      pool_;
+        std::unique_ptr<uint8_t[]> data_;
+        size_t                     size_ = 0;
+
+        void release();
+    };
+
+    struct statistics {
+        uint64_t allocations; // Buffers that had to be allocated
+        uint64_t reuses;      // Buffers handed out again
+    };
+
+    // At most max_free_per_size released buffers of each size are kept
+    explicit buffer_pool(size_t max_free_per_size = 16);
+    ~buffer_pool();
+
+    // Contents of the returned buffer are undefined
+    buffer acquire(size_t size);
+
+    statistics stats() const;
+
+    // The pool used by the streams in util
+    static buffer_pool& shared();
+
+private:
+    std::shared_ptr<impl> impl_;
+};
+
+} } // namespace skirmish::util
+
+#endif
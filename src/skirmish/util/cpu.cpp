@@ -0,0 +1,85 @@
+#include "cpu.h"
+#include <stdint.h>
+
+#if SKIRMISH_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace skirmish { namespace util {
+
+namespace {
+
+#if SKIRMISH_X86
+struct cpuid_result {
+    uint32_t eax, ebx, ecx, edx;
+};
+
+cpuid_result cpuid(uint32_t leaf, uint32_t subleaf)
+{
+    cpuid_result r;
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuidex(regs, static_cast<int>(leaf), static_cast<int>(subleaf));
+    r.eax = static_cast<uint32_t>(regs[0]);
+    r.ebx = static_cast<uint32_t>(regs[1]);
+    r.ecx = static_cast<uint32_t>(regs[2]);
+    r.edx = static_cast<uint32_t>(regs[3]);
+#else
+    __cpuid_count(leaf, subleaf, r.eax, r.ebx, r.ecx, r.edx);
+#endif
+    return r;
+}
+
+// Register state the OS saves on context switches (XCR0), only valid if OSXSAVE is set
+uint64_t xgetbv0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return lo | (static_cast<uint64_t>(hi) << 32);
+#endif
+}
+
+cpu_features detect()
+{
+    cpu_features f{};
+    const auto max_leaf = cpuid(0, 0).eax;
+    if (max_leaf < 1) {
+        return f;
+    }
+    const auto leaf1 = cpuid(1, 0);
+    f.sse41  = (leaf1.ecx & (1 << 19)) != 0;
+    f.sse42  = (leaf1.ecx & (1 << 20)) != 0;
+    f.pclmul = (leaf1.ecx & (1 << 1)) != 0;
+
+    const bool osxsave = (leaf1.ecx & (1 << 27)) != 0;
+    const bool ymm_saved = osxsave && (xgetbv0() & 6) == 6; // XMM and YMM state
+    f.avx = ymm_saved && (leaf1.ecx & (1 << 28)) != 0;
+    f.fma = f.avx && (leaf1.ecx & (1 << 12)) != 0;
+    if (max_leaf >= 7) {
+        f.avx2 = f.avx && (cpuid(7, 0).ebx & (1 << 5)) != 0;
+    }
+    return f;
+}
+#else
+cpu_features detect()
+{
+    return cpu_features{};
+}
+#endif
+
+} // unnamed namespace
+
+const cpu_features& cpu()
+{
+    static const cpu_features features = detect();
+    return features;
+}
+
+} } // namespace skirmish::util
@@ -0,0 +1,36 @@
+#ifndef SKIRMISH_UTIL_CPU_H
+#define SKIRMISH_UTIL_CPU_H
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SKIRMISH_X86 1
+#else
+#define SKIRMISH_X86 0
+#endif
+
+// Allows a function to use instructions beyond what the rest of the program is compiled for (MSVC lets any
+// function use them). Only call such functions after checking cpu().
+#if defined(__GNUC__)
+#define SKIRMISH_TARGET(features) __attribute__((target(features)))
+#else
+#define SKIRMISH_TARGET(features)
+#endif
+
+namespace skirmish { namespace util {
+
+// Instruction set extensions that can be used on the current machine (AVX and the extensions building
+// on it also require the OS to save the YMM registers)
+struct cpu_features {
+    bool sse41;
+    bool sse42;
+    bool pclmul;
+    bool avx;
+    bool avx2;
+    bool fma;
+};
+
+// Detected on first use
+const cpu_features& cpu();
+
+} } // namespace skirmish::util
+
+#endif
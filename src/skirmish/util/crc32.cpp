@@ -0,0 +1,193 @@
+#include "crc32.h"
+#include "cpu.h"
+#include "stream.h"
+#include <cassert>
+
+#if SKIRMISH_X86
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+namespace skirmish { namespace util {
+
+namespace {
+
+constexpr uint32_t polynomial = 0xedb88320; // Reversed
+
+struct crc32_tables {
+    uint32_t t[8][256]; // t[0] is the byte-wise table, t[k] advances t[k-1] by another zero byte
+
+    crc32_tables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (polynomial & (0 - (crc & 1)));
+            }
+            t[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k) {
+                t[k][i] = (t[k-1][i] >> 8) ^ t[0][t[k-1][i] & 0xff];
+            }
+        }
+    }
+};
+
+const crc32_tables& tables()
+{
+    static const crc32_tables instance;
+    return instance;
+}
+
+// The functions below work on the inverted crc
+
+uint32_t crc32_table(uint32_t crc, const uint8_t* p, size_t size)
+{
+    const auto& t = tables().t;
+    for (; size; --size) {
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+uint32_t crc32_slicing_by_8(uint32_t crc, const uint8_t* p, size_t size)
+{
+    const auto& t = tables().t;
+    for (; size >= 8; size -= 8, p += 8) {
+        const uint32_t lo = load_u32_le(p) ^ crc;
+        const uint32_t hi = load_u32_le(p + 4);
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+    return crc32_table(crc, p, size);
+}
+
+#if SKIRMISH_X86
+// Folds 64 bytes at a time into four 128-bit accumulators, then reduces those with a Barrett reduction.
+// See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009).
+// The constants are for the bit-reflected CRC-32 polynomial.
+constexpr size_t pclmul_min_size = 64;
+
+SKIRMISH_TARGET("sse2")
+inline __m128i load_m128(const uint8_t* src)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+}
+
+// Folds x across 128 bits (or 512 bits with k1k2) and adds in data
+SKIRMISH_TARGET("pclmul")
+inline __m128i fold(__m128i x, __m128i k, __m128i data)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00)), data);
+}
+
+SKIRMISH_TARGET("pclmul,sse4.1")
+uint32_t crc32_pclmul_blocks(uint32_t crc, const uint8_t* p, size_t size)
+{
+    assert(size >= pclmul_min_size && size % 16 == 0);
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1 = _mm_xor_si128(load_m128(p), _mm_cvtsi32_si128(static_cast<int>(crc)));
+    __m128i x2 = load_m128(p + 16);
+    __m128i x3 = load_m128(p + 32);
+    __m128i x4 = load_m128(p + 48);
+    p += 64;
+    size -= 64;
+
+    for (; size >= 64; p += 64, size -= 64) {
+        x1 = fold(x1, k1k2, load_m128(p));
+        x2 = fold(x2, k1k2, load_m128(p + 16));
+        x3 = fold(x3, k1k2, load_m128(p + 32));
+        x4 = fold(x4, k1k2, load_m128(p + 48));
+    }
+
+    // Fold into 128 bits
+    x1 = fold(x1, k3k4, x2);
+    x1 = fold(x1, k3k4, x3);
+    x1 = fold(x1, k3k4, x4);
+    for (; size >= 16; p += 16, size -= 16) {
+        x1 = fold(x1, k3k4, load_m128(p));
+    }
+
+    // Fold 128 bits to 64 bits
+    __m128i t = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), t);
+    t = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+
+    // Barrett reduction to 32 bits
+    t = _mm_and_si128(x1, mask);
+    t = _mm_clmulepi64_si128(t, poly, 0x10);
+    t = _mm_and_si128(t, mask);
+    t = _mm_clmulepi64_si128(t, poly, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+uint32_t crc32_pclmul(uint32_t crc, const uint8_t* p, size_t size)
+{
+    if (size >= pclmul_min_size) {
+        const auto block_size = size & ~static_cast<size_t>(15);
+        crc = crc32_pclmul_blocks(crc, p, block_size);
+        p += block_size;
+        size -= block_size;
+    }
+    return crc32_slicing_by_8(crc, p, size);
+}
+#endif
+
+using crc32_function = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+crc32_function function_for(crc32_implementation impl)
+{
+    switch (impl) {
+    case crc32_implementation::table:
+        return &crc32_table;
+    case crc32_implementation::slicing_by_8:
+        return &crc32_slicing_by_8;
+    case crc32_implementation::pclmul:
+#if SKIRMISH_X86
+        return &crc32_pclmul;
+#else
+        break;
+#endif
+    }
+    assert(false);
+    return &crc32_slicing_by_8;
+}
+
+} // unnamed namespace
+
+bool crc32_supported(crc32_implementation impl)
+{
+    if (impl == crc32_implementation::pclmul) {
+        return SKIRMISH_X86 && cpu().pclmul && cpu().sse41;
+    }
+    return true;
+}
+
+crc32_implementation crc32_best_implementation()
+{
+    return crc32_supported(crc32_implementation::pclmul) ? crc32_implementation::pclmul : crc32_implementation::slicing_by_8;
+}
+
+uint32_t crc32(uint32_t crc, const void* data, size_t size)
+{
+    static const crc32_function best = function_for(crc32_best_implementation());
+    return ~best(~crc, static_cast<const uint8_t*>(data), size);
+}
+
+uint32_t crc32(crc32_implementation impl, uint32_t crc, const void* data, size_t size)
+{
+    assert(crc32_supported(impl));
+    return ~function_for(impl)(~crc, static_cast<const uint8_t*>(data), size);
+}
+
+} } // namespace skirmish::util
@@ -0,0 +1,29 @@
+#ifndef SKIRMISH_UTIL_CRC32_H
+#define SKIRMISH_UTIL_CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace skirmish { namespace util {
+
+enum class crc32_implementation {
+    table,          // One byte at a time
+    slicing_by_8,   // Eight bytes at a time using eight tables
+    pclmul,         // Carry-less multiplication folding (x86 with PCLMULQDQ and SSE4.1)
+};
+
+// Returns true if impl can be used on this machine
+bool crc32_supported(crc32_implementation impl);
+
+// The fastest supported implementation (used by crc32 below)
+crc32_implementation crc32_best_implementation();
+
+// Updates crc (the CRC-32 used by zip and zlib, 0 for the initial value) with size bytes from data
+uint32_t crc32(uint32_t crc, const void* data, size_t size);
+
+// As above, using a specific implementation (which must be supported)
+uint32_t crc32(crc32_implementation impl, uint32_t crc, const void* data, size_t size);
+
+} } // namespace skirmish::util
+
+#endif
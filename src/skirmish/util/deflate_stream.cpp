@@ -1,8 +1,15 @@
 #include "deflate_stream.h"
+#include "thread_pool.h"
+#include "buffer_pool.h"
+#include "crc32.h"
 #include <cassert>
 #include <zlib.h>
 #include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
 #include <algorithm>
+#include <climits>
 
 namespace skirmish { namespace util {
 
@@ -12,49 +19,137 @@ public:
     }
 };
 
-class in_deflate_stream::impl {
+namespace {
+
+// Raw inflate states kept for reuse, resetting a state is much cheaper than inflateEnd followed by inflateInit2
+class inflater_pool : public std::enable_shared_from_this<inflater_pool> {
 public:
-    explicit impl(in_stream& s, size_t compressed_size, size_t uncompressed_size)
-        : s_(s)
-        , compressed_size_(compressed_size)
-        , uncompressed_size_(uncompressed_size)
-        , crc32_(::crc32(0, nullptr, 0))
-        , stream_() {
-        assert(!s.error());
-        int ret = inflateInit2(&stream_, -MAX_WBITS); // Initialize inflate in raw mode (no header)
+    class deleter {
+    public:
+        deleter() = default;
+        explicit deleter(std::shared_ptr<inflater_pool> pool) : pool_(std::move(pool)) {}
+
+        void operator()(z_stream* stream) const {
+            pool_->release(stream);
+        }
+
+    private:
+        std::shared_ptr<inflater_pool> pool_; // Keeps the pool alive until all states are back
+    };
+
+    using handle = std::unique_ptr<z_stream, deleter>;
+
+    ~inflater_pool() {
+        for (auto stream : free_) {
+            destroy(stream);
+        }
+    }
+
+    // The pool shared by all deflate streams
+    static inflater_pool& shared() {
+        static const auto pool = std::make_shared<inflater_pool>();
+        return *pool;
+    }
+
+    handle acquire() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (!free_.empty()) {
+                auto stream = free_.back();
+                free_.pop_back();
+                return handle{stream, deleter{shared_from_this()}};
+            }
+        }
+        auto stream = new z_stream{};
+        int ret = inflateInit2(stream, -MAX_WBITS); // Initialize inflate in raw mode (no header)
         if (ret != Z_OK) {
+            delete stream;
             throw zlib_exception("inflateInit failed", ret);
         }
+        return handle{stream, deleter{shared_from_this()}};
     }
 
-    ~impl() {
-        inflateEnd(&stream_);
+private:
+    static constexpr size_t max_free = 16;
+
+    std::mutex             mutex_;
+    std::vector<z_stream*> free_;
+
+    void release(z_stream* stream) {
+        if (inflateReset(stream) == Z_OK) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (free_.size() < max_free) {
+                free_.push_back(stream);
+                return;
+            }
+        }
+        destroy(stream);
+    }
+
+    static void destroy(z_stream* stream) {
+        inflateEnd(stream);
+        delete stream;
+    }
+};
+constexpr size_t inflater_pool::max_free;
+
+} // unnamed namespace
+
+class in_deflate_stream::impl {
+public:
+    explicit impl(in_stream& s, uint64_t compressed_size, uint64_t uncompressed_size, uint64_t checkpoint_interval, size_t buffer_size, bool compute_crc32)
+        : s_(s)
+        , in_start_(s.tell())
+        , compressed_size_(compressed_size)
+        , uncompressed_size_(uncompressed_size)
+        , checkpoint_interval_(checkpoint_interval)
+        , total_in_(0)
+        , total_out_(0)
+        , buffer_pos_(0)
+        , compute_crc32_(compute_crc32)
+        , crc32_(0)
+        , crc32_pos_(0)
+        , stream_(inflater_pool::shared().acquire())
+        , buffer_(buffer_pool::shared().acquire(buffer_size)) {
+        assert(!s.error());
+        assert(buffer_size > 0);
+        // Recycled states keep the buffer pointers of their previous user
+        stream_->next_in   = nullptr;
+        stream_->avail_in  = 0;
+        stream_->next_out  = nullptr;
+        stream_->avail_out = 0;
     }
 
     array_view<uint8_t> refill() {
-        assert(!stream_.avail_out);
-        const auto avail_out_on_start = std::min(static_cast<uInt>(buffer_size), static_cast<uInt>(uncompressed_size_ - stream_.total_out));
-        stream_.avail_out = avail_out_on_start;
-        stream_.next_out  = buffer_;
+        assert(!stream_->avail_out);
+        buffer_pos_ = total_out_;
+        const auto avail_out_on_start = static_cast<uInt>(std::min(static_cast<uint64_t>(std::min(buffer_.size(), static_cast<size_t>(UINT_MAX))), uncompressed_size_ - total_out_));
+        stream_->avail_out = avail_out_on_start;
+        stream_->next_out  = buffer_.data();
 
         do {
             assert(!end_reached());
 
-            if (!stream_.avail_in) {
-                assert(stream_.total_in < compressed_size_);
+            if (!stream_->avail_in) {
+                assert(total_in_ < compressed_size_);
                 s_.ensure_bytes_available();
                 auto in_buf = s_.peek();
-                stream_.avail_in = std::min(static_cast<uInt>(in_buf.size()), static_cast<uInt>(compressed_size_ - stream_.total_in));
-                stream_.next_in  = const_cast<uint8_t*>(in_buf.begin());
-                s_.seek(stream_.avail_in, seekdir::cur); // mark bytes as consumed
+                stream_->avail_in = static_cast<uInt>(std::min(static_cast<uint64_t>(std::min(in_buf.size(), static_cast<size_t>(UINT_MAX))), compressed_size_ - total_in_));
+                stream_->next_in  = const_cast<uint8_t*>(in_buf.begin());
+                s_.seek(stream_->avail_in, seekdir::cur); // mark bytes as consumed
             }
 
-            assert(stream_.avail_in);
-            assert(stream_.avail_out);
+            assert(stream_->avail_in);
+            assert(stream_->avail_out);
 
-            int ret = inflate(&stream_, Z_NO_FLUSH);
+            // z_stream's totals are only 32-bit on some platforms, so keep our own
+            const auto avail_in_before  = stream_->avail_in;
+            const auto avail_out_before = stream_->avail_out;
+            int ret = inflate(stream_.get(), Z_BLOCK);
+            total_in_  += avail_in_before - stream_->avail_in;
+            total_out_ += avail_out_before - stream_->avail_out;
             if (ret != Z_OK && ret != Z_STREAM_END) {
-                throw zlib_exception("zlib inflate failed: " + std::string(stream_.msg ? stream_.msg : "unknown error"), ret);
+                throw zlib_exception("zlib inflate failed: " + std::string(stream_->msg ? stream_->msg : "unknown error"), ret);
             }
 
             if (ret == Z_STREAM_END) {
@@ -63,37 +158,147 @@ public:
                     // TODO: Turn this into a soft error?
                     throw std::runtime_error("Premature EOF in deflate stream");
                 }
+            } else {
+                maybe_add_checkpoint();
             }
-        } while (!end_reached() && stream_.avail_out);
+        } while (!end_reached() && stream_->avail_out);
 
-        auto buf = make_array_view(buffer_, avail_out_on_start - stream_.avail_out);
-        crc32_ = ::crc32(crc32_, buf.begin(), static_cast<uInt>(buf.size()));
+        auto buf = make_array_view(buffer_.data(), avail_out_on_start - stream_->avail_out);
+        // Only output that hasn't been seen before is added to the checksum
+        if (compute_crc32_ && buffer_pos_ <= crc32_pos_ && crc32_pos_ < total_out_) {
+            const auto skip = static_cast<size_t>(crc32_pos_ - buffer_pos_);
+            crc32_ = util::crc32(crc32_, buf.begin() + skip, buf.size() - skip);
+            crc32_pos_ = total_out_;
+        }
 
         return buf;
     }
 
+    // Repositions the decompressor so that pos is inside (or at the end of) buffer()
+    void seek(uint64_t pos) {
+        assert(pos <= uncompressed_size_);
+        if (pos < buffer_pos_) {
+            restart_from(checkpoint_before(pos));
+        }
+        while (!end_reached() && total_out_ <= pos) {
+            stream_->avail_out = 0;
+            refill();
+        }
+    }
+
+    // Output position of the first byte in buffer()
+    uint64_t buffer_pos() const {
+        return buffer_pos_;
+    }
+
+    // The most recently decompressed data
+    array_view<uint8_t> buffer() const {
+        return make_array_view(buffer_.data(), static_cast<size_t>(total_out_ - buffer_pos_));
+    }
+
     uint32_t crc32() const {
-        assert(end_reached());
+        assert(compute_crc32_ && crc32_pos_ == uncompressed_size_);
         return crc32_;
     }
 
+    uint64_t uncompressed_size() const {
+        return uncompressed_size_;
+    }
+
     bool end_reached() const {
-        return stream_.total_out >= uncompressed_size_;
+        return total_out_ >= uncompressed_size_;
     }
 
 private:
-    in_stream&  s_;
-    size_t      compressed_size_;
-    size_t      uncompressed_size_;
-    uint32_t    crc32_;
-    z_stream    stream_;
-
-    static constexpr size_t buffer_size = 16384;
-    uint8_t    buffer_[buffer_size];
+    static constexpr size_t window_size = 32768;
+
+    // Enough state to restart decompression at a block boundary
+    struct checkpoint {
+        uint64_t             in_pos;  // Compressed bytes consumed
+        uint64_t             out_pos; // Uncompressed bytes produced
+        int                  bits;    // Bits of the byte at in_pos-1 that belong to the next block
+        std::vector<uint8_t> window;  // Last (up to) 32K of output
+    };
+
+    in_stream&              s_;
+    uint64_t                in_start_;
+    uint64_t                compressed_size_;
+    uint64_t                uncompressed_size_;
+    uint64_t                checkpoint_interval_;
+    uint64_t                total_in_;
+    uint64_t                total_out_;
+    uint64_t                buffer_pos_;
+    bool                    compute_crc32_;
+    uint32_t                crc32_;
+    uint64_t                crc32_pos_;   // Number of bytes covered by crc32_
+    inflater_pool::handle   stream_;
+    buffer_pool::buffer     buffer_;
+    std::vector<checkpoint> checkpoints_; // Sorted by position
+
+    void maybe_add_checkpoint() {
+        // Only at the end of a block that isn't the last one
+        if ((stream_->data_type & 128) == 0 || (stream_->data_type & 64) != 0) {
+            return;
+        }
+        // Checkpoints are only added the first time we pass a position
+        const auto last_out_pos = checkpoints_.empty() ? 0 : checkpoints_.back().out_pos;
+        if (total_out_ < last_out_pos + checkpoint_interval_) {
+            return;
+        }
+        checkpoint cp;
+        cp.in_pos  = total_in_;
+        cp.out_pos = total_out_;
+        cp.bits    = stream_->data_type & 7;
+        cp.window.resize(window_size);
+        uInt window_length = 0;
+        int ret = inflateGetDictionary(stream_.get(), cp.window.data(), &window_length);
+        if (ret != Z_OK) {
+            throw zlib_exception("inflateGetDictionary failed", ret);
+        }
+        cp.window.resize(window_length);
+        checkpoints_.push_back(std::move(cp));
+    }
+
+    // Returns the last checkpoint at or before pos (or nullptr if decompression has to start from the beginning)
+    const checkpoint* checkpoint_before(uint64_t pos) const {
+        auto it = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), pos, [](uint64_t p, const checkpoint& cp) { return p < cp.out_pos; });
+        return it == checkpoints_.begin() ? nullptr : &*(it - 1);
+    }
+
+    void restart_from(const checkpoint* cp) {
+        int ret = inflateReset(stream_.get());
+        if (ret != Z_OK) {
+            throw zlib_exception("inflateReset failed", ret);
+        }
+        stream_->avail_in  = 0;
+        stream_->avail_out = 0;
+        total_in_   = cp ? cp->in_pos : 0;
+        total_out_  = cp ? cp->out_pos : 0;
+        buffer_pos_ = total_out_;
+        s_.seek(in_start_ + total_in_ - (cp && cp->bits ? 1 : 0), seekdir::beg);
+        if (!cp) {
+            return;
+        }
+        if (cp->bits) {
+            const auto byte = s_.get();
+            ret = inflatePrime(stream_.get(), cp->bits, byte >> (8 - cp->bits));
+            if (ret != Z_OK) {
+                throw zlib_exception("inflatePrime failed", ret);
+            }
+        }
+        if (!cp->window.empty()) {
+            ret = inflateSetDictionary(stream_.get(), cp->window.data(), static_cast<uInt>(cp->window.size()));
+            if (ret != Z_OK) {
+                throw zlib_exception("inflateSetDictionary failed", ret);
+            }
+        }
+    }
 };
-constexpr size_t in_deflate_stream::impl::buffer_size;
+constexpr size_t in_deflate_stream::impl::window_size;
+constexpr uint64_t in_deflate_stream::default_checkpoint_interval;
+constexpr size_t in_deflate_stream::default_buffer_size;
 
-in_deflate_stream::in_deflate_stream(in_stream& inner_stream, size_t compressed_size, size_t uncompressed_size) : impl_(new impl{inner_stream, compressed_size, uncompressed_size})
+in_deflate_stream::in_deflate_stream(in_stream& inner_stream, uint64_t compressed_size, uint64_t uncompressed_size, uint64_t checkpoint_interval, size_t buffer_size, bool compute_crc32) : impl_(new impl{inner_stream, compressed_size, uncompressed_size, checkpoint_interval, buffer_size, compute_crc32})
 {
     set_refill(&in_deflate_stream::refill_in_deflate_stream);
 }
@@ -115,24 +320,335 @@ array_view<uint8_t> in_deflate_stream::refill_in_deflate_stream()
 
 uint64_t in_deflate_stream::do_stream_size() const
 {
-    assert(false);
-    return invalid_stream_size;
+    return impl_->uncompressed_size();
 }
 
 void in_deflate_stream::do_seek(int64_t offset, seekdir way)
 {
-    if (way == seekdir::cur && offset >= 0 && static_cast<uint64_t>(offset) <= peek().size()) {
-        set_cursor(peek().begin() + offset);
-    } else {
+    uint64_t new_pos = 0;
+    switch (way) {
+    case seekdir::beg:
+        new_pos = offset;
+        break;
+    case seekdir::cur:
+        new_pos = tell() + offset;
+        break;
+    case seekdir::end:
+        new_pos = impl_->uncompressed_size() + offset;
+        break;
+    }
+
+    if (new_pos > impl_->uncompressed_size()) {
         assert(false);
         set_failed(std::make_error_code(std::errc::invalid_seek));
+        return;
+    }
+
+    const auto buffer_pos = impl_->buffer_pos();
+    if (new_pos < buffer_pos || new_pos > buffer_pos + buffer().size()) {
+        impl_->seek(new_pos);
+        set_buffer(impl_->buffer());
     }
+    set_cursor(buffer().begin() + (new_pos - impl_->buffer_pos()));
 }
 
 uint64_t in_deflate_stream::do_tell() const
 {
+    return impl_->buffer_pos() + (peek().begin() - buffer().begin());
+}
+
+namespace {
+
+int zlib_strategy(deflate_strategy strategy)
+{
+    switch (strategy) {
+    case deflate_strategy::default_strategy: return Z_DEFAULT_STRATEGY;
+    case deflate_strategy::filtered:         return Z_FILTERED;
+    case deflate_strategy::huffman_only:     return Z_HUFFMAN_ONLY;
+    case deflate_strategy::rle:              return Z_RLE;
+    case deflate_strategy::fixed:            return Z_FIXED;
+    }
     assert(false);
-    return invalid_stream_size;
+    return Z_DEFAULT_STRATEGY;
+}
+
+void init_deflate(z_stream& stream, int level, int strategy)
+{
+    stream = z_stream{};
+    int ret = deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, strategy); // Raw mode (no header)
+    if (ret != Z_OK) {
+        throw zlib_exception("deflateInit failed", ret);
+    }
+}
+
+// Runs deflate on all of the input passing the output to sink
+template<typename Sink>
+void deflate_all(z_stream& stream, const uint8_t* data, size_t size, int flush, Sink sink)
+{
+    uint8_t out_buffer[16384];
+    stream.next_in  = const_cast<uint8_t*>(data);
+    stream.avail_in = static_cast<uInt>(size);
+    do {
+        stream.next_out  = out_buffer;
+        stream.avail_out = sizeof(out_buffer);
+        int ret = deflate(&stream, flush);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            throw zlib_exception("zlib deflate failed: " + std::string(stream.msg ? stream.msg : "unknown error"), ret);
+        }
+        sink(out_buffer, sizeof(out_buffer) - stream.avail_out);
+    } while (stream.avail_out == 0);
+    assert(stream.avail_in == 0);
+}
+
+} // unnamed namespace
+
+class out_deflate_stream::impl {
+public:
+    using chunk_type = std::shared_ptr<std::vector<uint8_t>>;
+
+    // A chunk compressed (and checksummed) by a worker thread
+    struct compressed_chunk {
+        std::vector<uint8_t> data;
+        uint32_t             crc32;
+        size_t               uncompressed_size;
+    };
+
+    explicit impl(out_stream& inner, thread_pool* pool, int level, deflate_strategy strategy, size_t chunk_size)
+        : inner_(inner)
+        , pool_(pool)
+        , level_(level)
+        , strategy_(zlib_strategy(strategy))
+        , chunk_size_(chunk_size)
+        , chunk_(std::make_shared<std::vector<uint8_t>>(chunk_size))
+        , used_(0)
+        , crc32_(0)
+        , uncompressed_size_(0)
+        , compressed_size_(0)
+        , finished_(false)
+        , stream_() {
+        assert(chunk_size > 0);
+        if (!pool_) {
+            init_deflate(stream_, level_, strategy_);
+        }
+    }
+
+    ~impl() {
+        if (!pool_) {
+            deflateEnd(&stream_);
+        }
+    }
+
+    // Free part of the current chunk
+    uint8_t* free_space() {
+        return chunk_->data() + used_;
+    }
+
+    size_t free_space_size() const {
+        return finished_ ? 0 : chunk_->size() - used_;
+    }
+
+    bool finished() const {
+        return finished_;
+    }
+
+    // count bytes have been written to free_space()
+    std::error_code add(size_t count) {
+        assert(count <= free_space_size());
+        uncompressed_size_ += count;
+        used_ += count;
+        if (!pool_) {
+            crc32_ = util::crc32(crc32_, chunk_->data(), used_);
+            deflate_all(stream_, chunk_->data(), used_, Z_NO_FLUSH, [this](const uint8_t* data, size_t size) { output(data, size); });
+            used_ = 0;
+        } else if (used_ == chunk_->size()) {
+            submit_chunk(false);
+            // Don't let the queue grow without bounds
+            while (pending_.size() > 2 * pool_->thread_count()) {
+                write_oldest_pending();
+            }
+        }
+        return inner_.error();
+    }
+
+    std::error_code finish() {
+        assert(!finished_);
+        if (!pool_) {
+            deflate_all(stream_, chunk_->data(), used_, Z_FINISH, [this](const uint8_t* data, size_t size) { output(data, size); });
+        } else {
+            submit_chunk(true);
+            while (!pending_.empty()) {
+                write_oldest_pending();
+            }
+        }
+        used_     = 0;
+        finished_ = true;
+        return inner_.error();
+    }
+
+    uint32_t crc32() const {
+        return crc32_;
+    }
+
+    uint64_t uncompressed_size() const {
+        return uncompressed_size_;
+    }
+
+    uint64_t compressed_size() const {
+        return compressed_size_;
+    }
+
+private:
+    out_stream&                                    inner_;
+    thread_pool*                                   pool_;
+    int                                            level_;
+    int                                            strategy_;
+    const size_t                                   chunk_size_;
+    chunk_type                                     chunk_;
+    size_t                                         used_;
+    chunk_type                                     dictionary_;     // The input preceding the next chunk, at most 32K (parallel mode)
+    std::deque<std::future<compressed_chunk>>      pending_;        // Compressed chunks in order (parallel mode)
+    uint32_t                                       crc32_;
+    uint64_t                                       uncompressed_size_;
+    uint64_t                                       compressed_size_;
+    bool                                           finished_;
+    z_stream                                       stream_;         // Serial mode only
+
+    void output(const uint8_t* data, size_t size) {
+        inner_.write(data, size);
+        compressed_size_ += size;
+    }
+
+    void submit_chunk(bool last) {
+        chunk_->resize(used_);
+        const auto chunk = chunk_;
+        const auto dictionary = dictionary_;
+        const auto level = level_;
+        const auto strategy = strategy_;
+        pending_.push_back(pool_->submit([chunk, dictionary, level, strategy, last] {
+            return compress_chunk(*chunk, dictionary.get(), level, strategy, last);
+        }));
+        update_dictionary(chunk);
+        chunk_ = std::make_shared<std::vector<uint8_t>>(chunk_size_);
+        used_ = 0;
+    }
+
+    // Keeps the last 32K of the input as the dictionary, chunks smaller than that are combined with
+    // the end of the previous dictionary so small chunks don't make the compression worse
+    void update_dictionary(const chunk_type& chunk) {
+        constexpr size_t window = 1 << MAX_WBITS;
+        if (!dictionary_ || chunk->size() >= window) {
+            dictionary_ = chunk;
+            return;
+        }
+        const auto keep = std::min(dictionary_->size(), window - chunk->size());
+        auto dictionary = std::make_shared<std::vector<uint8_t>>();
+        dictionary->reserve(keep + chunk->size());
+        dictionary->insert(dictionary->end(), dictionary_->end() - keep, dictionary_->end());
+        dictionary->insert(dictionary->end(), chunk->begin(), chunk->end());
+        dictionary_ = std::move(dictionary);
+    }
+
+    void write_oldest_pending() {
+        auto f = std::move(pending_.front());
+        pending_.pop_front();
+        const auto compressed = f.get();
+        crc32_ = static_cast<uint32_t>(crc32_combine(crc32_, compressed.crc32, static_cast<z_off_t>(compressed.uncompressed_size)));
+        output(compressed.data.data(), compressed.data.size());
+    }
+
+    // Compresses one chunk into a piece of the deflate stream. All but the last chunk end with a sync
+    // flush, which leaves the output byte aligned without marking the last block, so the pieces can be joined.
+    static compressed_chunk compress_chunk(const std::vector<uint8_t>& chunk, const std::vector<uint8_t>* dictionary, int level, int strategy, bool last) {
+        z_stream stream;
+        init_deflate(stream, level, strategy);
+        compressed_chunk res;
+        res.crc32             = util::crc32(0, chunk.data(), chunk.size());
+        res.uncompressed_size = chunk.size();
+        try {
+            if (dictionary && !dictionary->empty()) {
+                const auto window = std::min(dictionary->size(), static_cast<size_t>(1 << MAX_WBITS));
+                int ret = deflateSetDictionary(&stream, dictionary->data() + dictionary->size() - window, static_cast<uInt>(window));
+                if (ret != Z_OK) {
+                    throw zlib_exception("deflateSetDictionary failed", ret);
+                }
+            }
+            res.data.reserve(deflateBound(&stream, static_cast<uLong>(chunk.size())) + 16);
+            deflate_all(stream, chunk.data(), chunk.size(), last ? Z_FINISH : Z_SYNC_FLUSH, [&res](const uint8_t* data, size_t size) { res.data.insert(res.data.end(), data, data + size); });
+        } catch (...) {
+            deflateEnd(&stream);
+            throw;
+        }
+        deflateEnd(&stream);
+        return res;
+    }
+};
+
+constexpr int out_deflate_stream::default_level;
+constexpr size_t out_deflate_stream::default_chunk_size;
+
+out_deflate_stream::out_deflate_stream(out_stream& inner_stream, int level, deflate_strategy strategy) : impl_(new impl{inner_stream, nullptr, level, strategy, 65536})
+{
+    set_buffer(impl_->free_space(), impl_->free_space_size());
+    set_flush(&out_deflate_stream::flush_out_deflate_stream);
+}
+
+out_deflate_stream::out_deflate_stream(out_stream& inner_stream, thread_pool& pool, int level, deflate_strategy strategy, size_t chunk_size) : impl_(new impl{inner_stream, &pool, level, strategy, chunk_size})
+{
+    set_buffer(impl_->free_space(), impl_->free_space_size());
+    set_flush(&out_deflate_stream::flush_out_deflate_stream);
+}
+
+// Without finish() the deflate stream is left unterminated (e.g. when destroyed during stack unwinding)
+out_deflate_stream::~out_deflate_stream() = default;
+
+void out_deflate_stream::finish()
+{
+    flush();
+    if (error()) {
+        return;
+    }
+    if (const auto ec = impl_->finish()) {
+        set_failed(ec);
+        return;
+    }
+    set_buffer(impl_->free_space(), impl_->free_space_size());
+}
+
+uint32_t out_deflate_stream::crc32() const
+{
+    return impl_->crc32();
+}
+
+uint64_t out_deflate_stream::uncompressed_size() const
+{
+    return impl_->uncompressed_size();
+}
+
+uint64_t out_deflate_stream::compressed_size() const
+{
+    return impl_->compressed_size();
+}
+
+void out_deflate_stream::flush_out_deflate_stream()
+{
+    const auto count = written().size();
+    if (impl_->finished()) {
+        if (count) {
+            assert(false);
+            set_failed(std::make_error_code(std::errc::broken_pipe));
+        }
+        return;
+    }
+    if (const auto ec = impl_->add(count)) {
+        set_failed(ec);
+        return;
+    }
+    set_buffer(impl_->free_space(), impl_->free_space_size());
+}
+
+uint64_t out_deflate_stream::do_tell() const
+{
+    return impl_->uncompressed_size() + written().size();
 }
 
 } } // namespace skirmish::util
@@ -5,11 +5,22 @@
 
 namespace skirmish { namespace util {
 
+class thread_pool;
+
+// Decompresses a raw deflate stream. Seeking is supported in both directions: while decompressing a checkpoint
+// is saved roughly every checkpoint_interval bytes of output and backward seeks restart from the closest one.
+// The inner stream must be positioned at the start of the compressed data and be seekable.
+// The output buffer comes from buffer_pool::shared() and the inflate state is recycled between streams.
 class in_deflate_stream : public in_stream {
 public:
-    explicit in_deflate_stream(in_stream& inner_stream, size_t compressed_size, size_t uncompressed_size);
+    static constexpr uint64_t default_checkpoint_interval = 256 * 1024;
+    static constexpr size_t   default_buffer_size         = 16384;
+
+    // If compute_crc32 is false crc32() can't be used (skips the cost of checksumming the output)
+    explicit in_deflate_stream(in_stream& inner_stream, uint64_t compressed_size, uint64_t uncompressed_size, uint64_t checkpoint_interval = default_checkpoint_interval, size_t buffer_size = default_buffer_size, bool compute_crc32 = true);
     ~in_deflate_stream();
 
+    // CRC32 of the uncompressed data, only valid once all of it has been decompressed
     uint32_t crc32() const;
 
 private:
@@ -23,6 +34,42 @@ private:
     virtual uint64_t do_tell() const override;
 };
 
+enum class deflate_strategy { default_strategy, filtered, huffman_only, rle, fixed };
+
+// Compresses everything written to it into a raw deflate stream written to the inner stream. finish() must be called
+// to terminate the deflate stream. Given a thread pool the input is split into chunks that are compressed in parallel
+// (each primed with the 32K of input preceding it) and joined using sync flushes into a single deflate stream.
+class out_deflate_stream : public out_stream {
+public:
+    static constexpr int    default_level      = -1; // zlib's default (6)
+    static constexpr size_t default_chunk_size = 128 * 1024;
+
+    explicit out_deflate_stream(out_stream& inner_stream, int level = default_level, deflate_strategy strategy = deflate_strategy::default_strategy);
+    explicit out_deflate_stream(out_stream& inner_stream, thread_pool& pool, int level = default_level, deflate_strategy strategy = deflate_strategy::default_strategy, size_t chunk_size = default_chunk_size);
+    ~out_deflate_stream();
+
+    // Compresses any remaining data and terminates the deflate stream, nothing can be written afterwards
+    void finish();
+
+    // CRC32 of the uncompressed data written so far. With a thread pool the chunks are checksummed by the
+    // workers, so it only covers the data already passed on to the inner stream until finish() is called.
+    uint32_t crc32() const;
+
+    // Uncompressed bytes written so far
+    uint64_t uncompressed_size() const;
+
+    // Compressed bytes passed on to the inner stream so far
+    uint64_t compressed_size() const;
+
+private:
+    class impl;
+    std::unique_ptr<impl> impl_;
+
+    void flush_out_deflate_stream();
+
+    virtual uint64_t do_tell() const override;
+};
+
 } } // namespace skirmish::util
 
 #endif
\ No newline at end of file
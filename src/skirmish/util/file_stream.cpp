@@ -1,7 +1,18 @@
 #include "file_stream.h"
+#include "buffer_pool.h"
 #include <fstream>
 #include <cassert>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace skirmish { namespace util {
 
 namespace {
@@ -20,10 +31,12 @@ auto path_to_string(const path& p) {
 class in_file_stream::impl
 {
 public:
-    explicit impl(const path& filename)
-        : file_pos_{0}
+    explicit impl(const path& filename, size_t buffer_size)
+        : buffer_{buffer_pool::shared().acquire(buffer_size)}
+        , file_pos_{0}
         , file_size_{invalid_stream_size}
         , in_{path_to_string(filename), std::fstream::binary} {
+        assert(buffer_size > 0);
         if (in_) {
             in_.seekg(0, std::ios_base::end);
             file_size_ = in_.tellg();
@@ -31,14 +44,15 @@ public:
         }
     }
 
-    static constexpr int buffer_size = 4096;
-    uint8_t       buffer_[buffer_size];
-    uint64_t      file_pos_;
-    uint64_t      file_size_;
-    std::ifstream in_;
+    buffer_pool::buffer buffer_;
+    uint64_t            file_pos_;
+    uint64_t            file_size_;
+    std::ifstream       in_;
 };
 
-in_file_stream::in_file_stream(const path& filename) : impl_(new impl(filename))
+constexpr size_t in_file_stream::default_buffer_size;
+
+in_file_stream::in_file_stream(const path& filename, size_t buffer_size) : impl_(new impl(filename, buffer_size))
 {
     if (impl_->in_) {
         set_refill(&in_file_stream::refill_in_file_stream);
@@ -96,12 +110,192 @@ array_view<uint8_t> in_file_stream::refill_in_file_stream()
 
     impl_->file_pos_ += buffer().size();
 
-    impl_->in_.read(reinterpret_cast<char*>(impl_->buffer_), std::min(file_remaining, static_cast<uint64_t>(impl_->buffer_size)));
+    impl_->in_.read(reinterpret_cast<char*>(impl_->buffer_.data()), std::min(file_remaining, static_cast<uint64_t>(impl_->buffer_.size())));
     const auto byte_count = impl_->in_.gcount();
     if (!byte_count) {
         return set_failed(std::make_error_code(std::errc::io_error));
     }
-    return make_array_view(impl_->buffer_, static_cast<size_t>(byte_count));
+    return make_array_view(impl_->buffer_.data(), static_cast<size_t>(byte_count));
+}
+
+class in_mmap_stream::impl
+{
+public:
+    explicit impl(const path& filename) {
+#ifdef _WIN32
+        file_ = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size)) {
+            return;
+        }
+        size_ = static_cast<uint64_t>(size.QuadPart);
+        if (size_) {
+            mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping_) {
+                return;
+            }
+            data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+            if (!data_) {
+                return;
+            }
+        }
+#else
+        const int fd = ::open(path_to_string(filename).c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            size_ = static_cast<uint64_t>(st.st_size);
+            if (size_ && size_ <= SIZE_MAX) {
+                void* p = ::mmap(nullptr, static_cast<size_t>(size_), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    data_ = static_cast<const uint8_t*>(p);
+                }
+            }
+        }
+        ::close(fd); // The mapping keeps its own reference to the file
+#endif
+        valid_ = data_ || size_ == 0;
+    }
+
+    ~impl() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+        if (data_) ::munmap(const_cast<uint8_t*>(data_), static_cast<size_t>(size_));
+#endif
+    }
+
+    bool                valid_ = false;
+    const uint8_t*      data_  = nullptr;
+    uint64_t            size_  = invalid_stream_size;
+#ifdef _WIN32
+    HANDLE              file_    = INVALID_HANDLE_VALUE;
+    HANDLE              mapping_ = nullptr;
+#endif
+};
+
+in_mmap_stream::in_mmap_stream(const path& filename) : impl_(new impl(filename))
+{
+    if (impl_->valid_) {
+        set_buffer(make_array_view(impl_->data_, static_cast<size_t>(impl_->size_)));
+        set_refill(&in_mmap_stream::refill_in_mmap_stream);
+    } else {
+        set_failed(std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+}
+
+in_mmap_stream::~in_mmap_stream() = default;
+
+array_view<uint8_t> in_mmap_stream::refill_in_mmap_stream()
+{
+    // The whole file is in the buffer, so running out of bytes means we're at EOF
+    return set_failed(std::make_error_code(std::errc::broken_pipe));
+}
+
+uint64_t in_mmap_stream::do_stream_size() const
+{
+    return impl_->size_;
+}
+
+void in_mmap_stream::do_seek(int64_t offset, seekdir way)
+{
+    assert(!error());
+    uint64_t new_pos = 0;
+    switch (way) {
+    case seekdir::beg:
+        new_pos = offset;
+        break;
+    case seekdir::cur:
+        new_pos = tell() + offset;
+        break;
+    case seekdir::end:
+        new_pos = impl_->size_ + offset;
+        break;
+    }
+    if (new_pos <= impl_->size_) {
+        set_cursor(buffer().begin() + new_pos);
+    } else {
+        set_failed(std::make_error_code(std::errc::invalid_seek));
+    }
+}
+
+uint64_t in_mmap_stream::do_tell() const
+{
+    assert(!error());
+    return peek().begin() - buffer().begin();
+}
+
+bool in_mmap_stream::do_try_map(array_view<uint8_t>& contents) const
+{
+    if (error()) {
+        return false;
+    }
+    contents = buffer();
+    return true;
+}
+
+class out_file_stream::impl
+{
+public:
+    explicit impl(const path& filename)
+        : file_pos_{0}
+        , out_{path_to_string(filename), std::fstream::binary | std::fstream::trunc} {
+    }
+
+    static constexpr int buffer_size = 65536;
+    uint8_t       buffer_[buffer_size];
+    uint64_t      file_pos_;
+    std::ofstream out_;
+};
+
+out_file_stream::out_file_stream(const path& filename) : impl_(new impl(filename))
+{
+    if (impl_->out_) {
+        set_buffer(impl_->buffer_, impl_->buffer_size);
+        set_flush(&out_file_stream::flush_out_file_stream);
+    } else {
+        set_failed(std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+}
+
+out_file_stream::~out_file_stream()
+{
+    flush();
+}
+
+void out_file_stream::flush_out_file_stream()
+{
+    const auto data = written();
+    impl_->out_.write(reinterpret_cast<const char*>(data.begin()), data.size());
+    if (!impl_->out_) {
+        set_failed(std::make_error_code(std::errc::io_error));
+        return;
+    }
+    impl_->file_pos_ += data.size();
+    set_buffer(impl_->buffer_, impl_->buffer_size);
+}
+
+void out_file_stream::do_flush_destination()
+{
+    if (error()) {
+        return;
+    }
+    impl_->out_.flush();
+    if (!impl_->out_) {
+        set_failed(std::make_error_code(std::errc::io_error));
+    }
+}
+
+uint64_t out_file_stream::do_tell() const
+{
+    return impl_->file_pos_ + written().size();
 }
 
 } } // namespace skirmish::util
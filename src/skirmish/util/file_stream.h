@@ -8,7 +8,10 @@ namespace skirmish { namespace util {
 
 class in_file_stream : public in_stream {
 public:
-    explicit in_file_stream(const path& filename);
+    static constexpr size_t default_buffer_size = 4096;
+
+    // The buffer is taken from buffer_pool::shared()
+    explicit in_file_stream(const path& filename, size_t buffer_size = default_buffer_size);
     ~in_file_stream();
 
 private:
@@ -22,6 +25,41 @@ private:
     virtual uint64_t do_tell() const override;
 };
 
+// Maps the whole file into memory, peek() covers the entire file and seeking just moves the cursor
+class in_mmap_stream : public in_stream {
+public:
+    explicit in_mmap_stream(const path& filename);
+    ~in_mmap_stream();
+
+private:
+    class impl;
+    std::unique_ptr<impl> impl_;
+
+    array_view<uint8_t> refill_in_mmap_stream();
+
+    virtual uint64_t do_stream_size() const override;
+    virtual void do_seek(int64_t offset, seekdir way) override;
+    virtual uint64_t do_tell() const override;
+    virtual bool do_try_map(array_view<uint8_t>& contents) const override;
+};
+
+// Creates (or truncates) the file
+class out_file_stream : public out_stream {
+public:
+    explicit out_file_stream(const path& filename);
+    // Flushes any remaining data
+    ~out_file_stream();
+
+private:
+    class impl;
+    std::unique_ptr<impl> impl_;
+
+    void flush_out_file_stream();
+
+    virtual void do_flush_destination() override;
+    virtual uint64_t do_tell() const override;
+};
+
 } } // namespace skirmish::util
 
 #endif
\ No newline at end of file
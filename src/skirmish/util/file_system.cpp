@@ -1,5 +1,6 @@
 #include "file_system.h"
 #include "file_stream.h"
+#include <mutex>
 
 namespace skirmish { namespace util {
 
@@ -56,10 +57,26 @@ public:
     std::unique_ptr<in_stream> open(const path& filename) {
         const auto real_path = root_ / filename;
         assert(exists(real_path) && is_regular_file(real_path));
+        // Prefer mapping the file, but fall back to buffered reads if that isn't possible
+        std::unique_ptr<in_stream> mapped = std::make_unique<in_mmap_stream>(real_path);
+        if (!mapped->error()) {
+            return mapped;
+        }
         return std::make_unique<in_file_stream>(real_path);
     }
+
+    void read_batch(std::vector<read_request> requests, const io_service::completion_handler& handler) {
+        for (auto& r : requests) {
+            r.filename = root_ / r.filename;
+        }
+        // Only start the I/O service the first time it's needed
+        std::call_once(io_once_, [this] { io_ = std::make_unique<io_service>(); });
+        io_->read(requests, handler);
+    }
 private:
-    path root_;
+    path                        root_;
+    std::once_flag              io_once_;
+    std::unique_ptr<io_service> io_;
 };
 
 native_file_system::native_file_system(const path & root) : impl_(new impl{root})
@@ -68,6 +85,11 @@ native_file_system::native_file_system(const path & root) : impl_(new impl{root}
 
 native_file_system::~native_file_system() = default;
 
+void native_file_system::read_batch(const std::vector<read_request>& requests, const io_service::completion_handler& handler)
+{
+    impl_->read_batch(requests, handler);
+}
+
 std::vector<path> native_file_system::do_file_list() const
 {
     return impl_->file_list();
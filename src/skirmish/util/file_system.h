@@ -4,6 +4,7 @@
 #include <vector>
 #include "path.h"
 #include "stream.h"
+#include "io_service.h"
 
 namespace skirmish { namespace util {
 
@@ -29,6 +30,9 @@ public:
     explicit native_file_system(const path& root);
     ~native_file_system();
 
+    // Reads a batch of file ranges (filenames relative to root) concurrently, see io_service::read
+    void read_batch(const std::vector<read_request>& requests, const io_service::completion_handler& handler);
+
 private:
     class impl;
     std::unique_ptr<impl> impl_;
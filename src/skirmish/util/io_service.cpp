@@ -0,0 +1,720 @@
+#include "io_service.h"
+#include "thread_pool.h"
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <future>
+#include <algorithm>
+#include <limits>
+#include <cassert>
+#include <cerrno>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SKIRMISH_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace skirmish { namespace util {
+
+namespace {
+
+// Largest single read (keeps the byte counts within what every API accepts)
+constexpr size_t max_read_size = 1 << 30;
+
+// File opened for positional reads, which may be done from several threads at once
+class native_file {
+public:
+#ifdef _WIN32
+    explicit native_file(const path& filename) {
+        file_ = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (file_ != INVALID_HANDLE_VALUE && GetFileSizeEx(file_, &size)) {
+            size_ = static_cast<uint64_t>(size.QuadPart);
+        }
+    }
+#else
+    explicit native_file(const path& filename) : native_file(::open(filename.c_str(), O_RDONLY | O_CLOEXEC)) {
+    }
+
+    // Takes ownership of fd (-1 if opening the file failed)
+    explicit native_file(int fd) : fd_(fd) {
+        struct stat st;
+        if (fd_ >= 0 && ::fstat(fd_, &st) == 0 && S_ISREG(st.st_mode)) {
+            size_ = static_cast<uint64_t>(st.st_size);
+        }
+    }
+
+    // Takes ownership of fd whose size is already known
+    native_file(int fd, uint64_t size) : fd_(fd), size_(size) {
+    }
+#endif
+
+    native_file(const native_file&) = delete;
+    native_file& operator=(const native_file&) = delete;
+
+    ~native_file() {
+#ifdef _WIN32
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+        if (fd_ >= 0) ::close(fd_);
+#endif
+    }
+
+    // invalid_stream_size if the file couldn't be opened
+    uint64_t size() const {
+        return size_;
+    }
+
+#ifndef _WIN32
+    int fd() const {
+        return fd_;
+    }
+#endif
+
+    std::error_code read(uint8_t* dest, size_t count, uint64_t offset) const {
+        while (count) {
+            const auto now = std::min(count, max_read_size);
+#ifdef _WIN32
+            OVERLAPPED overlapped{};
+            overlapped.Offset     = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD res = 0;
+            if (!ReadFile(file_, dest, static_cast<DWORD>(now), &res, &overlapped)) {
+                return std::error_code(static_cast<int>(GetLastError()), std::system_category());
+            }
+#else
+            const auto res = ::pread(fd_, dest, now, static_cast<off_t>(offset));
+            if (res < 0) {
+                if (errno == EINTR) continue;
+                return std::error_code(errno, std::system_category());
+            }
+#endif
+            if (res == 0) {
+                // The file shrank
+                return std::make_error_code(std::errc::broken_pipe);
+            }
+            dest   += res;
+            count  -= res;
+            offset += res;
+        }
+        return std::error_code{};
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE   file_ = INVALID_HANDLE_VALUE;
+#else
+    int      fd_   = -1;
+#endif
+    uint64_t size_ = invalid_stream_size;
+};
+
+// The requests of a batch with their files opened (once per file) and ranges validated
+class prepared_batch {
+public:
+    struct request {
+        const native_file* file;
+        uint64_t           offset;
+        size_t             size;
+        std::error_code    error; // Set if the request can't be started
+    };
+
+    // open_files(filenames) opens every distinct file of the batch at once, returning them in the same order
+    template<typename OpenFiles>
+    explicit prepared_batch(const std::vector<read_request>& requests, OpenFiles open_files) {
+        std::unordered_map<path::string_type, size_t> file_indices;
+        std::vector<const path*>                      filenames;
+        std::vector<size_t>                           request_files;
+        request_files.reserve(requests.size());
+        for (const auto& r : requests) {
+            const auto it = file_indices.emplace(r.filename.native(), filenames.size());
+            if (it.second) {
+                filenames.push_back(&r.filename);
+            }
+            request_files.push_back(it.first->second);
+        }
+        files_ = open_files(filenames);
+        assert(files_.size() == filenames.size());
+
+        requests_.reserve(requests.size());
+        for (size_t i = 0; i < requests.size(); ++i) {
+            const auto& r    = requests[i];
+            const auto& file = files_[request_files[i]];
+            request pr{file.get(), r.offset, 0, std::error_code{}};
+            const auto file_size = file->size();
+            if (file_size == invalid_stream_size) {
+                pr.error = std::make_error_code(std::errc::no_such_file_or_directory);
+            } else if (r.offset > file_size || (r.size != invalid_stream_size && r.size > file_size - r.offset)) {
+                pr.error = std::make_error_code(std::errc::broken_pipe);
+            } else {
+                const auto size = r.size == invalid_stream_size ? file_size - r.offset : r.size;
+                if (size > SIZE_MAX) {
+                    pr.error = std::make_error_code(std::errc::not_enough_memory);
+                } else {
+                    pr.size = static_cast<size_t>(size);
+                }
+            }
+            requests_.push_back(pr);
+        }
+    }
+
+    size_t size() const {
+        return requests_.size();
+    }
+
+    const request& operator[](size_t index) const {
+        return requests_[index];
+    }
+
+private:
+    std::vector<std::unique_ptr<native_file>> files_;
+    std::vector<request>                      requests_;
+};
+
+// Calls the completion handler, holding on to the first exception so the remaining requests still
+// get their call and the reads can be drained first
+class completion_dispatcher {
+public:
+    explicit completion_dispatcher(const io_service::completion_handler& handler) : handler_(handler) {
+    }
+
+    void operator()(size_t index, const std::error_code& error, array_view<uint8_t> data) {
+        try {
+            handler_(index, error, data);
+        } catch (...) {
+            if (!first_error_) {
+                first_error_ = std::current_exception();
+            }
+        }
+    }
+
+    void finish() {
+        if (first_error_) {
+            std::rethrow_exception(first_error_);
+        }
+    }
+
+private:
+    const io_service::completion_handler& handler_;
+    std::exception_ptr                    first_error_;
+};
+
+#ifdef SKIRMISH_HAVE_IO_URING
+
+// Minimal io_uring wrapper using the raw system calls
+class uring {
+public:
+    explicit uring(unsigned entries) {
+        io_uring_params p{};
+        fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+        if (fd_ < 0) {
+            return;
+        }
+        sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        single_mmap_  = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap_) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        cq_ring_ = single_mmap_ ? sq_ring_ : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes == MAP_FAILED) {
+            if (sqes != MAP_FAILED) ::munmap(sqes, sqes_size_);
+            unmap_rings();
+            ::close(fd_);
+            fd_ = -1;
+            return;
+        }
+
+        auto sq = static_cast<uint8_t*>(sq_ring_);
+        sq_head_  = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail_  = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask_  = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        sqes_     = static_cast<io_uring_sqe*>(sqes);
+        auto cq = static_cast<uint8_t*>(cq_ring_);
+        cq_head_  = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail_  = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask_  = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes_     = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        entries_  = p.sq_entries;
+    }
+
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+
+    ~uring() {
+        if (fd_ >= 0) {
+            ::munmap(sqes_, sqes_size_);
+            unmap_rings();
+            ::close(fd_);
+        }
+    }
+
+    bool valid() const {
+        return fd_ >= 0;
+    }
+
+    // Number of submission queue entries, never keep more requests than this in flight
+    // so the completion queue can't overflow
+    unsigned entries() const {
+        return entries_;
+    }
+
+    void push_readv(int fd, const iovec* iov, uint64_t offset, uint64_t user_data) {
+        io_uring_sqe& sqe = prepare(IORING_OP_READV, fd, user_data);
+        sqe.off  = offset;
+        sqe.addr = reinterpret_cast<uint64_t>(iov);
+        sqe.len  = 1;
+        commit();
+    }
+
+    // Opens filename (relative to the current directory), the completion result is the descriptor
+    void push_openat(const char* filename, int flags, uint64_t user_data) {
+        io_uring_sqe& sqe = prepare(IORING_OP_OPENAT, AT_FDCWD, user_data);
+        sqe.addr       = reinterpret_cast<uint64_t>(filename);
+        sqe.open_flags = static_cast<uint32_t>(flags);
+        commit();
+    }
+
+    // Gets the attributes in mask of the open file fd
+    void push_fstatx(int fd, unsigned mask, struct statx* out, uint64_t user_data) {
+        io_uring_sqe& sqe = prepare(IORING_OP_STATX, fd, user_data);
+        sqe.addr        = reinterpret_cast<uint64_t>("");
+        sqe.len         = mask;
+        sqe.off         = reinterpret_cast<uint64_t>(out);
+        sqe.statx_flags = AT_EMPTY_PATH;
+        commit();
+    }
+
+    // Submits the queued reads and waits for at least one completion
+    std::error_code submit_and_wait() {
+        for (;;) {
+            const int res = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, to_submit_, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (res >= 0) {
+                to_submit_ -= std::min(to_submit_, static_cast<unsigned>(res));
+                return std::error_code{};
+            }
+            if (errno != EINTR && errno != EAGAIN) {
+                return std::error_code(errno, std::system_category());
+            }
+        }
+    }
+
+    // Waits for at least one completion without submitting anything
+    std::error_code wait() {
+        for (;;) {
+            const int res = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (res >= 0) {
+                return std::error_code{};
+            }
+            if (errno != EINTR && errno != EAGAIN) {
+                return std::error_code(errno, std::system_category());
+            }
+        }
+    }
+
+    // Number of queued reads the kernel hasn't accepted yet (they're never started if the ring is destroyed)
+    unsigned pending_submissions() const {
+        return to_submit_;
+    }
+
+    // Calls f(user_data, result) for every available completion
+    template<typename F>
+    void reap(F f) {
+        unsigned head = *cq_head_;
+        const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const auto& cqe = cqes_[head & cq_mask_];
+            f(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    int           fd_           = -1;
+    unsigned      entries_      = 0;
+    unsigned      to_submit_    = 0;
+    bool          single_mmap_  = false;
+    void*         sq_ring_      = MAP_FAILED;
+    void*         cq_ring_      = MAP_FAILED;
+    size_t        sq_ring_size_ = 0;
+    size_t        cq_ring_size_ = 0;
+    size_t        sqes_size_    = 0;
+    unsigned*     sq_head_      = nullptr;
+    unsigned*     sq_tail_      = nullptr;
+    unsigned      sq_mask_      = 0;
+    unsigned*     sq_array_     = nullptr;
+    io_uring_sqe* sqes_         = nullptr;
+    unsigned*     cq_head_      = nullptr;
+    unsigned*     cq_tail_      = nullptr;
+    unsigned      cq_mask_      = 0;
+    io_uring_cqe* cqes_         = nullptr;
+
+    // Returns the cleared entry for the next submission, it's queued by commit()
+    io_uring_sqe& prepare(uint8_t opcode, int fd, uint64_t user_data) {
+        const unsigned tail = *sq_tail_;
+        assert(tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) < entries_);
+        const unsigned index = tail & sq_mask_;
+        io_uring_sqe& sqe = sqes_[index];
+        sqe = io_uring_sqe{};
+        sqe.opcode    = opcode;
+        sqe.fd        = fd;
+        sqe.user_data = user_data;
+        sq_array_[index] = index;
+        return sqe;
+    }
+
+    void commit() {
+        __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+        ++to_submit_;
+    }
+
+    void unmap_rings() {
+        if (sq_ring_ != MAP_FAILED) ::munmap(sq_ring_, sq_ring_size_);
+        if (cq_ring_ != MAP_FAILED && !single_mmap_) ::munmap(cq_ring_, cq_ring_size_);
+    }
+};
+
+#endif
+
+} // unnamed namespace
+
+class io_service::impl {
+public:
+    explicit impl(io_backend backend, unsigned thread_count) : thread_count_(thread_count) {
+#ifdef SKIRMISH_HAVE_IO_URING
+        if (backend != io_backend::thread_pool) {
+            ring_ = std::make_unique<uring>(ring_entries);
+            if (!ring_->valid()) {
+                // Not supported by the kernel or blocked (e.g. by a seccomp filter)
+                ring_.reset();
+            }
+        }
+#endif
+        if (backend == io_backend::io_uring && !uses_ring()) {
+            throw std::runtime_error("io_uring is not available");
+        }
+        if (!uses_ring()) {
+            pool_ = std::make_unique<thread_pool>(thread_count_);
+        }
+    }
+
+    io_backend backend() const {
+#ifdef SKIRMISH_HAVE_IO_URING
+        std::lock_guard<std::mutex> lock{ring_mutex_}; // read_ring may give up the ring on another thread
+#endif
+        return uses_ring() ? io_backend::io_uring : io_backend::thread_pool;
+    }
+
+    void read(const std::vector<read_request>& requests, const completion_handler& handler) {
+        completion_dispatcher dispatch{handler};
+#ifdef SKIRMISH_HAVE_IO_URING
+        {
+            std::lock_guard<std::mutex> lock{ring_mutex_};
+            if (uses_ring()) {
+                const prepared_batch batch{requests, [this](const std::vector<const path*>& filenames) { return open_ring(filenames); }};
+                if (uses_ring()) {
+                    read_ring(batch, dispatch);
+                } else {
+                    // The ring failed while opening the files
+                    read_pool(batch, dispatch);
+                }
+                dispatch.finish();
+                return;
+            }
+        }
+#endif
+        const prepared_batch batch{requests, [this](const std::vector<const path*>& filenames) { return open_pool(filenames); }};
+        read_pool(batch, dispatch);
+        dispatch.finish();
+    }
+
+private:
+#ifdef SKIRMISH_HAVE_IO_URING
+    static constexpr unsigned ring_entries = 64;
+    mutable std::mutex                ring_mutex_; // The ring is used by one batch at a time
+    std::unique_ptr<uring>            ring_;
+    // When the ring fails with reads the kernel may still be writing into, their buffers are kept here
+    // along with the ring, so they outlive it (members are destroyed in reverse order)
+    std::vector<std::vector<uint8_t>> abandoned_buffers_;
+    std::unique_ptr<uring>            broken_ring_;
+#endif
+    const unsigned                    thread_count_;
+    std::unique_ptr<thread_pool>      pool_;
+
+    bool uses_ring() const {
+#ifdef SKIRMISH_HAVE_IO_URING
+        return ring_ != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    // Each open is a blocking system call (or several), so they're spread over the pool like the reads
+    std::vector<std::unique_ptr<native_file>> open_pool(const std::vector<const path*>& filenames) {
+        std::vector<std::future<std::unique_ptr<native_file>>> opened;
+        opened.reserve(filenames.size());
+        for (const auto filename : filenames) {
+            opened.push_back(pool_->submit([filename] { return std::make_unique<native_file>(*filename); }));
+        }
+        for (const auto& f : opened) {
+            f.wait();
+        }
+        std::vector<std::unique_ptr<native_file>> files;
+        files.reserve(opened.size());
+        for (auto& f : opened) {
+            files.push_back(f.get());
+        }
+        return files;
+    }
+
+    void read_pool(const prepared_batch& batch, completion_dispatcher& dispatch) {
+        std::vector<std::future<std::vector<uint8_t>>> results(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const auto& r = batch[i];
+            if (!r.error && r.size) {
+                results[i] = pool_->submit([&r] {
+                    std::vector<uint8_t> data(r.size);
+                    const auto error = r.file->read(data.data(), data.size(), r.offset);
+                    if (error) {
+                        throw std::system_error(error);
+                    }
+                    return data;
+                });
+            }
+        }
+        // Wait for everything even if the handler throws, the files must stay open until all reads are done
+        for (size_t i = 0; i < batch.size(); ++i) {
+            std::error_code error = batch[i].error;
+            std::vector<uint8_t> data;
+            if (results[i].valid()) {
+                try {
+                    data = results[i].get();
+                } catch (const std::system_error& e) {
+                    error = e.code();
+                }
+            }
+            dispatch(i, error, make_array_view(data));
+        }
+    }
+
+#ifdef SKIRMISH_HAVE_IO_URING
+    // Opens the files through the ring, queuing a statx for each as soon as its open completes. Files the
+    // ring didn't open (kernels before 5.6 reject the opcodes with EINVAL) are opened directly.
+    std::vector<std::unique_ptr<native_file>> open_ring(const std::vector<const path*>& filenames) {
+        const int not_completed = std::numeric_limits<int>::min();
+        std::vector<int> open_results(filenames.size(), not_completed);
+        std::vector<int> statx_results(filenames.size(), not_completed);
+        // Kept as raw bytes so it can be abandoned like a read buffer
+        std::vector<uint8_t> statx_data(filenames.size() * sizeof(struct statx));
+        auto statx_buffer = [&statx_data](size_t i) { return reinterpret_cast<struct statx*>(statx_data.data() + i * sizeof(struct statx)); };
+
+        // The user data is the file index times two, plus one for the statx
+        unsigned in_flight = 0;
+        auto complete = [&](uint64_t user_data, int res) {
+            --in_flight;
+            const auto i = static_cast<size_t>(user_data >> 1);
+            if (user_data & 1) {
+                statx_results[i] = res;
+            } else if ((open_results[i] = res) >= 0) {
+                ring_->push_fstatx(res, STATX_TYPE | STATX_SIZE, statx_buffer(i), user_data | 1);
+                ++in_flight;
+            }
+        };
+
+        std::error_code ring_error;
+        size_t next = 0;
+        while (in_flight || next < filenames.size()) {
+            for (; next < filenames.size() && in_flight < ring_->entries(); ++next, ++in_flight) {
+                ring_->push_openat(filenames[next]->c_str(), O_RDONLY | O_CLOEXEC, next << 1);
+            }
+            ring_error = ring_->submit_and_wait();
+            if (ring_error) {
+                break;
+            }
+            ring_->reap(complete);
+        }
+        const bool drained = !ring_error || drain(in_flight, complete);
+
+        std::vector<std::unique_ptr<native_file>> files;
+        files.reserve(filenames.size());
+        for (size_t i = 0; i < filenames.size(); ++i) {
+            const int fd = open_results[i];
+            if (fd >= 0 && statx_results[i] == 0) {
+                const auto& st = *statx_buffer(i);
+                files.push_back(std::make_unique<native_file>(fd, S_ISREG(st.stx_mode) ? static_cast<uint64_t>(st.stx_size) : invalid_stream_size));
+            } else if (fd >= 0) {
+                files.push_back(std::make_unique<native_file>(fd));
+            } else if (fd == not_completed || fd == -EINVAL || fd == -EAGAIN || fd == -EINTR) {
+                // If the ring failed with the open still in flight, the descriptor it may yet return is lost
+                files.push_back(std::make_unique<native_file>(*filenames[i]));
+            } else {
+                files.push_back(std::make_unique<native_file>(-1));
+            }
+        }
+        if (ring_error) {
+            if (!drained) {
+                abandoned_buffers_.push_back(std::move(statx_data));
+            }
+            give_up_ring(drained);
+        }
+        return files;
+    }
+
+    // Waits for the requests the kernel accepted before a submission failed, complete is called for each and
+    // has to decrement in_flight. Returns false if some may still be running.
+    template<typename F>
+    bool drain(unsigned& in_flight, F& complete) {
+        while (in_flight > ring_->pending_submissions() && !ring_->wait()) {
+            ring_->reap(complete);
+        }
+        return in_flight == ring_->pending_submissions();
+    }
+
+    // Switches to the thread pool after the ring failed. Unless it was drained the ring is kept alive (see
+    // abandoned_buffers_), closing it doesn't stop requests the kernel is already working on.
+    void give_up_ring(bool drained) {
+        if (!drained) {
+            broken_ring_ = std::move(ring_);
+        }
+        ring_.reset();
+        pool_ = std::make_unique<thread_pool>(thread_count_);
+    }
+
+    void read_ring(const prepared_batch& batch, completion_dispatcher& dispatch) {
+        struct state {
+            std::vector<uint8_t> data;
+            size_t               done;
+            iovec                iov;
+            bool                 in_ring; // Queued to the ring and not completed yet
+        };
+        std::vector<state> states(batch.size());
+        std::deque<size_t> queue;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const auto& r = batch[i];
+            if (r.error || !r.size) {
+                dispatch(i, r.error, array_view<uint8_t>{});
+            } else {
+                states[i].data.resize(r.size);
+                states[i].done    = 0;
+                states[i].in_ring = false;
+                queue.push_back(i);
+            }
+        }
+
+        unsigned in_flight = 0;
+        auto complete = [&](uint64_t user_data, int res) {
+            --in_flight;
+            const auto i = static_cast<size_t>(user_data);
+            auto& s = states[i];
+            s.in_ring = false;
+            if (res == -EINTR || res == -EAGAIN) {
+                queue.push_front(i);
+            } else if (res < 0) {
+                dispatch(i, std::error_code(-res, std::system_category()), array_view<uint8_t>{});
+                s.data = std::vector<uint8_t>{};
+            } else if (res == 0) {
+                dispatch(i, std::make_error_code(std::errc::broken_pipe), array_view<uint8_t>{});
+                s.data = std::vector<uint8_t>{};
+            } else if ((s.done += res) < s.data.size()) {
+                queue.push_front(i); // Short read, continue where it stopped
+            } else {
+                dispatch(i, std::error_code{}, make_array_view(s.data));
+                s.data = std::vector<uint8_t>{};
+            }
+        };
+
+        std::error_code ring_error;
+        while (in_flight || !queue.empty()) {
+            while (!queue.empty() && in_flight < ring_->entries()) {
+                const auto i = queue.front();
+                queue.pop_front();
+                auto& s = states[i];
+                s.iov.iov_base = s.data.data() + s.done;
+                s.iov.iov_len  = std::min(s.data.size() - s.done, max_read_size);
+                s.in_ring      = true;
+                ring_->push_readv(batch[i].file->fd(), &s.iov, batch[i].offset + s.done, i);
+                ++in_flight;
+            }
+            ring_error = ring_->submit_and_wait();
+            if (ring_error) {
+                break;
+            }
+            ring_->reap(complete);
+        }
+        if (!ring_error) {
+            return;
+        }
+
+        // The ring is broken. Before giving it up wait for the reads the kernel has accepted, as they
+        // write into states, then finish everything else with positional reads on the thread pool.
+        const bool drained = drain(in_flight, complete);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            auto& s = states[i];
+            if (!s.in_ring) {
+                continue;
+            }
+            if (drained) {
+                // Never submitted
+                queue.push_back(i);
+            } else {
+                // Can't tell whether the kernel is still writing into the buffer, so it's kept until the ring is gone
+                dispatch(i, ring_error, array_view<uint8_t>{});
+                abandoned_buffers_.push_back(std::move(s.data));
+            }
+        }
+        give_up_ring(drained);
+
+        std::vector<std::pair<size_t, std::future<std::error_code>>> rest;
+        for (const auto i : queue) {
+            auto& s = states[i];
+            rest.emplace_back(i, pool_->submit([&batch, &s, i] {
+                return batch[i].file->read(s.data.data() + s.done, s.data.size() - s.done, batch[i].offset + s.done);
+            }));
+        }
+        for (auto& r : rest) {
+            const auto error = r.second.get();
+            dispatch(r.first, error, error ? array_view<uint8_t>{} : make_array_view(states[r.first].data));
+        }
+    }
+#endif
+};
+
+#ifdef SKIRMISH_HAVE_IO_URING
+constexpr unsigned io_service::impl::ring_entries;
+#endif
+
+io_service::io_service(io_backend backend, unsigned thread_count) : impl_(new impl{backend, thread_count})
+{
+}
+
+io_service::~io_service() = default;
+
+io_backend io_service::backend() const
+{
+    return impl_->backend();
+}
+
+void io_service::read(const std::vector<read_request>& requests, const completion_handler& handler)
+{
+    impl_->read(requests, handler);
+}
+
+} } // namespace skirmish::util
@@ -0,0 +1,53 @@
+#ifndef SKIRMISH_UTIL_IO_SERVICE_H
+#define SKIRMISH_UTIL_IO_SERVICE_H
+
+#include "stream.h"
+#include "path.h"
+#include <vector>
+#include <functional>
+
+namespace skirmish { namespace util {
+
+// Reads size bytes starting at offset of filename. A size of invalid_stream_size reads the rest of the file.
+struct read_request {
+    path     filename;
+    uint64_t offset;
+    uint64_t size;
+};
+
+enum class io_backend {
+    automatic,   // io_uring if the kernel allows it, otherwise thread_pool
+    io_uring,    // Linux only, construction fails with std::runtime_error if it isn't available
+    thread_pool, // Positional reads spread over a pool of threads
+};
+
+// Reads batches of file ranges concurrently. On Linux all opens and reads of a batch are queued to the kernel
+// at once through io_uring, elsewhere (or when io_uring isn't available) they're done by a pool of threads.
+// If io_uring fails in the middle of a batch, the rest of it and all later batches use the thread pool.
+class io_service {
+public:
+    // Called once per request (from the thread calling read()) as soon as it has completed. Reads
+    // extending past the end of the file fail with broken_pipe. data is only valid during the call.
+    using completion_handler = std::function<void (size_t index, const std::error_code& error, array_view<uint8_t> data)>;
+
+    // A thread_count of 0 means one thread per hardware thread (only used by the thread_pool backend)
+    explicit io_service(io_backend backend = io_backend::automatic, unsigned thread_count = 0);
+    ~io_service();
+
+    // Returns the backend actually in use (never automatic)
+    io_backend backend() const;
+
+    // Reads all requests returning once every completion handler has been called. Calls for different
+    // requests can come in any order. If the handler throws the remaining requests still get their call,
+    // and the first exception is passed on once all reads are done.
+    // Batches read from several threads at once are handled one at a time by the io_uring backend.
+    void read(const std::vector<read_request>& requests, const completion_handler& handler);
+
+private:
+    class impl;
+    std::unique_ptr<impl> impl_;
+};
+
+} } // namespace skirmish::util
+
+#endif
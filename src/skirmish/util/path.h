@@ -12,10 +12,12 @@ namespace skirmish { namespace util {
 #ifdef _MSC_VER
 using path = std::experimental::filesystem::path;
 using recursive_directory_iterator = std::experimental::filesystem::recursive_directory_iterator;
+using std::experimental::filesystem::temp_directory_path;
 inline std::string path_to_u8string(const path& p) { return p.generic_u8string(); }
 #else
 using path = boost::filesystem::path;
 using recursive_directory_iterator = boost::filesystem::recursive_directory_iterator;
+using boost::filesystem::temp_directory_path;
 inline std::string path_to_u8string(const path& p) { return p.generic_string(); } // XXX: FIXME
 #endif
 
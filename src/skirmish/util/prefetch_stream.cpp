@@ -0,0 +1,260 @@
+#include "prefetch_stream.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+namespace skirmish { namespace util {
+
+class in_prefetch_stream::impl {
+public:
+    explicit impl(in_stream& inner, std::unique_ptr<in_stream> owned_inner, size_t buffer_size, size_t buffer_count)
+        : owned_inner_(std::move(owned_inner))
+        , inner_(inner)
+        , size_(inner.stream_size())
+        , buffers_(buffer_count)
+        , current_(nullptr)
+        , pos_(inner.tell())
+        , generation_(0)
+        , seek_pos_(pos_)
+        , stopping_(false) {
+        assert(buffer_size > 0 && buffer_count > 0);
+        for (auto& b : buffers_) {
+            b.data.resize(buffer_size);
+            free_.push_back(&b);
+        }
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~impl() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stopping_ = true;
+        }
+        producer_cv_.notify_one();
+        thread_.join();
+    }
+
+    uint64_t size() const {
+        return size_;
+    }
+
+    // Position of the start of the buffer currently being consumed
+    uint64_t pos() const {
+        return current_ ? current_->pos : pos_;
+    }
+
+    // Returns the next buffer of data (waiting for it if necessary) or sets error
+    array_view<uint8_t> next(std::error_code& error) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        release_current();
+        consumer_cv_.wait(lock, [this] { return !filled_.empty(); });
+        current_ = filled_.front();
+        filled_.pop_front();
+        if (!current_->size) {
+            error = current_->error;
+            release_current();
+            return array_view<uint8_t>{};
+        }
+        return make_array_view(current_->data.data(), current_->size);
+    }
+
+    // Returns the buffer containing pos if it's in the current or already read ahead buffers (setting offset
+    // to the position of pos in it), otherwise an empty buffer is returned and reading restarts at pos
+    array_view<uint8_t> seek(uint64_t pos, size_t& offset) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (current_ && pos >= current_->pos && pos - current_->pos < current_->size) {
+            offset = static_cast<size_t>(pos - current_->pos);
+            return make_array_view(current_->data.data(), current_->size);
+        }
+        release_current();
+        while (!filled_.empty() && filled_.front()->size && pos >= filled_.front()->pos) {
+            auto b = filled_.front();
+            filled_.pop_front();
+            if (pos - b->pos < b->size) {
+                current_ = b;
+                producer_cv_.notify_one();
+                offset = static_cast<size_t>(pos - b->pos);
+                return make_array_view(b->data.data(), b->size);
+            }
+            free_.push_back(b);
+        }
+        // Discard what has been read ahead and restart
+        free_.insert(free_.end(), filled_.begin(), filled_.end());
+        filled_.clear();
+        ++generation_;
+        seek_pos_ = pos;
+        pos_      = pos;
+        offset    = 0;
+        producer_cv_.notify_one();
+        return array_view<uint8_t>{};
+    }
+
+private:
+    struct buffer {
+        std::vector<uint8_t> data;
+        size_t               size;
+        uint64_t             pos;   // Stream position of data[0]
+        std::error_code      error; // Only set for buffers without data
+    };
+
+    std::unique_ptr<in_stream> owned_inner_;
+    in_stream&                 inner_;     // Only used by the background thread once it's started
+    const uint64_t             size_;
+    std::vector<buffer>        buffers_;
+    buffer*                    current_;   // Buffer being consumed (only changed by the consumer)
+    uint64_t                   pos_;       // Position when there is no current buffer
+
+    std::mutex                 mutex_;
+    std::condition_variable    producer_cv_;
+    std::condition_variable    consumer_cv_;
+    std::vector<buffer*>       free_;
+    std::deque<buffer*>        filled_;    // In stream order
+    uint64_t                   generation_; // Incremented for every seek that restarts reading
+    uint64_t                   seek_pos_;
+    bool                       stopping_;
+    std::thread                thread_;
+
+    // mutex_ must be held
+    void release_current() {
+        if (current_) {
+            pos_ = current_->pos + current_->size;
+            free_.push_back(current_);
+            current_ = nullptr;
+            producer_cv_.notify_one();
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        uint64_t generation = generation_;
+        uint64_t pos        = seek_pos_;
+        bool     seek       = false;
+        bool     failed     = false;
+        for (;;) {
+            producer_cv_.wait(lock, [&] { return stopping_ || generation != generation_ || (!failed && !free_.empty()); });
+            if (stopping_) {
+                return;
+            }
+            if (generation != generation_) {
+                generation = generation_;
+                pos        = seek_pos_;
+                seek       = true;
+                failed     = false;
+                continue;
+            }
+
+            auto b = free_.back();
+            free_.pop_back();
+            lock.unlock();
+            if (seek) {
+                inner_.seek(pos, seekdir::beg);
+                seek = false;
+            }
+            fill(*b, pos);
+            lock.lock();
+
+            if (generation != generation_) {
+                // Seeked while filling
+                free_.push_back(b);
+                continue;
+            }
+            pos   += b->size;
+            failed = b->size == 0;
+            filled_.push_back(b);
+            consumer_cv_.notify_one();
+        }
+    }
+
+    void fill(buffer& b, uint64_t pos) {
+        b.pos   = pos;
+        b.size  = 0;
+        b.error = std::error_code{};
+        auto wanted = b.data.size();
+        if (size_ != invalid_stream_size) {
+            if (pos >= size_) {
+                b.error = std::make_error_code(std::errc::broken_pipe);
+                return;
+            }
+            wanted = static_cast<size_t>(std::min(static_cast<uint64_t>(wanted), size_ - pos));
+        }
+        while (b.size < wanted) {
+            inner_.ensure_bytes_available();
+            if (inner_.error()) {
+                break;
+            }
+            const auto count = std::min(inner_.peek().size(), wanted - b.size);
+            inner_.read(b.data.data() + b.size, count);
+            b.size += count;
+        }
+        if (!b.size) {
+            b.error = inner_.error();
+            assert(b.error);
+        }
+    }
+};
+
+constexpr size_t in_prefetch_stream::default_buffer_size;
+constexpr size_t in_prefetch_stream::default_buffer_count;
+
+in_prefetch_stream::in_prefetch_stream(in_stream& inner_stream, size_t buffer_size, size_t buffer_count) : impl_(new impl{inner_stream, nullptr, buffer_size, buffer_count})
+{
+    set_refill(&in_prefetch_stream::refill_in_prefetch_stream);
+}
+
+in_prefetch_stream::in_prefetch_stream(std::unique_ptr<in_stream> inner_stream, size_t buffer_size, size_t buffer_count) : impl_(new impl{*inner_stream, std::move(inner_stream), buffer_size, buffer_count})
+{
+    set_refill(&in_prefetch_stream::refill_in_prefetch_stream);
+}
+
+in_prefetch_stream::~in_prefetch_stream() = default;
+
+uint64_t in_prefetch_stream::do_stream_size() const
+{
+    return impl_->size();
+}
+
+void in_prefetch_stream::do_seek(int64_t offset, seekdir way)
+{
+    assert(!error());
+    uint64_t new_pos = 0;
+    switch (way) {
+    case seekdir::beg:
+        new_pos = offset;
+        break;
+    case seekdir::cur:
+        new_pos = tell() + offset;
+        break;
+    case seekdir::end:
+        new_pos = impl_->size() + offset;
+        break;
+    }
+    if (impl_->size() != invalid_stream_size && new_pos > impl_->size()) {
+        set_failed(std::make_error_code(std::errc::invalid_seek));
+        return;
+    }
+    size_t buffer_offset;
+    const auto buf = impl_->seek(new_pos, buffer_offset);
+    set_buffer(buf);
+    set_cursor(buf.begin() + buffer_offset);
+}
+
+uint64_t in_prefetch_stream::do_tell() const
+{
+    return impl_->pos() + (peek().begin() - buffer().begin());
+}
+
+array_view<uint8_t> in_prefetch_stream::refill_in_prefetch_stream()
+{
+    std::error_code error;
+    const auto buf = impl_->next(error);
+    if (error) {
+        return set_failed(error);
+    }
+    return buf;
+}
+
+} } // namespace skirmish::util
@@ -0,0 +1,34 @@
+#ifndef SKIRMISH_UTIL_PREFETCH_STREAM_H
+#define SKIRMISH_UTIL_PREFETCH_STREAM_H
+
+#include "stream.h"
+
+namespace skirmish { namespace util {
+
+// Reads ahead of the consumer on a background thread. The inner stream is read into a ring of buffer_count
+// buffers so refilling it (file I/O, decompression) overlaps with whatever is done with the data already read.
+// Once the prefetch stream has been constructed the inner stream must not be used directly. Seeking within the
+// data read ahead is cheap, other seeks discard it and restart reading at the new position.
+class in_prefetch_stream : public in_stream {
+public:
+    static constexpr size_t default_buffer_size  = 64 * 1024;
+    static constexpr size_t default_buffer_count = 3;
+
+    explicit in_prefetch_stream(in_stream& inner_stream, size_t buffer_size = default_buffer_size, size_t buffer_count = default_buffer_count);
+    explicit in_prefetch_stream(std::unique_ptr<in_stream> inner_stream, size_t buffer_size = default_buffer_size, size_t buffer_count = default_buffer_count);
+    ~in_prefetch_stream();
+
+private:
+    class impl;
+    std::unique_ptr<impl> impl_;
+
+    array_view<uint8_t> refill_in_prefetch_stream();
+
+    virtual uint64_t do_stream_size() const override;
+    virtual void do_seek(int64_t offset, seekdir way) override;
+    virtual uint64_t do_tell() const override;
+};
+
+} } // namespace skirmish::util
+
+#endif
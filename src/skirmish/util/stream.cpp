@@ -68,6 +68,11 @@ uint8_t in_stream::get()
 
 uint16_t in_stream::get_u16_le()
 {
+    if (end_ - cursor_ >= 2) {
+        const auto res = load_u16_le(cursor_);
+        cursor_ += 2;
+        return res;
+    }
     uint16_t res = get();
     res |= static_cast<uint16_t>(get()) << 8;
     return res;
@@ -75,6 +80,11 @@ uint16_t in_stream::get_u16_le()
 
 uint32_t in_stream::get_u32_le()
 {
+    if (end_ - cursor_ >= 4) {
+        const auto res = load_u32_le(cursor_);
+        cursor_ += 4;
+        return res;
+    }
     uint32_t res = get_u16_le();
     res |= static_cast<uint32_t>(get_u16_le()) << 16;
     return res;
@@ -89,6 +99,22 @@ float in_stream::get_float_le()
     return f;
 }
 
+void in_stream::read_array_le(void* dest, size_t count, size_t element_size)
+{
+    read(dest, count * element_size);
+#if SKIRMISH_BIG_ENDIAN
+    auto p = static_cast<uint8_t*>(dest);
+    for (size_t i = 0; i < count; ++i, p += element_size) {
+        std::reverse(p, p + element_size);
+    }
+#endif
+}
+
+bool in_stream::do_try_map(array_view<uint8_t>&) const
+{
+    return false;
+}
+
 array_view<uint8_t> in_stream::zeros()
 {
     static const uint8_t zeros[256] = {0,};
@@ -165,4 +191,192 @@ uint64_t in_mem_stream::do_tell() const
     return peek().begin() - buffer().begin();
 }
 
+bool in_mem_stream::do_try_map(array_view<uint8_t>& contents) const
+{
+    if (error()) {
+        return false;
+    }
+    contents = buffer();
+    return true;
+}
+
+out_stream::out_stream()
+    : start_(nullptr)
+    , cursor_(nullptr)
+    , end_(nullptr)
+    , error_()
+    , flush_(&out_stream::discard)
+{
+}
+
+void out_stream::ensure_space_available()
+{
+    if (cursor_ >= end_) {
+        (this->*flush_)();
+        if (cursor_ >= end_) {
+            set_failed(std::make_error_code(std::errc::no_buffer_space));
+        }
+    }
+    assert(space_available() > 0);
+}
+
+void out_stream::write(const void* src, size_t count)
+{
+    auto s = static_cast<const uint8_t*>(src);
+    while (count) {
+        ensure_space_available();
+        const auto now = std::min(count, space_available());
+        std::memcpy(cursor_, s, now);
+        s       += now;
+        cursor_ += now;
+        count   -= now;
+        assert(cursor_ <= end_);
+    }
+}
+
+void out_stream::put(uint8_t value)
+{
+    ensure_space_available();
+    *cursor_++ = value;
+}
+
+void out_stream::put_u16_le(uint16_t value)
+{
+    if (space_available() >= 2) {
+        cursor_[0] = static_cast<uint8_t>(value);
+        cursor_[1] = static_cast<uint8_t>(value >> 8);
+        cursor_ += 2;
+        return;
+    }
+    put(static_cast<uint8_t>(value));
+    put(static_cast<uint8_t>(value >> 8));
+}
+
+void out_stream::put_u32_le(uint32_t value)
+{
+    if (space_available() >= 4) {
+        cursor_[0] = static_cast<uint8_t>(value);
+        cursor_[1] = static_cast<uint8_t>(value >> 8);
+        cursor_[2] = static_cast<uint8_t>(value >> 16);
+        cursor_[3] = static_cast<uint8_t>(value >> 24);
+        cursor_ += 4;
+        return;
+    }
+    put_u16_le(static_cast<uint16_t>(value));
+    put_u16_le(static_cast<uint16_t>(value >> 16));
+}
+
+void out_stream::put_u64_le(uint64_t value)
+{
+    put_u32_le(static_cast<uint32_t>(value));
+    put_u32_le(static_cast<uint32_t>(value >> 32));
+}
+
+void out_stream::put_float_le(float value)
+{
+    uint32_t u32;
+    static_assert(sizeof(u32)==sizeof(value),"");
+    memcpy(&u32, &value, sizeof(float));
+    put_u32_le(u32);
+}
+
+void out_stream::write_array_le(const void* src, size_t count, size_t element_size)
+{
+#if SKIRMISH_BIG_ENDIAN
+    auto p = static_cast<const uint8_t*>(src);
+    for (size_t i = 0; i < count; ++i, p += element_size) {
+        for (size_t j = element_size; j--;) {
+            put(p[j]);
+        }
+    }
+#else
+    write(src, count * element_size);
+#endif
+}
+
+array_view<uint8_t> out_stream::written() const
+{
+    return make_array_view(static_cast<const uint8_t*>(start_), cursor_ - start_);
+}
+
+void out_stream::set_buffer(uint8_t* data, size_t size)
+{
+    start_ = cursor_ = data;
+    end_ = data + size;
+}
+
+void out_stream::set_failed(std::error_code error)
+{
+    assert(error);
+    error_ = error;
+    flush_ = &out_stream::discard;
+    discard();
+}
+
+void out_stream::discard()
+{
+    set_buffer(discard_buffer_, sizeof(discard_buffer_));
+}
+
+out_mem_stream::out_mem_stream(void* data, size_t bytes) : data_(static_cast<uint8_t*>(data))
+{
+    set_buffer(data_, bytes);
+    set_flush(&out_mem_stream::flush_out_mem_stream);
+}
+
+array_view<uint8_t> out_mem_stream::data() const
+{
+    return make_array_view(static_cast<const uint8_t*>(data_), static_cast<size_t>(tell()));
+}
+
+void out_mem_stream::flush_out_mem_stream()
+{
+    // Nothing to pass on, keep writing to the rest of the buffer (if any)
+    const auto w = written();
+    const auto size = static_cast<size_t>(w.size() + space_available());
+    set_buffer(const_cast<uint8_t*>(w.end()), size - w.size());
+}
+
+uint64_t out_mem_stream::do_tell() const
+{
+    assert(!error()); // If the stream has error we're writing to the discard buffer, you probably don't want that
+    return written().end() - data_;
+}
+
+out_vector_stream::out_vector_stream(size_t initial_capacity)
+{
+    buffer_.resize(initial_capacity);
+    set_buffer(buffer_.data(), buffer_.size());
+    set_flush(&out_vector_stream::flush_out_vector_stream);
+}
+
+array_view<uint8_t> out_vector_stream::data() const
+{
+    return make_array_view(buffer_.data(), static_cast<size_t>(tell()));
+}
+
+std::vector<uint8_t> out_vector_stream::release()
+{
+    auto res = std::move(buffer_);
+    res.resize(static_cast<size_t>(written().end() - res.data()));
+    buffer_ = std::vector<uint8_t>{};
+    set_buffer(nullptr, 0);
+    return res;
+}
+
+void out_vector_stream::flush_out_vector_stream()
+{
+    const auto used = static_cast<size_t>(written().end() - buffer_.data());
+    if (used == buffer_.size()) {
+        buffer_.resize(std::max(static_cast<size_t>(256), buffer_.size() * 2));
+    }
+    set_buffer(buffer_.data() + used, buffer_.size() - used);
+}
+
+uint64_t out_vector_stream::do_tell() const
+{
+    assert(!error()); // If the stream has error we're writing to the discard buffer, you probably don't want that
+    return written().end() - buffer_.data();
+}
+
 } } // namespace skirmish::util
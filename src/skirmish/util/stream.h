@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <system_error>
 #include <memory>
+#include <type_traits>
+#include <vector>
 
 #include <skirmish/util/array_view.h>
 
@@ -17,6 +19,28 @@ enum class seekdir {
 
 static constexpr uint64_t invalid_stream_size = UINT64_MAX;
 
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SKIRMISH_BIG_ENDIAN 1
+#else
+#define SKIRMISH_BIG_ENDIAN 0
+#endif
+
+// Load little-endian values from (unaligned) memory
+inline uint16_t load_u16_le(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t load_u32_le(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t load_u64_le(const uint8_t* p) {
+    return load_u32_le(p) | (static_cast<uint64_t>(load_u32_le(p + 4)) << 32);
+}
+
+template<typename Stream>
+class stream_reader;
+
 class in_stream {
 public:
     virtual ~in_stream() {}
@@ -45,6 +69,13 @@ public:
     // Read little-endian ieee-754 single precision floating point value
     float get_float_le();
 
+    // Read count little-endian values (copied directly from the buffer on little-endian hosts)
+    template<typename T>
+    void read_array_le(T* dest, size_t count) {
+        static_assert(std::is_arithmetic<T>::value, "Only arrays of integers and floating point values can be read");
+        read_array_le(dest, count, sizeof(T));
+    }
+
     // Returns stream size (may or may not be meaningful for the stream)
     uint64_t stream_size() const {
         return do_stream_size();
@@ -60,6 +91,11 @@ public:
         return do_tell();
     }
 
+    // Returns true and sets contents to a view of the complete stream if it is memory-resident
+    bool try_map(array_view<uint8_t>& contents) const {
+        return do_try_map(contents);
+    }
+
 protected:
     explicit in_stream();
 
@@ -97,9 +133,16 @@ private:
     // Returns view of static (const) zero buffer
     array_view<uint8_t> zeros();
 
+    void read_array_le(void* dest, size_t count, size_t element_size);
+
+    // Keeps its own copy of the cursor and hands it back through set_cursor
+    template<typename Stream>
+    friend class stream_reader;
+
     virtual uint64_t do_stream_size() const = 0;
     virtual void do_seek(int64_t offset, seekdir way) = 0;
     virtual uint64_t do_tell() const = 0;
+    virtual bool do_try_map(array_view<uint8_t>& contents) const;
 };
 
 class in_zero_stream : public in_stream {
@@ -132,6 +175,135 @@ private:
     virtual uint64_t do_stream_size() const override;
     virtual void do_seek(int64_t offset, seekdir way) override;
     virtual uint64_t do_tell() const override;
+    virtual bool do_try_map(array_view<uint8_t>& contents) const override;
+};
+
+class out_stream {
+public:
+    virtual ~out_stream() {}
+
+    // Returns the streams current error condition (or a default constructed error_code if no error)
+    const std::error_code& error() const { return error_; }
+
+    // Number of bytes that can be written before the buffer has to be flushed
+    size_t space_available() const { return end_ - cursor_; }
+
+    // Makes sure atleast one byte can be written (post condition: space_available() > 0)
+    void ensure_space_available();
+
+    // Write count bytes
+    void write(const void* src, size_t count);
+
+    // Write one byte
+    void put(uint8_t value);
+
+    // Write little-endian 16-bit value
+    void put_u16_le(uint16_t value);
+
+    // Write little-endian 32-bit value
+    void put_u32_le(uint32_t value);
+
+    // Write little-endian 64-bit value
+    void put_u64_le(uint64_t value);
+
+    // Write little-endian ieee-754 single precision floating point value
+    void put_float_le(float value);
+
+    // Write count values in little-endian byte order (copied directly into the buffer on little-endian hosts)
+    template<typename T>
+    void write_array_le(const T* src, size_t count) {
+        static_assert(std::is_arithmetic<T>::value, "Only arrays of integers and floating point values can be written");
+        write_array_le(src, count, sizeof(T));
+    }
+
+    // Passes everything written so far on to the destination and flushes the destination itself (e.g. the file)
+    void flush() {
+        (this->*flush_)();
+        do_flush_destination();
+    }
+
+    // Returns current stream position (number of bytes written)
+    uint64_t tell() const {
+        return do_tell();
+    }
+
+protected:
+    explicit out_stream();
+
+    // set error_ and start discarding everything written
+    void set_failed(std::error_code error);
+
+    // view of the part of the current buffer that has been written to
+    array_view<uint8_t> written() const;
+
+    // sets a new buffer and resets the cursor to the start of it
+    void set_buffer(uint8_t* data, size_t size);
+
+    // set the member-function to be called when the buffer is full or flush() is called. It must consume
+    // written() and should make more space available (the stream fails if it doesn't), may call set_failed.
+    template<typename C>
+    void set_flush(void (C::*flush)()) {
+        flush_ = static_cast<flush_function_type>(flush);
+    }
+
+private:
+    // start_ <= cursor_ <= end_
+    uint8_t*        start_;
+    uint8_t*        cursor_;
+    uint8_t*        end_;
+
+    // starts out default constructed, errors are sticky
+    std::error_code error_;
+
+    using flush_function_type = void (out_stream::*)();
+    flush_function_type flush_;
+
+    // Writes are redirected here after an error
+    uint8_t         discard_buffer_[256];
+
+    void discard();
+
+    void write_array_le(const void* src, size_t count, size_t element_size);
+
+    // Called by flush() after the buffer has been passed on (not when it's passed on because it's full),
+    // may call set_failed
+    virtual void do_flush_destination() {}
+    virtual uint64_t do_tell() const = 0;
+};
+
+// Writes into a fixed size block of memory, fails when it's full
+class out_mem_stream : public out_stream {
+public:
+    explicit out_mem_stream(void* data, size_t bytes);
+
+    // The bytes written so far
+    array_view<uint8_t> data() const;
+
+private:
+    uint8_t* data_;
+
+    void flush_out_mem_stream();
+
+    virtual uint64_t do_tell() const override;
+};
+
+// Writes into a vector that grows as needed
+class out_vector_stream : public out_stream {
+public:
+    explicit out_vector_stream(size_t initial_capacity = 4096);
+
+    // The bytes written so far
+    array_view<uint8_t> data() const;
+
+    // Returns the bytes written so far and starts over with an empty stream
+    std::vector<uint8_t> release();
+
+private:
+    std::vector<uint8_t> buffer_;
+
+    void flush_out_vector_stream();
+
+    virtual uint64_t do_tell() const override;
 };
 
 } } // namespace skirmish::util
@@ -0,0 +1,211 @@
+#ifndef SKIRMISH_UTIL_STREAM_READER_H
+#define SKIRMISH_UTIL_STREAM_READER_H
+
+#include "stream.h"
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+namespace skirmish { namespace util {
+
+// Cursor over an in_stream for hot parsing loops. The position inside the current buffer is kept in the reader
+// (so it can live in registers) and all reads of bytes already in the buffer are inlined, only running out of
+// buffer goes through the stream's refill function (and seek/tell/stream_size through its virtual functions).
+// The stream must only be used through the reader while it exists.
+template<typename Stream = in_stream>
+class stream_reader {
+public:
+    explicit stream_reader(Stream& s) : s_(s) {
+        load();
+    }
+
+    // Hands the position back to the stream
+    ~stream_reader() {
+        store();
+    }
+
+    stream_reader(const stream_reader&) = delete;
+    stream_reader& operator=(const stream_reader&) = delete;
+
+    const std::error_code& error() const {
+        return s_.error();
+    }
+
+    // Bytes available without refilling (might be empty)
+    array_view<uint8_t> peek() const {
+        return make_array_view(cursor_, end_);
+    }
+
+    // Makes sure at least one byte is available, returns false on error
+    bool ensure_bytes_available() {
+        return cursor_ != end_ || refill();
+    }
+
+    // True if all bytes of the stream have been consumed
+    bool at_end() {
+        if (cursor_ != end_) {
+            return false;
+        }
+        store();
+        return s_.tell() >= s_.stream_size();
+    }
+
+    uint8_t get() {
+        if (cursor_ == end_) {
+            refill();
+        }
+        return *cursor_++;
+    }
+
+    uint16_t get_u16_le() {
+        if (end_ - cursor_ >= 2) {
+            const auto res = load_u16_le(cursor_);
+            cursor_ += 2;
+            return res;
+        }
+        uint8_t b[2];
+        read(b, sizeof(b));
+        return load_u16_le(b);
+    }
+
+    uint32_t get_u32_le() {
+        if (end_ - cursor_ >= 4) {
+            const auto res = load_u32_le(cursor_);
+            cursor_ += 4;
+            return res;
+        }
+        uint8_t b[4];
+        read(b, sizeof(b));
+        return load_u32_le(b);
+    }
+
+    float get_float_le() {
+        const uint32_t u32 = get_u32_le();
+        float f;
+        static_assert(sizeof(u32) == sizeof(f), "");
+        std::memcpy(&f, &u32, sizeof(f));
+        return f;
+    }
+
+    void read(void* dest, size_t count) {
+        auto dst = static_cast<uint8_t*>(dest);
+        while (count) {
+            if (cursor_ == end_) {
+                refill();
+            }
+            const auto now = std::min(count, static_cast<size_t>(end_ - cursor_));
+            std::memcpy(dst, cursor_, now);
+            dst     += now;
+            cursor_ += now;
+            count   -= now;
+        }
+    }
+
+    template<typename T>
+    void read_array_le(T* dest, size_t count) {
+        store();
+        s_.read_array_le(dest, count);
+        load();
+    }
+
+    // Consumes count bytes
+    void skip(size_t count) {
+        while (count) {
+            if (cursor_ == end_) {
+                refill();
+            }
+            const auto now = std::min(count, static_cast<size_t>(end_ - cursor_));
+            cursor_ += now;
+            count   -= now;
+        }
+    }
+
+    // Appends the bytes before the next delimiter to out and consumes the delimiter. Returns false if
+    // the stream ends (or fails) first, in which case out holds the rest of the stream.
+    bool read_until(uint8_t delimiter, std::string& out) {
+        while (!error() && ensure_bytes_available()) {
+            const auto pos = find(delimiter);
+            if (pos) {
+                out.append(cursor_, pos);
+                cursor_ = pos + 1;
+                return true;
+            }
+            out.append(cursor_, end_);
+            cursor_ = end_;
+        }
+        return false;
+    }
+
+    // As read_until, but returns a view of the bytes before the delimiter (or the end of the stream) instead of
+    // copying them. The view points into the stream's buffer unless the bytes straddle a refill, in which case
+    // they are gathered in spill. Reaching the end of the stream is not an error. Valid until the next read.
+    array_view<uint8_t> view_until(uint8_t delimiter, std::string& spill) {
+        auto pos = find(delimiter);
+        if (pos) {
+            const auto res = make_array_view(cursor_, pos);
+            cursor_ = pos + 1;
+            return res;
+        }
+        spill.assign(cursor_, end_);
+        cursor_ = end_;
+        while (!error() && !at_end() && refill()) {
+            pos = find(delimiter);
+            if (pos) {
+                spill.append(cursor_, pos);
+                cursor_ = pos + 1;
+                break;
+            }
+            spill.append(cursor_, end_);
+            cursor_ = end_;
+        }
+        return make_array_view(reinterpret_cast<const uint8_t*>(spill.data()), spill.size());
+    }
+
+    uint64_t tell() {
+        store();
+        return s_.tell();
+    }
+
+    void seek(int64_t offset, seekdir way) {
+        store();
+        s_.seek(offset, way);
+        load();
+    }
+
+    uint64_t stream_size() const {
+        return s_.stream_size();
+    }
+
+private:
+    Stream&        s_;
+    const uint8_t* cursor_;
+    const uint8_t* end_;
+
+    void load() {
+        const auto buf = s_.peek();
+        cursor_ = buf.begin();
+        end_    = buf.end();
+    }
+
+    const uint8_t* find(uint8_t value) const {
+        return cursor_ != end_ ? static_cast<const uint8_t*>(std::memchr(cursor_, value, end_ - cursor_)) : nullptr;
+    }
+
+    void store() {
+        static_cast<in_stream&>(s_).set_cursor(cursor_);
+    }
+
+    // Returns false (leaving the stream's zero buffer available) on error
+    bool refill() {
+        store();
+        s_.ensure_bytes_available();
+        load();
+        assert(cursor_ != end_);
+        return !s_.error();
+    }
+};
+
+} } // namespace skirmish::util
+
+#endif
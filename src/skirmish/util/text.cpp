@@ -1,40 +1,154 @@
 #include "text.h"
-#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
 
 namespace skirmish { namespace util {
 
+namespace {
+
+bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+template<typename T>
+const char* parse_unsigned(const char* first, const char* last, T& value)
+{
+    auto p = first;
+    if (p != last && *p == '+') ++p;
+    if (p == last || !is_digit(*p)) {
+        return first;
+    }
+    T res = 0;
+    for (; p != last && is_digit(*p); ++p) {
+        const T digit = static_cast<T>(*p - '0');
+        if (res > (std::numeric_limits<T>::max() - digit) / 10) {
+            return first;
+        }
+        res = res * 10 + digit;
+    }
+    value = res;
+    return p;
+}
+
+// Powers of ten that are exactly representable as doubles
+constexpr double exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Narrows a correctly rounded double to float. Rounding twice only gives a different result than rounding the
+// exact value once if the double lies exactly halfway between two floats, returns false in that case.
+bool narrow_correctly_rounded(double d, float& f)
+{
+    f = static_cast<float>(d);
+    if (static_cast<double>(f) == d || std::isinf(f)) {
+        return true;
+    }
+    const float other = std::nextafter(f, d > f ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity());
+    return static_cast<double>(f) + static_cast<double>(other) != 2 * d;
+}
+
+} // unnamed namespace
+
 std::string trim(const std::string& in)
 {
-    const char* whitespace = "\t\r\n\v ";
-    const auto first = in.find_first_not_of(whitespace);
-    const auto last  = in.find_last_not_of(whitespace);
-    return first != last ? in.substr(first, last-first+1) : "";
+    const auto res = trim(make_array_view(in));
+    return std::string(res.begin(), res.end());
+}
+
+array_view<char> trim(const array_view<char>& in)
+{
+    auto first = in.begin(), last = in.end();
+    while (first != last && is_space(*first)) ++first;
+    while (last != first && is_space(last[-1])) --last;
+    return make_array_view(first, last);
 }
 
 bool read_line(in_stream& s, std::string& line)
 {
-    line.clear();
-    for (;;) {
-        s.ensure_bytes_available();
-        if (s.error()) break;
-
-        // Is there a newline in the buffer?
-        const auto& buf = s.peek();
-        auto nl = std::find(buf.begin(), buf.end(), '\n');
-        if (nl != buf.end()) {
-            // Yes, extract all bytes up to it
-            line.insert(line.end(), buf.begin(), nl);
-            // And move the stream forward to just past it
-            s.seek(nl - buf.begin() + 1, seekdir::cur);
-            break;
+    stream_reader<> reader{s};
+    return read_line(reader, line);
+}
+
+const char* parse_number(const char* first, const char* last, float& value)
+{
+    auto p = first;
+    const bool negative = p != last && *p == '-';
+    if (p != last && (*p == '-' || *p == '+')) ++p;
+
+    // Gather up to 19 significant digits (always fits in 64 bits)
+    uint64_t mantissa = 0;
+    int      significant_digits = 0;
+    int      exponent = 0;
+    bool     any_digits = false;
+    bool     truncated = false;
+    auto add_digit = [&](char c, bool fraction) {
+        any_digits = true;
+        if (significant_digits < 19) {
+            mantissa = mantissa * 10 + (c - '0');
+            if (mantissa) ++significant_digits;
+            if (fraction) --exponent;
+        } else {
+            truncated |= c != '0';
+            if (!fraction) ++exponent;
+        }
+    };
+    for (; p != last && is_digit(*p); ++p) {
+        add_digit(*p, false);
+    }
+    if (p != last && *p == '.') {
+        for (++p; p != last && is_digit(*p); ++p) {
+            add_digit(*p, true);
+        }
+    }
+    if (!any_digits) {
+        return first;
+    }
+    if (p != last && (*p == 'e' || *p == 'E')) {
+        auto e = p + 1;
+        const bool negative_exponent = e != last && *e == '-';
+        if (e != last && (*e == '-' || *e == '+')) ++e;
+        if (e != last && is_digit(*e)) {
+            int exp_value = 0;
+            for (; e != last && is_digit(*e); ++e) {
+                if (exp_value < 100000) exp_value = exp_value * 10 + (*e - '0');
+            }
+            exponent += negative_exponent ? -exp_value : exp_value;
+            p = e;
         }
-        // No newline in the buffer currently, add all of the data to the line
-        line.insert(line.end(), buf.begin(), buf.end());
-        // And advance the stream
-        s.seek(buf.size(), seekdir::cur);
     }
 
-    return !s.error();
+    float result;
+    bool exact = false;
+    if (!truncated && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        // Both the mantissa and the power of ten are exact, so this is correctly rounded (as a double)
+        double d = static_cast<double>(mantissa);
+        d = exponent < 0 ? d / exact_powers_of_ten[-exponent] : d * exact_powers_of_ten[exponent];
+        exact = narrow_correctly_rounded(negative ? -d : d, result);
+    }
+    if (!exact) {
+        // Rare slow path (the program never changes the C locale, so strtof agrees on the format)
+        const std::string number(first, p);
+        result = std::strtof(number.c_str(), nullptr);
+    }
+
+    if (!(std::fabs(result) <= std::numeric_limits<float>::max())) {
+        return first;
+    }
+    value = result;
+    return p;
+}
+
+const char* parse_number(const char* first, const char* last, uint32_t& value)
+{
+    return parse_unsigned(first, last, value);
+}
+
+const char* parse_number(const char* first, const char* last, unsigned long long& value)
+{
+    return parse_unsigned(first, last, value);
 }
 
-} } // namespace skirmish::util
\ No newline at end of file
+} } // namespace skirmish::util
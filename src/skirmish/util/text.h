@@ -2,14 +2,109 @@
 #define SKIRMISH_UTIL_TEXT_H
 
 #include "stream.h"
+#include "stream_reader.h"
 #include <string>
 
 namespace skirmish { namespace util {
 
+inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
 std::string trim(const std::string& in);
 
+array_view<char> trim(const array_view<char>& in);
+
 bool read_line(in_stream& s, std::string& line);
 
+// As above, but for parsers that keep a reader over the stream between lines
+template<typename Stream>
+bool read_line(stream_reader<Stream>& s, std::string& line)
+{
+    line.clear();
+    s.read_until('\n', line);
+    return !s.error();
+}
+
+// Parse a number at the start of [first, last) in the style of std::from_chars: no locale, no leading
+// whitespace (but a leading '+' is accepted). Returns a pointer past the number, or first (leaving value
+// untouched) if there isn't a valid number there or it's out of range.
+const char* parse_number(const char* first, const char* last, float& value);
+const char* parse_number(const char* first, const char* last, uint32_t& value);
+const char* parse_number(const char* first, const char* last, unsigned long long& value);
+
+// Splits a stream into lines of whitespace separated tokens without copying them out of the stream's buffer
+// (only lines that straddle a refill are gathered in a spill buffer). Views of the line and its tokens are
+// only valid until the next call to next_line.
+template<typename Stream = in_stream>
+class line_tokenizer {
+public:
+    explicit line_tokenizer(Stream& s) : reader_(s), line_(), pos_(nullptr) {
+    }
+
+    const std::error_code& error() const {
+        return reader_.error();
+    }
+
+    // Advances to the next line, returns false if the stream has been exhausted (or failed)
+    bool next_line() {
+        if (reader_.error() || reader_.at_end()) {
+            line_ = array_view<char>{};
+            pos_  = nullptr;
+            return false;
+        }
+        const auto l = reader_.view_until('\n', spill_);
+        line_ = make_array_view(reinterpret_cast<const char*>(l.data()), l.size());
+        pos_  = line_.begin();
+        return !reader_.error();
+    }
+
+    // The current line (without the '\n')
+    array_view<char> line() const {
+        return line_;
+    }
+
+    // Copy of the current line (for error messages)
+    std::string line_string() const {
+        return std::string(line_.begin(), line_.end());
+    }
+
+    // Returns the next token on the current line, empty at the end of the line
+    array_view<char> next_token() {
+        skip_space();
+        const auto start = pos_;
+        while (pos_ != line_.end() && !is_space(*pos_)) {
+            ++pos_;
+        }
+        return make_array_view(start, pos_);
+    }
+
+    // Parses a number at the current position (after skipping whitespace), returns false if there isn't one
+    template<typename T>
+    bool next_number(T& value) {
+        skip_space();
+        const auto next = parse_number(pos_, line_.end(), value);
+        if (next == pos_) {
+            return false;
+        }
+        pos_ = next;
+        return true;
+    }
+
+private:
+    stream_reader<Stream> reader_;
+    std::string           spill_;
+    array_view<char>      line_;
+    const char*           pos_;
+
+    void skip_space() {
+        while (pos_ != line_.end() && is_space(*pos_)) {
+            ++pos_;
+        }
+    }
+};
+
 } } // namespace skirmish::util
 
-#endif
\ No newline at end of file
+#endif
@@ -1,5 +1,5 @@
 #include "tga.h"
-#include <ostream>
+#include "stream_reader.h"
 #include <cassert>
 
 namespace skirmish { namespace tga {
@@ -9,10 +9,10 @@ enum class color_map_type : uint8_t {
     present = 1
 };
 
-void write_grayscale(std::ostream& os, unsigned width, unsigned height, const void* data)
+void write_grayscale(util::out_stream& out, unsigned width, unsigned height, const void* data)
 {
-    auto put_u8 = [&](uint8_t x) { os.put(static_cast<char>(x)); };
-    auto put_u16 = [&](uint16_t x) { put_u8(x&0xff); put_u8(x>>8); };
+    auto put_u8 = [&](uint8_t x) { out.put(x); };
+    auto put_u16 = [&](uint16_t x) { out.put_u16_le(x); };
 
     put_u8(0);                                                        // ID length
     put_u8(static_cast<uint8_t>(color_map_type::none));               // Color map type
@@ -33,29 +33,30 @@ void write_grayscale(std::ostream& os, unsigned width, unsigned height, const vo
     // Image ID
     // Color map
     // Image
-    os.write(static_cast<const char*>(data), width * height);
+    out.write(data, width * height);
 }
 
 bool read(util::in_stream& in, image& img)
 {
     assert(!in.error());
 
-    const auto id_length  = in.get();
-    const auto cmap_type  = static_cast<color_map_type>(in.get());
-    const auto img_type   = static_cast<image_type>(in.get());
+    util::stream_reader<> reader{in};
+    const auto id_length  = reader.get();
+    const auto cmap_type  = static_cast<color_map_type>(reader.get());
+    const auto img_type   = static_cast<image_type>(reader.get());
     // Color map specification
-    const auto cmap_first = in.get_u16_le();
-    const auto cmap_len   = in.get_u16_le();
-    const auto cmap_bpp   = in.get();
+    const auto cmap_first = reader.get_u16_le();
+    const auto cmap_len   = reader.get_u16_le();
+    const auto cmap_bpp   = reader.get();
     // Image specification
-    const auto x_origin   = in.get_u16_le();
-    const auto y_origin   = in.get_u16_le();
-    const auto width      = in.get_u16_le();
-    const auto height     = in.get_u16_le();
-    const auto bpp        = in.get();
-    const auto alpha_info = in.get();
+    const auto x_origin   = reader.get_u16_le();
+    const auto y_origin   = reader.get_u16_le();
+    const auto width      = reader.get_u16_le();
+    const auto height     = reader.get_u16_le();
+    const auto bpp        = reader.get();
+    const auto alpha_info = reader.get();
 
-    if (in.error()) {
+    if (reader.error()) {
         assert(false);
         return false;
     }
@@ -74,7 +75,7 @@ bool read(util::in_stream& in, image& img)
     (void) cmap_first; (void) cmap_bpp; (void) alpha_info; // Ignored
 
     // Skip Image ID
-    if (id_length) in.seek(id_length, util::seekdir::cur);
+    reader.skip(id_length);
     // No color map
     assert(!cmap_len);
     // Image data
@@ -83,8 +84,8 @@ bool read(util::in_stream& in, image& img)
     img.height = height;
     img.bpp    = bpp;
     img.data.resize(width * height * ((bpp+7)/8));
-    in.read(&img.data[0], img.data.size());
-    return !in.error();
+    reader.read(&img.data[0], img.data.size());
+    return !reader.error();
 }
 
 std::vector<uint32_t> to_rgba(const image& img)
@@ -1,14 +1,13 @@
 #ifndef SKIRMISH_TGA_H
 #define SKIRMISH_TGA_H
 
-#include <iosfwd>
 #include <stdint.h>
 #include <skirmish/util/stream.h>
 #include <vector>
 
 namespace skirmish { namespace tga {
 
-void write_grayscale(std::ostream& os, unsigned width, unsigned height, const void* data);
+void write_grayscale(util::out_stream& out, unsigned width, unsigned height, const void* data);
 
 enum class image_type : uint8_t {
     uncompressed_true_color = 2,
@@ -0,0 +1,88 @@
+#include "thread_pool.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <cassert>
+
+namespace skirmish { namespace util {
+
+class thread_pool::impl {
+public:
+    explicit impl(unsigned thread_count) {
+        if (!thread_count) {
+            thread_count = std::max(1U, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < thread_count; ++i) {
+            threads_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~impl() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+        assert(work_.empty());
+    }
+
+    unsigned thread_count() const {
+        return static_cast<unsigned>(threads_.size());
+    }
+
+    void push(std::function<void ()> work) {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            assert(!stopping_);
+            work_.push_back(std::move(work));
+        }
+        cv_.notify_one();
+    }
+
+private:
+    std::mutex                          mutex_;
+    std::condition_variable             cv_;
+    std::deque<std::function<void ()>>  work_;
+    bool                                stopping_ = false;
+    std::vector<std::thread>            threads_;
+
+    void run() {
+        for (;;) {
+            std::function<void ()> work;
+            {
+                std::unique_lock<std::mutex> lock{mutex_};
+                cv_.wait(lock, [this] { return stopping_ || !work_.empty(); });
+                if (work_.empty()) {
+                    return; // Only stop once all work is done
+                }
+                work = std::move(work_.front());
+                work_.pop_front();
+            }
+            work();
+        }
+    }
+};
+
+thread_pool::thread_pool(unsigned thread_count) : impl_(new impl{thread_count})
+{
+}
+
+thread_pool::~thread_pool() = default;
+
+unsigned thread_pool::thread_count() const
+{
+    return impl_->thread_count();
+}
+
+void thread_pool::push(std::function<void ()> work)
+{
+    impl_->push(std::move(work));
+}
+
+} } // namespace skirmish::util
@@ -0,0 +1,41 @@
+#ifndef SKIRMISH_UTIL_THREAD_POOL_H
+#define SKIRMISH_UTIL_THREAD_POOL_H
+
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace skirmish { namespace util {
+
+// Fixed number of worker threads running submitted work in FIFO order. Work that waits for
+// the result of other work must be submitted after it to avoid deadlocking the pool.
+class thread_pool {
+public:
+    // A thread_count of 0 means one thread per hardware thread
+    explicit thread_pool(unsigned thread_count = 0);
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+    // Runs all submitted work to completion before returning
+    ~thread_pool();
+
+    unsigned thread_count() const;
+
+    template<typename F>
+    auto submit(F&& f) -> std::future<decltype(f())> {
+        using result_type = decltype(f());
+        auto task = std::make_shared<std::packaged_task<result_type ()>>(std::forward<F>(f));
+        auto res  = task->get_future();
+        push([task] { (*task)(); });
+        return res;
+    }
+
+private:
+    class impl;
+    std::unique_ptr<impl> impl_;
+
+    void push(std::function<void ()> work);
+};
+
+} } // namespace skirmish::util
+
+#endif
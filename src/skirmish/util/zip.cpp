@@ -1,59 +1,304 @@
 #include "zip.h"
 #include "zip_internals.h"
 #include "deflate_stream.h"
-#include <map>
+#include "file_stream.h"
+#include "buffer_pool.h"
+#include "thread_pool.h"
+#include "crc32.h"
+#include <type_traits>
+#include <mutex>
+#include <atomic>
+#include <list>
+#include <deque>
+#include <unordered_map>
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 
 namespace skirmish { namespace zip {
 
 using util::path_to_u8string;
 
-struct zip_path_compare {
-    static constexpr char crude_transform(char c) {
-        return c >= 'A' && c <= 'Z' ?  c + 'a' - 'A' : static_cast<unsigned char>(c) > 0x7f ? 0x7f : c;
+namespace {
+
+// The UTF-8 form of a path used for lookups (path_to_u8string), on POSIX that's the native string itself
+#ifdef _WIN32
+std::string key_string(const util::path& p)
+{
+    return path_to_u8string(p);
+}
+#else
+const std::string& key_string(const util::path& p)
+{
+    return p.native();
+}
+#endif
+
+} // unnamed namespace
+
+// Flat case-insensitive index of the files in an archive. Keys are normalized once when the index is
+// built, lookups hash and compare the characters of the path in place (they only allocate on Windows,
+// where the path has to be converted to UTF-8).
+class file_index {
+public:
+    void add(std::string&& filename, const central_directory_file_header& header) {
+        names_.push_back(std::move(filename));
+        headers_.push_back(header);
+    }
+
+    // Must be called after the last add() and before the first find()
+    void build() {
+        const auto count = names_.size();
+        if (count >= invalid_slot / 2) {
+            throw std::runtime_error("Too many files in zip archive");
+        }
+
+        std::vector<entry> entries(count);
+        std::string key_chars;
+        for (size_t i = 0; i < count; ++i) {
+            const util::path name{names_[i]};
+            const auto& name_key = key_string(name);
+            auto& e      = entries[i];
+            e.key_offset = static_cast<uint32_t>(key_chars.size());
+            e.key_length = static_cast<uint32_t>(name_key.size());
+            e.hash       = hash_init;
+            for (const auto c : name_key) {
+                const auto nc = normalize(c);
+                key_chars.push_back(nc);
+                e.hash = hash_step(e.hash, nc);
+            }
+        }
+
+        // Keep the files sorted by key so file_list() returns them in a stable order
+        std::vector<uint32_t> order(count);
+        for (size_t i = 0; i < count; ++i) order[i] = static_cast<uint32_t>(i);
+        auto key = [&](const entry& e) { return util::make_array_view(key_chars.data() + e.key_offset, e.key_length); };
+        std::sort(order.begin(), order.end(), [&](uint32_t l, uint32_t r) {
+            const auto lk = key(entries[l]), rk = key(entries[r]);
+            return std::lexicographical_compare(lk.begin(), lk.end(), rk.begin(), rk.end());
+        });
+
+        std::vector<std::string>                   names(count);
+        std::vector<central_directory_file_header> headers(count);
+        entries_.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            names[i]    = std::move(names_[order[i]]);
+            headers[i]  = headers_[order[i]];
+            entries_[i] = entries[order[i]];
+        }
+        names_     = std::move(names);
+        headers_   = std::move(headers);
+        key_chars_ = std::move(key_chars);
+
+        // Open addressing with linear probing, at most half full
+        size_t slot_count = 16;
+        while (slot_count < count * 2) slot_count *= 2;
+        slots_.assign(slot_count, invalid_slot);
+        for (uint32_t i = 0; i < count; ++i) {
+            const auto& e = entries_[i];
+            for (size_t slot = e.hash & (slot_count - 1);; slot = (slot + 1) & (slot_count - 1)) {
+                if (slots_[slot] == invalid_slot) {
+                    slots_[slot] = i;
+                    break;
+                }
+                const auto& other = entries_[slots_[slot]];
+                if (other.hash == e.hash && other.key_length == e.key_length && std::equal(key_chars_.begin() + e.key_offset, key_chars_.begin() + e.key_offset + e.key_length, key_chars_.begin() + other.key_offset)) {
+                    throw std::runtime_error("Duplicate filename in zip: " + names_[i]);
+                }
+            }
+        }
     }
-    static std::string crude_transform(const util::path& p) {
-        std::string s = path_to_u8string(p);
-        for (auto& c : s) c = crude_transform(c);
-        return s;
+
+    const central_directory_file_header* find(const util::path& filename) const {
+        const auto& filename_key = key_string(filename);
+        uint32_t hash = hash_init;
+        for (const auto c : filename_key) {
+            hash = hash_step(hash, normalize(c));
+        }
+
+        const auto mask = slots_.size() - 1;
+        for (size_t slot = hash & mask; slots_[slot] != invalid_slot; slot = (slot + 1) & mask) {
+            const auto& e = entries_[slots_[slot]];
+            if (e.hash != hash || e.key_length != filename_key.size()) {
+                continue;
+            }
+            const char* key = key_chars_.data() + e.key_offset;
+            if (std::equal(filename_key.begin(), filename_key.end(), key, [](char c, char k) { return normalize(c) == k; })) {
+                return &headers_[slots_[slot]];
+            }
+        }
+        return nullptr;
     }
-    bool operator()(const util::path& l, const util::path& r) const {
-        return crude_transform(l) < crude_transform(r);
+
+    const std::vector<std::string>& names() const {
+        return names_;
+    }
+
+    // Headers in the same order as names()
+    const std::vector<central_directory_file_header>& headers() const {
+        return headers_;
+    }
+
+private:
+    struct entry {
+        uint32_t key_offset;
+        uint32_t key_length;
+        uint32_t hash;
+    };
+
+    static constexpr uint32_t invalid_slot = UINT32_MAX;
+    static constexpr uint32_t hash_init    = 2166136261U; // FNV-1a
+
+    std::vector<std::string>                   names_;
+    std::vector<central_directory_file_header> headers_;
+    std::vector<entry>                         entries_;
+    std::string                                key_chars_;
+    std::vector<uint32_t>                      slots_;
+
+    static constexpr char normalize(char c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 'a' - 'A') : static_cast<unsigned char>(c) > 0x7f ? 0x7f : c;
+    }
+
+    static constexpr uint32_t hash_step(uint32_t hash, char c) {
+        return (hash ^ static_cast<uint8_t>(c)) * 16777619U;
     }
 };
+constexpr uint32_t file_index::invalid_slot;
+constexpr uint32_t file_index::hash_init;
+
+// Serializes positional (pread-style) reads against the archive stream, so independent
+// readers never depend on where the shared cursor was left
+class archive_reader {
+public:
+    explicit archive_reader(util::in_stream& in) : in_(in), size_(in.error() ? 0 : in.stream_size()), has_mapping_(in.try_map(mapped_)) {
+    }
 
+    uint64_t size() const {
+        return size_;
+    }
+
+    bool try_map(util::array_view<uint8_t>& contents) const {
+        contents = mapped_;
+        return has_mapping_;
+    }
+
+    // Reads count bytes at absolute position pos, returns false on error
+    bool read_at(uint64_t pos, void* dest, size_t count) {
+        if (pos > size_ || count > size_ - pos) {
+            return false;
+        }
+        if (has_mapping_) {
+            std::memcpy(dest, mapped_.begin() + pos, count);
+            return true;
+        }
+        std::lock_guard<std::mutex> lock{mutex_};
+        in_.seek(pos, util::seekdir::beg);
+        in_.read(dest, count);
+        return !in_.error();
+    }
+
+private:
+    util::in_stream&          in_;
+    uint64_t                  size_;
+    util::array_view<uint8_t> mapped_;
+    bool                      has_mapping_;
+    std::mutex                mutex_;
+};
+
+// Stream of the raw bytes [offset, offset+size) of the archive with its own cursor
+class in_zip_range_stream : public util::in_stream {
+public:
+    explicit in_zip_range_stream(archive_reader& archive, uint64_t offset, uint64_t size, size_t buffer_size)
+        : archive_(archive)
+        , offset_(offset)
+        , size_(size)
+        , pos_(0)
+        , buffer_(util::buffer_pool::shared().acquire(buffer_size)) {
+        set_refill(&in_zip_range_stream::refill_in_zip_range_stream);
+    }
+
+private:
+    archive_reader& archive_;
+    uint64_t        offset_;
+    uint64_t        size_;
+    uint64_t        pos_;     // Position of the start of the current buffer
+    util::buffer_pool::buffer buffer_;
+
+    util::array_view<uint8_t> refill_in_zip_range_stream() {
+        pos_ += buffer().size();
+        if (pos_ >= size_) {
+            return set_failed(std::make_error_code(std::errc::broken_pipe));
+        }
+        const auto count = static_cast<size_t>(std::min(size_ - pos_, static_cast<uint64_t>(buffer_.size())));
+        if (!archive_.read_at(offset_ + pos_, buffer_.data(), count)) {
+            return set_failed(std::make_error_code(std::errc::io_error));
+        }
+        return util::make_array_view(buffer_.data(), count);
+    }
+
+    virtual uint64_t do_stream_size() const override {
+        return size_;
+    }
+
+    virtual void do_seek(int64_t offset, util::seekdir way) override {
+        uint64_t new_pos = 0;
+        switch (way) {
+        case util::seekdir::beg:
+            new_pos = offset;
+            break;
+        case util::seekdir::cur:
+            new_pos = tell() + offset;
+            break;
+        case util::seekdir::end:
+            new_pos = size_ + offset;
+            break;
+        }
+        if (new_pos > size_) {
+            set_failed(std::make_error_code(std::errc::invalid_seek));
+        } else if (new_pos >= pos_ && new_pos <= pos_ + buffer().size()) {
+            set_cursor(buffer().begin() + (new_pos - pos_));
+        } else {
+            set_buffer(util::array_view<uint8_t>{});
+            pos_ = new_pos;
+        }
+    }
+
+    virtual uint64_t do_tell() const override {
+        return pos_ + peek().begin() - buffer().begin();
+    }
+};
+
+// If verified is non-null the CRC32 is checked once the end of the entry is reached and *verified is set if it matched
 class in_zip_file_stream : public util::in_stream {
 public:
-    explicit in_zip_file_stream(util::in_stream& zip, bool& open, bool raw, size_t compressed_size, size_t uncompressed_size, uint32_t crc32)
-        : zip_(zip)
-        , deflate_(raw ? nullptr : new util::in_deflate_stream{zip, compressed_size, uncompressed_size})
-        , open_(open)
+    explicit in_zip_file_stream(std::unique_ptr<util::in_stream> raw_stream, bool stored, uint64_t compressed_size, uint64_t uncompressed_size, uint32_t crc32, size_t buffer_size, std::atomic<bool>* verified)
+        : raw_(std::move(raw_stream))
+        , deflate_(stored ? nullptr : new util::in_deflate_stream{*raw_, compressed_size, uncompressed_size, util::in_deflate_stream::default_checkpoint_interval, buffer_size, verified != nullptr})
         , pos_(0)
         , size_(uncompressed_size)
-        , crc32_(crc32) {
+        , expected_crc32_(crc32)
+        , verified_(verified)
+        , crc32_(0)
+        , crc32_pos_(0) {
         set_refill(&in_zip_file_stream::refill_in_zip_file_stream);
     }
 
-    ~in_zip_file_stream() {
-        assert(open_);
-        open_ = false;
-    }
-
 private:
-    util::in_stream&                         zip_;
+    std::unique_ptr<util::in_stream>         raw_;
     std::unique_ptr<util::in_deflate_stream> deflate_;
-    bool&                                    open_;
-    size_t                                   pos_;
-    size_t                                   size_;
-    uint32_t                                 crc32_;
+    uint64_t                                 pos_;
+    uint64_t                                 size_;
+    uint32_t                                 expected_crc32_;
+    std::atomic<bool>*                       verified_;
+    uint32_t                                 crc32_;       // Only used for stored entries (in_deflate_stream checksums deflated ones)
+    uint64_t                                 crc32_pos_;   // Number of bytes covered by crc32_
 
     util::array_view<uint8_t> refill_in_zip_file_stream() {
-        if (pos_ >= size_) {
+        if (pos_ + buffer().size() >= size_) {
             return set_failed(std::make_error_code(std::errc::broken_pipe));
         }
 
-        auto& uncompressed_ = deflate_ ? *deflate_ : zip_;
+        auto& uncompressed_ = deflate_ ? *deflate_ : *raw_;
 
         assert(!uncompressed_.error());
         pos_ += buffer().size();
@@ -64,44 +309,61 @@ private:
             return set_failed(std::make_error_code(std::errc::io_error));
         }
         auto buf = uncompressed_.peek();
-        if (pos_ + buf.size() >= size_) {
-            // TODO: Check CRC32 on uncompressed file
-            if (deflate_ && deflate_->crc32() != crc32_) {
-                assert(false);
-                return set_failed(std::make_error_code(std::errc::io_error));
-            }
+        if (verified_ && !verify(buf)) {
+            return set_failed(std::make_error_code(std::errc::io_error));
         }
         return buf;
     }
 
+    // Checksums the part of buf (starting at pos_) not seen before, returns false on a mismatch at the end of the entry
+    bool verify(const util::array_view<uint8_t>& buf) {
+        if (!deflate_ && pos_ <= crc32_pos_ && crc32_pos_ < pos_ + buf.size()) {
+            const auto skip = static_cast<size_t>(crc32_pos_ - pos_);
+            crc32_ = util::crc32(crc32_, buf.begin() + skip, buf.size() - skip);
+            crc32_pos_ = pos_ + buf.size();
+        }
+        if (pos_ + buf.size() < size_) {
+            return true;
+        }
+        if (!deflate_ && crc32_pos_ != size_) {
+            // Part of the stored entry was skipped by seeking forward, so it can't be checked
+            return true;
+        }
+        if ((deflate_ ? deflate_->crc32() : crc32_) != expected_crc32_) {
+            return false;
+        }
+        *verified_ = true;
+        return true;
+    }
+
     virtual uint64_t do_stream_size() const override {
         return size_;
     }
 
     virtual void do_seek(int64_t offset, util::seekdir way) override {
-        if (way == util::seekdir::beg) {
-            offset -= tell();
+        int64_t new_pos = offset;
+        if (way == util::seekdir::cur) {
+            new_pos += tell();
         } else if (way == util::seekdir::end) {
-            offset = stream_size() - offset - tell();
+            new_pos += size_;
         }
 
-        if (offset < 0) {
+        if (new_pos < 0 || static_cast<uint64_t>(new_pos) > size_) {
             assert(false);
             set_failed(std::make_error_code(std::errc::invalid_seek));
             return;
         }
 
-        // Discard 'offset' bytes
-#if 1
-        while (offset) {
-            ensure_bytes_available();
-            const auto now = std::min(peek().size(), static_cast<size_t>(offset));
-            set_cursor(peek().begin() + now);
-            offset -= now;
+        if (static_cast<uint64_t>(new_pos) >= pos_ && static_cast<uint64_t>(new_pos) <= pos_ + buffer().size()) {
+            set_cursor(buffer().begin() + (new_pos - pos_));
+            return;
         }
-#else
-        while (offset--) get();
-#endif
+
+        // Both stored and deflated files can be positioned directly (the latter using inflate checkpoints)
+        auto& uncompressed_ = deflate_ ? *deflate_ : *raw_;
+        uncompressed_.seek(new_pos, util::seekdir::beg);
+        pos_ = static_cast<uint64_t>(new_pos);
+        set_buffer(util::array_view<uint8_t>{});
     }
 
     virtual uint64_t do_tell() const override {
@@ -109,42 +371,364 @@ private:
     }
 };
 
+using entry_data = std::shared_ptr<const std::vector<uint8_t>>;
+
+// in_mem_stream that keeps cached entry data alive even if it's evicted while the stream is open
+class in_cached_entry_stream : public util::in_mem_stream {
+public:
+    explicit in_cached_entry_stream(const entry_data& data) : in_mem_stream(data->data(), data->size()), data_(data) {
+    }
+
+private:
+    entry_data data_;
+};
+
+class entry_cache::impl {
+public:
+    explicit impl(uint64_t capacity) : capacity_(capacity), stats_() {
+    }
+
+    uint64_t capacity() const {
+        return capacity_;
+    }
+
+    statistics stats() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return stats_;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock{mutex_};
+        lru_.clear();
+        index_.clear();
+        stats_.size_bytes  = 0;
+        stats_.entry_count = 0;
+    }
+
+    // Entries are identified by the archive and the offset of their local header
+    entry_data find(uint64_t archive_id, uint64_t entry_offset) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = index_.find(key{archive_id, entry_offset});
+        if (it == index_.end()) {
+            ++stats_.misses;
+            return nullptr;
+        }
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->data;
+    }
+
+    void insert(uint64_t archive_id, uint64_t entry_offset, const entry_data& data) {
+        const auto size = data->size();
+        if (size > capacity_) {
+            return;
+        }
+        const key k{archive_id, entry_offset};
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (index_.count(k)) {
+            // Another thread got here first
+            return;
+        }
+        while (stats_.size_bytes + size > capacity_) {
+            evict_one();
+        }
+        lru_.push_front(node{k, data});
+        index_.emplace(k, lru_.begin());
+        stats_.size_bytes += size;
+        ++stats_.entry_count;
+    }
+
+    // Removes all entries belonging to the archive
+    void remove_archive(uint64_t archive_id) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        for (auto it = lru_.begin(); it != lru_.end();) {
+            if (it->k.archive_id == archive_id) {
+                stats_.size_bytes -= it->data->size();
+                --stats_.entry_count;
+                index_.erase(it->k);
+                it = lru_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+private:
+    struct key {
+        uint64_t archive_id;
+        uint64_t entry_offset;
+
+        bool operator==(const key& rhs) const {
+            return archive_id == rhs.archive_id && entry_offset == rhs.entry_offset;
+        }
+    };
+
+    struct key_hash {
+        size_t operator()(const key& k) const {
+            return std::hash<uint64_t>()(k.archive_id * 0x9e3779b97f4a7c15ULL ^ k.entry_offset);
+        }
+    };
+
+    struct node {
+        key        k;
+        entry_data data;
+    };
+
+    const uint64_t                                                    capacity_;
+    mutable std::mutex                                                mutex_;
+    statistics                                                        stats_;
+    std::list<node>                                                   lru_;   // Most recently used first
+    std::unordered_map<key, std::list<node>::iterator, key_hash>      index_;
+
+    void evict_one() {
+        assert(!lru_.empty());
+        const auto& victim = lru_.back();
+        stats_.size_bytes -= victim.data->size();
+        --stats_.entry_count;
+        ++stats_.evictions;
+        index_.erase(victim.k);
+        lru_.pop_back();
+    }
+};
+
+entry_cache::entry_cache(uint64_t capacity_bytes) : impl_(new impl{capacity_bytes})
+{
+}
+
+entry_cache::~entry_cache() = default;
+
+uint64_t entry_cache::capacity() const
+{
+    return impl_->capacity();
+}
+
+entry_cache::statistics entry_cache::stats() const
+{
+    return impl_->stats();
+}
+
+void entry_cache::clear()
+{
+    impl_->clear();
+}
 
 class in_zip_archive::impl {
 public:
-    explicit impl(util::in_stream& in) : owned_stream_(), zip_(in) {
+    explicit impl(util::in_stream& in, std::shared_ptr<entry_cache> cache, crc_check check) : owned_stream_(), zip_(in), archive_(in), cache_(std::move(cache)), id_(next_id()), crc_check_(check) {
         initialize();
     }
     
-    explicit impl(std::unique_ptr<util::in_stream> owned_stream) : owned_stream_(std::move(owned_stream)), zip_(*owned_stream_) {
+    explicit impl(std::unique_ptr<util::in_stream> owned_stream, std::shared_ptr<entry_cache> cache, crc_check check) : owned_stream_(std::move(owned_stream)), zip_(*owned_stream_), archive_(*owned_stream_), cache_(std::move(cache)), id_(next_id()), crc_check_(check) {
         initialize();
     }
 
+    ~impl() {
+        if (cache_) {
+            // Entries of this archive can never be hit again
+            cache_->impl_->remove_archive(id_);
+        }
+    }
+
     std::vector<util::path> file_list() const {
         std::vector<util::path> res;
-        for (const auto& f: files_) {
-            res.push_back(f.first);
+        for (const auto& f: files_.names()) {
+            res.push_back(f);
         }
         return res;
     }
 
-    std::unique_ptr<util::in_stream> open(const util::path& filename) {
-        assert(!zip_.error());
-        if (open_file_) {
-            assert(false);
-            throw std::runtime_error("Only one file can be open at a time");
+    // Safe to call concurrently, every returned stream reads the archive through its own cursor
+    std::unique_ptr<util::in_stream> open(const util::path& filename, size_t buffer_size) {
+        const auto& ch = find(filename);
+
+        util::array_view<uint8_t> contents;
+        if (try_map(filename, ch, contents)) {
+            // The entry is just a range of the mapped archive
+            verify_mapped(filename, ch, contents);
+            return std::make_unique<util::in_mem_stream>(contents);
+        }
+
+        if (cache_) {
+            if (auto data = cache_->impl_->find(id_, ch.local_file_header_offset)) {
+                return std::make_unique<in_cached_entry_stream>(data);
+            }
+        }
+
+        auto stream = open_entry(filename, ch, buffer_size, crc_check_flag(ch));
+        if (!cache_ || ch.uncompressed_size > cache_->capacity()) {
+            return stream;
+        }
+
+        auto data = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(ch.uncompressed_size));
+        stream->read(data->data(), data->size());
+        if (stream->error()) {
+            throw std::system_error(stream->error(), "Error reading " + path_to_u8string(filename) + " from zip archive");
+        }
+        cache_->impl_->insert(id_, ch.local_file_header_offset, data);
+        return std::make_unique<in_cached_entry_stream>(data);
+    }
+
+    bool try_map(const util::path& filename, util::array_view<uint8_t>& contents) const {
+        const auto& ch = find(filename);
+        if (!try_map(filename, ch, contents)) {
+            return false;
         }
+        verify_mapped(filename, ch, contents);
+        return true;
+    }
+
+    void extract_all(const extract_callback& callback, unsigned thread_count) {
+        // Hand out the files largest (compressed) first, so the threads finish at roughly the same time
+        const auto& headers = files_.headers();
+        std::vector<size_t> order(headers.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t l, size_t r) { return headers[l].compressed_size > headers[r].compressed_size; });
+
+        std::atomic<size_t> next{0};
+        std::atomic<bool>   failed{false};
+        auto worker = [&] {
+            try {
+                for (size_t i; !failed && (i = next++) < order.size();) {
+                    extract(files_.names()[order[i]], headers[order[i]], callback);
+                }
+            } catch (...) {
+                failed = true;
+                throw;
+            }
+        };
 
-        auto it = files_.find(filename);
-        if (it == files_.end()) {
+        util::thread_pool pool{thread_count};
+        std::vector<std::future<void>> results;
+        for (unsigned i = 0; i < pool.thread_count(); ++i) {
+            results.push_back(pool.submit(worker));
+        }
+        std::exception_ptr first_error;
+        for (auto& r : results) {
+            try {
+                r.get();
+            } catch (...) {
+                if (!first_error) first_error = std::current_exception();
+            }
+        }
+        if (first_error) {
+            std::rethrow_exception(first_error);
+        }
+    }
+
+private:
+    std::unique_ptr<util::in_stream> owned_stream_;
+    util::in_stream&                 zip_;      // Only used directly while reading the central directory
+    archive_reader                   archive_;
+    std::shared_ptr<entry_cache>     cache_;
+    const uint64_t                   id_;       // Identifies the archive in cache_
+    const crc_check                  crc_check_;
+    file_index                       files_;
+    std::unique_ptr<std::atomic<bool>[]> verified_; // Per entry (in files_.headers() order), set once its CRC32 has matched
+
+    // Returns the flag to set once the CRC32 of the entry has been verified or nullptr if it shouldn't be checked
+    std::atomic<bool>* crc_check_flag(const central_directory_file_header& ch) const {
+        auto& verified = verified_[&ch - files_.headers().data()];
+        if (crc_check_ == crc_check::never || (crc_check_ == crc_check::first_open && verified)) {
+            return nullptr;
+        }
+        return &verified;
+    }
+
+    // Checks the CRC32 of a mapped stored entry up front, since nothing reads it through a checking stream
+    void verify_mapped(const util::path& filename, const central_directory_file_header& ch, util::array_view<uint8_t> contents) const {
+        if (const auto verified = crc_check_flag(ch)) {
+            if (util::crc32(0, contents.begin(), contents.size()) != ch.crc32) {
+                throw std::runtime_error("CRC32 mismatch for " + path_to_u8string(filename) + " in zip archive");
+            }
+            *verified = true;
+        }
+    }
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> id{0};
+        return id++;
+    }
+
+    const central_directory_file_header& find(const util::path& filename) const {
+        const auto header = files_.find(filename);
+        if (!header) {
             throw std::runtime_error(path_to_u8string(filename) + " not found in zip archive");
         }
+        return *header;
+    }
+
+    // Enough for the local header of most files
+    static constexpr size_t local_header_buffer_size = 512;
+
+    std::unique_ptr<util::in_stream> open_entry(const util::path& filename, const central_directory_file_header& ch, size_t buffer_size, std::atomic<bool>* verified) {
+        const auto data_offset = ch.local_file_header_offset + local_header_size(*open_range(ch.local_file_header_offset, archive_.size() - ch.local_file_header_offset, local_header_buffer_size), filename, ch);
+        assert(ch.compression_method == compression_methods::stored || ch.compression_method == compression_methods::deflated);
+        return std::make_unique<in_zip_file_stream>(open_range(data_offset, ch.compressed_size, buffer_size), ch.compression_method == compression_methods::stored, ch.compressed_size, ch.uncompressed_size, ch.crc32, buffer_size, verified);
+    }
+
+    static constexpr size_t max_chunk_size = 1 << 20;
+
+    void extract(const std::string& filename, const central_directory_file_header& ch, const extract_callback& callback) {
+        const util::path path{filename};
+        util::array_view<uint8_t> contents;
+        std::unique_ptr<util::in_stream> stream;
+        if (try_map(path, ch, contents)) {
+            stream = std::make_unique<util::in_mem_stream>(contents);
+        } else {
+            stream = open_entry(path, ch, default_buffer_size, nullptr);
+        }
+
+        // Checksum the data as it's handed out
+        const auto verified = crc_check_flag(ch);
+        uint32_t crc = 0;
+        uint64_t offset = 0;
+        do {
+            util::array_view<uint8_t> chunk;
+            if (offset < ch.uncompressed_size) {
+                stream->ensure_bytes_available();
+                if (stream->error()) {
+                    throw std::system_error(stream->error(), "Error extracting " + filename + " from zip archive");
+                }
+                const auto buf = stream->peek();
+                chunk = util::make_array_view(buf.begin(), static_cast<size_t>(std::min(static_cast<uint64_t>(std::min(buf.size(), max_chunk_size)), ch.uncompressed_size - offset)));
+                if (verified) crc = util::crc32(crc, chunk.begin(), chunk.size());
+            }
+            callback(path, offset, chunk);
+            stream->seek(chunk.size(), util::seekdir::cur);
+            offset += chunk.size();
+        } while (offset < ch.uncompressed_size);
+
+        if (verified) {
+            if (crc != ch.crc32) {
+                throw std::runtime_error("CRC32 mismatch for " + filename + " in zip archive");
+            }
+            *verified = true;
+        }
+    }
 
-        const auto& ch = it->second;
-        zip_.seek(ch.local_file_header_offset, util::seekdir::beg);
+    // Returns a stream of the raw archive bytes [offset, offset+size)
+    std::unique_ptr<util::in_stream> open_range(uint64_t offset, uint64_t size, size_t buffer_size) {
+        if (offset > archive_.size() || size > archive_.size() - offset) {
+            throw std::runtime_error("Invalid range in zip archive");
+        }
+        util::array_view<uint8_t> mapped;
+        if (archive_.try_map(mapped)) {
+            return std::make_unique<util::in_mem_stream>(util::make_array_view(mapped.begin() + offset, static_cast<size_t>(size)));
+        }
+        return std::make_unique<in_zip_range_stream>(archive_, offset, size, buffer_size);
+    }
+
+    // The sizes in the local zip64 extra field (if any) must match the central directory anyway, so
+    // a local size holding the marker isn't looked up
+    static bool zip64_size_matches(uint64_t central_size, uint64_t local_size) {
+        return local_size == zip64_marker_u32 || local_size == central_size;
+    }
+
+    // Reads and validates the local file header at the start of in, returns the number of bytes before the file data
+    static uint64_t local_header_size(util::in_stream& in, const util::path& filename, const central_directory_file_header& ch) {
         local_file_header lh;
-        read(zip_, lh);
-        if (zip_.error() || lh.signature != local_file_header::signature_magic) {
+        read(in, lh);
+        if (in.error() || lh.signature != local_file_header::signature_magic) {
             throw std::runtime_error("Could not read local file header for " + path_to_u8string(filename));
         }
 
@@ -154,47 +738,64 @@ public:
             ch.last_modified_time != lh.last_modified_time ||
             ch.last_modified_date != lh.last_modified_date ||
             ch.crc32 != lh.crc32 ||
-            ch.compressed_size != lh.compressed_size ||
-            ch.uncompressed_size != lh.uncompressed_size ||
+            !zip64_size_matches(ch.compressed_size, lh.compressed_size) ||
+            !zip64_size_matches(ch.uncompressed_size, lh.uncompressed_size) ||
             ch.filename_length != lh.filename_length) {
             throw std::runtime_error("Local and central file headers differ for " + path_to_u8string(filename));
         }
         // TODO: Could check filenames as well here...
-        zip_.seek(lh.filename_length + lh.extra_field_length, util::seekdir::cur);
-        assert(ch.compression_method == compression_methods::stored || ch.compression_method == compression_methods::deflated);
-        open_file_ = true;
-        return std::make_unique<in_zip_file_stream>(zip_, open_file_, ch.compression_method == compression_methods::stored, ch.compressed_size, ch.uncompressed_size, ch.crc32);
+        return local_file_header::min_size_bytes + lh.filename_length + lh.extra_field_length;
     }
 
-private:
-    using file_map_type = std::map<util::path, central_directory_file_header, zip_path_compare>;
-    std::unique_ptr<util::in_stream> owned_stream_;
-    util::in_stream&                 zip_;
-    end_of_central_directory_record  dir_end_;
-    file_map_type                    files_;
-    bool                             open_file_ = false;
+    bool try_map(const util::path& filename, const central_directory_file_header& ch, util::array_view<uint8_t>& contents) const {
+        util::array_view<uint8_t> mapped;
+        if (!archive_.try_map(mapped) || ch.compression_method != compression_methods::stored) {
+            return false;
+        }
+        if (ch.local_file_header_offset > mapped.size()) {
+            throw std::runtime_error("Invalid local header offset for " + path_to_u8string(filename));
+        }
+        util::in_mem_stream local_header{util::make_array_view(mapped.begin() + ch.local_file_header_offset, mapped.end())};
+        const auto offset = ch.local_file_header_offset + local_header_size(local_header, filename, ch);
+        if (ch.compressed_size != ch.uncompressed_size || offset > mapped.size() || ch.compressed_size > mapped.size() - offset) {
+            throw std::runtime_error("Invalid stored file in zip archive: " + path_to_u8string(filename));
+        }
+        contents = util::make_array_view(mapped.begin() + static_cast<size_t>(offset), static_cast<size_t>(ch.compressed_size));
+        return true;
+    }
 
     void initialize() {
         if (zip_.error()) {
             throw std::system_error(zip_.error(), "Invalid ZIP stream");
         }
-        const auto central_dir_end_pos = find_end_of_central_directory_record(zip_, dir_end_);
+        end_of_central_directory_record       dir_end;
+        zip64_end_of_central_directory_record dir_end64;
+        const auto central_dir_end_pos = find_end_of_central_directory_record(zip_, dir_end, dir_end64);
         if (central_dir_end_pos == invalid_file_pos) {
             throw std::runtime_error("Invalid zip archive");
         }
 
-        if (dir_end_.disk_number != 0 || dir_end_.central_disk != 0) {
+        uint64_t central_dir_offset = dir_end.central_directory_offset;
+        uint64_t central_dir_size   = dir_end.central_directory_size_bytes;
+        if (dir_end64.signature) {
+            if (dir_end64.disk_number != 0 || dir_end64.central_disk != 0) {
+                throw std::runtime_error("Disk-spanning zip archives not supported");
+            }
+            central_dir_offset = dir_end64.central_directory_offset;
+            central_dir_size   = dir_end64.central_directory_size_bytes;
+        } else if (dir_end.disk_number != 0 || dir_end.central_disk != 0) {
             throw std::runtime_error("Disk-spanning zip archives not supported");
         }
 
-        const auto central_dir_end = dir_end_.central_directory_offset + dir_end_.central_directory_size_bytes;
+        const auto central_dir_end = central_dir_offset + central_dir_size;
 
-        if (central_dir_end > zip_.stream_size() || central_dir_end > central_dir_end_pos) {
+        if (central_dir_end < central_dir_offset || central_dir_end > zip_.stream_size() || central_dir_end > central_dir_end_pos) {
             throw std::runtime_error("Central directory in zip file is invalid");
         }
 
-        zip_.seek(dir_end_.central_directory_offset, util::seekdir::beg);
+        zip_.seek(central_dir_offset, util::seekdir::beg);
 
+        std::vector<uint8_t> extra_field;
         while (!zip_.error() && zip_.tell() < central_dir_end) {
             central_directory_file_header central_header;
             read(zip_, central_header);
@@ -205,33 +806,61 @@ private:
 
             std::string filename(central_header.filename_length, '\0');
             zip_.read(&filename[0], filename.size());
-            zip_.seek(central_header.extra_field_length, util::seekdir::cur);
+            extra_field.resize(central_header.extra_field_length);
+            zip_.read(extra_field.data(), extra_field.size());
             zip_.seek(central_header.file_comment_length, util::seekdir::cur);
+            if (!read_zip64_extra_field(util::make_array_view(extra_field), central_header)) {
+                throw std::runtime_error("Invalid zip64 extra field in zip file");
+            }
+            if (central_header.disk != 0) {
+                throw std::runtime_error("Disk-spanning zip archives not supported");
+            }
             const bool is_dir = (central_header.external_file_attributes & 0x10) != 0;
             if (!is_dir) {
-                const auto ir = files_.insert({std::move(filename), central_header});
-                if (!ir.second) {
-                    throw std::runtime_error("Duplicate filename in zip: " + path_to_u8string(ir.first->first));
-                }
+                files_.add(std::move(filename), central_header);
             }
         }
 
         if (zip_.error()) {
             throw std::runtime_error("Error while reading zip central directory");
         }
+        files_.build();
+        verified_.reset(new std::atomic<bool>[files_.headers().size()]);
+        for (size_t i = 0; i < files_.headers().size(); ++i) {
+            verified_[i] = false;
+        }
     }
 };
 
-in_zip_archive::in_zip_archive(util::in_stream& in) : impl_(new impl{in})
+constexpr size_t in_zip_archive::impl::local_header_buffer_size;
+constexpr size_t in_zip_archive::impl::max_chunk_size;
+constexpr size_t in_zip_archive::default_buffer_size;
+
+in_zip_archive::in_zip_archive(util::in_stream& in, std::shared_ptr<entry_cache> cache, crc_check check) : impl_(new impl{in, std::move(cache), check})
 {
 }
 
-in_zip_archive::in_zip_archive(std::unique_ptr<util::in_stream> in) : impl_(new impl{std::move(in)})
+in_zip_archive::in_zip_archive(std::unique_ptr<util::in_stream> in, std::shared_ptr<entry_cache> cache, crc_check check) : impl_(new impl{std::move(in), std::move(cache), check})
 {
 }
 
 in_zip_archive::~in_zip_archive() = default;
 
+std::unique_ptr<util::in_stream> in_zip_archive::open(const util::path& filename, size_t buffer_size)
+{
+    return impl_->open(filename, buffer_size);
+}
+
+bool in_zip_archive::try_map(const util::path& filename, util::array_view<uint8_t>& contents) const
+{
+    return impl_->try_map(filename, contents);
+}
+
+void in_zip_archive::extract_all(const extract_callback& callback, unsigned thread_count)
+{
+    impl_->extract_all(callback, thread_count);
+}
+
 std::vector<util::path> in_zip_archive::do_file_list() const
 {
     return impl_->file_list();
@@ -239,7 +868,257 @@ std::vector<util::path> in_zip_archive::do_file_list() const
 
 std::unique_ptr<util::in_stream> in_zip_archive::do_open(const util::path& filename)
 {
-    return impl_->open(filename);
+    return impl_->open(filename, default_buffer_size);
+}
+
+class out_zip_archive::impl {
+public:
+    // Produces the uncompressed contents of an entry, called once on a worker thread
+    using data_source = std::function<std::vector<uint8_t> ()>;
+
+    explicit impl(util::out_stream& out, unsigned thread_count, int level) : out_(out), base_(out.tell()), level_(level), finished_(false), pool_(thread_count) {
+    }
+
+    void add(const util::path& filename, data_source source, entry_compression compression) {
+        assert(!finished_);
+        auto name = entry_name(filename);
+        const auto level = level_;
+        pending_.push_back(pool_.submit([name, source, compression, level] {
+            return compress_entry(name, source(), compression, level);
+        }));
+        // Don't let finished entries pile up in memory
+        while (pending_.size() > 2 * pool_.thread_count()) {
+            write_oldest_pending();
+        }
+    }
+
+    void finish() {
+        assert(!finished_);
+        while (!pending_.empty()) {
+            write_oldest_pending();
+        }
+        finished_ = true;
+
+        const auto central_dir_offset = position();
+        for (const auto& e : central_dir_) {
+            const auto extra_field = make_zip64_extra_field(e.header);
+            auto header = e.header;
+            header.extra_field_length = static_cast<uint16_t>(extra_field.size());
+            write(out_, header);
+            out_.write(e.name.data(), e.name.size());
+            out_.write(extra_field.data(), extra_field.size());
+        }
+        const auto central_dir_size = position() - central_dir_offset;
+        const uint64_t count = central_dir_.size();
+
+        end_of_central_directory_record dir_end{};
+        dir_end.signature                            = end_of_central_directory_record::signature_magic;
+        dir_end.central_directory_records_this_disk  = static_cast<uint16_t>(std::min<uint64_t>(count, zip64_marker_u16));
+        dir_end.central_directory_records_this_total = dir_end.central_directory_records_this_disk;
+        dir_end.central_directory_size_bytes         = static_cast<uint32_t>(std::min<uint64_t>(central_dir_size, zip64_marker_u32));
+        dir_end.central_directory_offset             = static_cast<uint32_t>(std::min<uint64_t>(central_dir_offset, zip64_marker_u32));
+
+        if (count >= zip64_marker_u16 || central_dir_size >= zip64_marker_u32 || central_dir_offset >= zip64_marker_u32) {
+            zip64_end_of_central_directory_record dir_end64{};
+            dir_end64.signature                            = zip64_end_of_central_directory_record::signature_magic;
+            dir_end64.record_size                          = zip64_end_of_central_directory_record::min_size_bytes - 12;
+            dir_end64.version                              = zip64_version;
+            dir_end64.min_version                          = zip64_version;
+            dir_end64.central_directory_records_this_disk  = count;
+            dir_end64.central_directory_records_this_total = count;
+            dir_end64.central_directory_size_bytes         = central_dir_size;
+            dir_end64.central_directory_offset             = central_dir_offset;
+
+            zip64_end_of_central_directory_locator locator{};
+            locator.signature                       = zip64_end_of_central_directory_locator::signature_magic;
+            locator.end_of_central_directory_offset = position();
+            locator.total_disks                     = 1;
+
+            write(out_, dir_end64);
+            write(out_, locator);
+        }
+        write(out_, dir_end);
+        out_.flush();
+        check_output();
+    }
+
+private:
+    struct compressed_entry {
+        std::string          name;
+        compression_methods  method;
+        uint32_t             crc32;
+        uint64_t             uncompressed_size;
+        std::vector<uint8_t> data;
+    };
+
+    struct central_dir_entry {
+        central_directory_file_header header;
+        std::string                   name;
+    };
+
+    static constexpr uint16_t version       = 20;
+    static constexpr uint16_t zip64_version = 45;
+    // Entries get a fixed timestamp (1980-01-01 00:00) so identical input gives identical archives
+    static constexpr uint16_t dos_time      = 0;
+    static constexpr uint16_t dos_date      = (1 << 5) | 1;
+    // General purpose flag: filename is UTF-8
+    static constexpr uint16_t utf8_flag     = 1 << 11;
+
+    util::out_stream&                        out_;
+    const uint64_t                           base_;
+    const int                                level_;
+    bool                                     finished_;
+    std::vector<central_dir_entry>           central_dir_;
+    std::deque<std::future<compressed_entry>> pending_;
+    util::thread_pool                        pool_; // Last so queued work finishes before the other members are destroyed
+
+    uint64_t position() const {
+        return out_.tell() - base_;
+    }
+
+    void check_output() {
+        if (out_.error()) {
+            throw std::system_error(out_.error(), "Error writing zip archive");
+        }
+    }
+
+    static std::string entry_name(const util::path& filename) {
+        auto name = path_to_u8string(filename);
+        if (name.empty() || name.size() > 0xffff || name.front() == '/') {
+            throw std::runtime_error("Invalid filename for zip archive: " + name);
+        }
+        return name;
+    }
+
+    static compressed_entry compress_entry(const std::string& name, std::vector<uint8_t> data, entry_compression compression, int level) {
+        compressed_entry res;
+        res.name              = name;
+        res.method            = compression_methods::stored;
+        res.crc32             = 0;
+        res.uncompressed_size = data.size();
+        if (compression != entry_compression::stored && !data.empty()) {
+            util::out_vector_stream compressed_stream{data.size() / 2 + 64};
+            util::out_deflate_stream deflater{compressed_stream, level};
+            deflater.write(data.data(), data.size());
+            deflater.finish();
+            if (deflater.error()) {
+                throw std::system_error(deflater.error(), "Error compressing " + name);
+            }
+            res.crc32 = deflater.crc32();
+            if (compression == entry_compression::deflated || deflater.compressed_size() < data.size()) {
+                res.method = compression_methods::deflated;
+                res.data   = compressed_stream.release();
+                return res;
+            }
+        } else {
+            res.crc32 = util::crc32(0, data.data(), data.size());
+        }
+        res.data = std::move(data);
+        return res;
+    }
+
+    void write_oldest_pending() {
+        // Popped first, so an entry that failed to compress doesn't stay behind as a spent future
+        auto f = std::move(pending_.front());
+        pending_.pop_front();
+        auto e = f.get();
+
+        const auto offset = position();
+        const bool zip64 = e.data.size() >= zip64_marker_u32 || e.uncompressed_size >= zip64_marker_u32 || offset >= zip64_marker_u32;
+        const bool utf8  = std::any_of(e.name.begin(), e.name.end(), [](char c) { return (c & 0x80) != 0; });
+
+        local_file_header lh{};
+        lh.signature          = local_file_header::signature_magic;
+        lh.min_version        = zip64 ? zip64_version : e.method == compression_methods::deflated ? 20 : 10;
+        lh.flags              = utf8 ? utf8_flag : 0;
+        lh.compression_method = e.method;
+        lh.last_modified_time = dos_time;
+        lh.last_modified_date = dos_date;
+        lh.crc32              = e.crc32;
+        lh.compressed_size    = e.data.size();
+        lh.uncompressed_size  = e.uncompressed_size;
+        lh.filename_length    = static_cast<uint16_t>(e.name.size());
+        const auto extra_field = make_zip64_extra_field(lh);
+        lh.extra_field_length = static_cast<uint16_t>(extra_field.size());
+
+        write(out_, lh);
+        out_.write(e.name.data(), e.name.size());
+        out_.write(extra_field.data(), extra_field.size());
+        out_.write(e.data.data(), e.data.size());
+        check_output();
+
+        central_dir_entry ce{};
+        ce.header.signature                = central_directory_file_header::signature_magic;
+        ce.header.version                  = std::max(version, lh.min_version);
+        ce.header.min_version              = lh.min_version;
+        ce.header.flags                    = lh.flags;
+        ce.header.compression_method       = lh.compression_method;
+        ce.header.last_modified_time       = lh.last_modified_time;
+        ce.header.last_modified_date       = lh.last_modified_date;
+        ce.header.crc32                    = lh.crc32;
+        ce.header.compressed_size          = lh.compressed_size;
+        ce.header.uncompressed_size        = lh.uncompressed_size;
+        ce.header.filename_length          = lh.filename_length;
+        ce.header.local_file_header_offset = offset;
+        ce.name                            = std::move(e.name);
+        central_dir_.push_back(std::move(ce));
+    }
+};
+
+constexpr int out_zip_archive::default_level;
+constexpr uint16_t out_zip_archive::impl::version;
+constexpr uint16_t out_zip_archive::impl::zip64_version;
+constexpr uint16_t out_zip_archive::impl::dos_time;
+constexpr uint16_t out_zip_archive::impl::dos_date;
+constexpr uint16_t out_zip_archive::impl::utf8_flag;
+
+out_zip_archive::out_zip_archive(util::out_stream& out, unsigned thread_count, int level) : impl_(new impl{out, thread_count, level})
+{
+}
+
+out_zip_archive::~out_zip_archive() = default;
+
+void out_zip_archive::add_file(const util::path& filename, const util::path& source, entry_compression compression)
+{
+    impl_->add(filename, [source] {
+        util::in_file_stream in{source};
+        const auto size = in.stream_size();
+        if (in.error() || size > SIZE_MAX) {
+            throw std::system_error(in.error(), "Error opening " + path_to_u8string(source));
+        }
+        std::vector<uint8_t> data(static_cast<size_t>(size));
+        in.read(data.data(), data.size());
+        if (in.error()) {
+            throw std::system_error(in.error(), "Error reading " + path_to_u8string(source));
+        }
+        return data;
+    }, compression);
+}
+
+void out_zip_archive::add(const util::path& filename, util::in_stream& in, entry_compression compression)
+{
+    const auto size = in.stream_size();
+    const auto pos  = in.tell();
+    if (in.error() || size == util::invalid_stream_size || pos > size || size - pos > SIZE_MAX) {
+        throw std::system_error(in.error(), "Invalid stream for " + path_to_u8string(filename));
+    }
+    std::vector<uint8_t> data(static_cast<size_t>(size - pos));
+    in.read(data.data(), data.size());
+    if (in.error()) {
+        throw std::system_error(in.error(), "Error reading " + path_to_u8string(filename));
+    }
+    add(filename, std::move(data), compression);
+}
+
+void out_zip_archive::add(const util::path& filename, std::vector<uint8_t> data, entry_compression compression)
+{
+    auto shared_data = std::make_shared<std::vector<uint8_t>>(std::move(data));
+    impl_->add(filename, [shared_data] { return std::move(*shared_data); }, compression);
+}
+
+void out_zip_archive::finish()
+{
+    impl_->finish();
 }
 
 } } // namespace skirmish::zipu
@@ -5,15 +5,78 @@
 #include <skirmish/util/file_system.h>
 #include <vector>
 #include <string>
+#include <functional>
 
 namespace skirmish { namespace zip {
 
+// Byte-budgeted LRU cache of decompressed zip entries, keyed by (archive, entry). One cache can be
+// shared by several archives. Safe to use from multiple threads.
+class entry_cache {
+public:
+    struct statistics {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t size_bytes;    // Bytes currently held
+        uint64_t entry_count;   // Entries currently held
+    };
+
+    explicit entry_cache(uint64_t capacity_bytes);
+    ~entry_cache();
+
+    uint64_t capacity() const;
+
+    statistics stats() const;
+
+    // Drops all cached entries (counters are kept)
+    void clear();
+
+private:
+    friend class in_zip_archive;
+    class impl;
+    std::unique_ptr<impl> impl_;
+};
+
+// When the CRC32 of an entry is checked (once all of it has been read through open() or extract_all()).
+// Stored entries that are mapped directly (see try_map) are checked in full when opened or mapped,
+// and a mismatch throws.
+enum class crc_check {
+    always,
+    first_open, // Until it has matched once
+    never,
+};
+
+// Any number of files can be open at the same time (and read from different threads), every
+// file stream reads the archive with positional reads rather than sharing its cursor
 class in_zip_archive : public util::file_system {
 public:
-    explicit in_zip_archive(util::in_stream& in);
-    explicit in_zip_archive(std::unique_ptr<util::in_stream> in);
+    static constexpr size_t default_buffer_size = 16384;
+
+    // If a cache is given, entries that can't be mapped directly are decompressed in full the first time
+    // they're opened and later opens return an in_mem_stream over the cached bytes
+    explicit in_zip_archive(util::in_stream& in, std::shared_ptr<entry_cache> cache = nullptr, crc_check check = crc_check::always);
+    explicit in_zip_archive(std::unique_ptr<util::in_stream> in, std::shared_ptr<entry_cache> cache = nullptr, crc_check check = crc_check::always);
     ~in_zip_archive();
 
+    using util::file_system::open;
+
+    // Opens filename reading (and decompressing) it buffer_size bytes at a time, the buffers
+    // are taken from util::buffer_pool::shared()
+    std::unique_ptr<util::in_stream> open(const util::path& filename, size_t buffer_size);
+
+    // If filename is stored uncompressed in a memory-resident archive, sets contents to a view
+    // of the entry's bytes directly inside the archive and returns true (no copying is done).
+    // Throws if the entry's CRC32 is checked (see crc_check) and doesn't match.
+    bool try_map(const util::path& filename, util::array_view<uint8_t>& contents) const;
+
+    // Receives the contents of a file as consecutive chunks (a file without contents gets a single empty chunk).
+    // Different files are extracted concurrently so calls can come from several threads at once.
+    using extract_callback = std::function<void (const util::path& filename, uint64_t offset, util::array_view<uint8_t> data)>;
+
+    // Extracts all files using thread_count threads (0 means one per hardware thread), largest files first
+    // and verifies their CRC32 (see crc_check). The first error encountered is rethrown once all threads have stopped.
+    void extract_all(const extract_callback& callback, unsigned thread_count = 0);
+
 private:
     class impl;
     std::unique_ptr<impl> impl_;
@@ -22,6 +85,42 @@ private:
     virtual std::unique_ptr<util::in_stream> do_open(const util::path& filename) override;
 };
 
+// How the contents of an entry are stored in an out_zip_archive
+enum class entry_compression {
+    automatic,  // Deflated unless that doesn't make the entry smaller
+    stored,
+    deflated,
+};
+
+// Writes a zip archive, switching to the zip64 format for the entries (and central directory) that need it.
+// Entries are read and compressed concurrently on worker threads but written in the order they were added.
+// Every entry is held in memory until it has been written.
+class out_zip_archive {
+public:
+    static constexpr int default_level = -1;
+
+    // A thread_count of 0 means one thread per hardware thread
+    explicit out_zip_archive(util::out_stream& out, unsigned thread_count = 0, int level = default_level);
+    // Entries not yet written are discarded unless finish() has been called
+    ~out_zip_archive();
+
+    // Adds the contents of the file source (read on a worker thread)
+    void add_file(const util::path& filename, const util::path& source, entry_compression compression = entry_compression::automatic);
+
+    // Adds the remaining contents of in (read before returning)
+    void add(const util::path& filename, util::in_stream& in, entry_compression compression = entry_compression::automatic);
+
+    void add(const util::path& filename, std::vector<uint8_t> data, entry_compression compression = entry_compression::automatic);
+
+    // Writes the remaining entries, the central directory and flushes the output stream.
+    // Errors from reading, compressing or writing entries are thrown from add*() or finish().
+    void finish();
+
+private:
+    class impl;
+    std::unique_ptr<impl> impl_;
+};
+
 } } // namespace skirmish::zip
 
 #endif
\ No newline at end of file
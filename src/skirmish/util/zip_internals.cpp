@@ -1,41 +1,155 @@
 #include "zip_internals.h"
 #include <ostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
 
 namespace skirmish { namespace zip {
 
-void read(util::in_stream& in, uint16_t& value)
+namespace {
+
+// Reads a fixed size record with a single read and decodes the fields from memory
+template<size_t Size>
+class record_reader {
+public:
+    explicit record_reader(util::in_stream& in) : pos_(0) {
+        in.read(data_, Size);
+    }
+
+    ~record_reader() {
+        assert(pos_ == Size);
+    }
+
+    void operator()(uint16_t& value) { value = u16(); }
+    void operator()(uint32_t& value) { value = u32(); }
+    void operator()(uint64_t& value) { value = util::load_u64_le(take(8)); }
+
+    template<typename E>
+    void operator()(E& value) {
+        std::underlying_type_t<E> repr;
+        (*this)(repr);
+        value = static_cast<E>(repr);
+    }
+
+    // For fields that are wider in memory than in the file
+    uint16_t u16() { return util::load_u16_le(take(2)); }
+    uint32_t u32() { return util::load_u32_le(take(4)); }
+
+private:
+    uint8_t data_[Size];
+    size_t  pos_;
+
+    const uint8_t* take(size_t count) {
+        assert(pos_ + count <= Size);
+        const auto p = data_ + pos_;
+        pos_ += count;
+        return p;
+    }
+};
+
+} // unnamed namespace
+
+constexpr uint32_t end_of_central_directory_record::signature_magic;
+constexpr uint32_t end_of_central_directory_record::min_size_bytes;
+
+void read(util::in_stream& in, end_of_central_directory_record& r)
 {
-    value = in.get_u16_le();
+    record_reader<end_of_central_directory_record::min_size_bytes> rr{in};
+    rr(r.signature);
+    rr(r.disk_number);
+    rr(r.central_disk);
+    rr(r.central_directory_records_this_disk);
+    rr(r.central_directory_records_this_total);
+    rr(r.central_directory_size_bytes);
+    rr(r.central_directory_offset);
+    rr(r.comment_length);
 }
 
-void read(util::in_stream& in, uint32_t& value)
+void write(util::out_stream& out, const end_of_central_directory_record& r)
 {
-    value = in.get_u32_le();
+    out.put_u32_le(r.signature);
+    out.put_u16_le(r.disk_number);
+    out.put_u16_le(r.central_disk);
+    out.put_u16_le(r.central_directory_records_this_disk);
+    out.put_u16_le(r.central_directory_records_this_total);
+    out.put_u32_le(r.central_directory_size_bytes);
+    out.put_u32_le(r.central_directory_offset);
+    out.put_u16_le(r.comment_length);
 }
 
-template<typename E>
-void read(util::in_stream& in, E& value)
+constexpr uint32_t zip64_end_of_central_directory_locator::signature_magic;
+constexpr uint32_t zip64_end_of_central_directory_locator::size_bytes;
+
+void read(util::in_stream& in, zip64_end_of_central_directory_locator& r)
 {
-    std::underlying_type_t<E> repr;
-    read(in, repr);
-    value = static_cast<E>(repr);
+    record_reader<zip64_end_of_central_directory_locator::size_bytes> rr{in};
+    rr(r.signature);
+    rr(r.central_disk);
+    rr(r.end_of_central_directory_offset);
+    rr(r.total_disks);
 }
 
-constexpr uint32_t end_of_central_directory_record::signature_magic;
-constexpr uint32_t end_of_central_directory_record::min_size_bytes;
+void write(util::out_stream& out, const zip64_end_of_central_directory_locator& r)
+{
+    out.put_u32_le(r.signature);
+    out.put_u32_le(r.central_disk);
+    out.put_u64_le(r.end_of_central_directory_offset);
+    out.put_u32_le(r.total_disks);
+}
 
-void read(util::in_stream& in, end_of_central_directory_record& r)
+constexpr uint32_t zip64_end_of_central_directory_record::signature_magic;
+constexpr uint32_t zip64_end_of_central_directory_record::min_size_bytes;
+
+void read(util::in_stream& in, zip64_end_of_central_directory_record& r)
 {
-    read(in, r.signature);
-    read(in, r.disk_number);
-    read(in, r.central_disk);
-    read(in, r.central_directory_records_this_disk);
-    read(in, r.central_directory_records_this_total);
-    read(in, r.central_directory_size_bytes);
-    read(in, r.central_directory_offset);
-    read(in, r.comment_length);
+    record_reader<zip64_end_of_central_directory_record::min_size_bytes> rr{in};
+    rr(r.signature);
+    rr(r.record_size);
+    rr(r.version);
+    rr(r.min_version);
+    rr(r.disk_number);
+    rr(r.central_disk);
+    rr(r.central_directory_records_this_disk);
+    rr(r.central_directory_records_this_total);
+    rr(r.central_directory_size_bytes);
+    rr(r.central_directory_offset);
 }
 
+void write(util::out_stream& out, const zip64_end_of_central_directory_record& r)
+{
+    out.put_u32_le(r.signature);
+    out.put_u64_le(r.record_size);
+    out.put_u16_le(r.version);
+    out.put_u16_le(r.min_version);
+    out.put_u32_le(r.disk_number);
+    out.put_u32_le(r.central_disk);
+    out.put_u64_le(r.central_directory_records_this_disk);
+    out.put_u64_le(r.central_directory_records_this_total);
+    out.put_u64_le(r.central_directory_size_bytes);
+    out.put_u64_le(r.central_directory_offset);
+}
+
+namespace {
+
+uint16_t u16_or_marker(uint64_t value)
+{
+    return static_cast<uint16_t>(std::min<uint64_t>(value, zip64_marker_u16));
+}
+
+uint32_t u32_or_marker(uint64_t value)
+{
+    return static_cast<uint32_t>(std::min<uint64_t>(value, zip64_marker_u32));
+}
+
+// Unlike in the central directory, the local header has to store both sizes in the extra field if either is
+bool local_needs_zip64(const local_file_header& r)
+{
+    return r.compressed_size >= zip64_marker_u32 || r.uncompressed_size >= zip64_marker_u32;
+}
+
+} // unnamed namespace
+
 std::ostream& operator<<(std::ostream& os, compression_methods cm)
 {
     switch (cm) {
@@ -50,23 +164,45 @@ constexpr uint32_t central_directory_file_header::min_size_bytes;
 
 void read(util::in_stream& in, central_directory_file_header& r)
 {
-    read(in, r.signature);
-    read(in, r.version);
-    read(in, r.min_version);
-    read(in, r.flags);
-    read(in, r.compression_method);
-    read(in, r.last_modified_time);
-    read(in, r.last_modified_date);
-    read(in, r.crc32);
-    read(in, r.compressed_size);
-    read(in, r.uncompressed_size);
-    read(in, r.filename_length);
-    read(in, r.extra_field_length);
-    read(in, r.file_comment_length);
-    read(in, r.disk);
-    read(in, r.internal_file_attributes);
-    read(in, r.external_file_attributes);
-    read(in, r.local_file_header_offset);
+    record_reader<central_directory_file_header::min_size_bytes> rr{in};
+    rr(r.signature);
+    rr(r.version);
+    rr(r.min_version);
+    rr(r.flags);
+    rr(r.compression_method);
+    rr(r.last_modified_time);
+    rr(r.last_modified_date);
+    rr(r.crc32);
+    r.compressed_size = rr.u32();
+    r.uncompressed_size = rr.u32();
+    rr(r.filename_length);
+    rr(r.extra_field_length);
+    rr(r.file_comment_length);
+    r.disk = rr.u16();
+    rr(r.internal_file_attributes);
+    rr(r.external_file_attributes);
+    r.local_file_header_offset = rr.u32();
+}
+
+void write(util::out_stream& out, const central_directory_file_header& r)
+{
+    out.put_u32_le(r.signature);
+    out.put_u16_le(r.version);
+    out.put_u16_le(r.min_version);
+    out.put_u16_le(r.flags);
+    out.put_u16_le(static_cast<uint16_t>(r.compression_method));
+    out.put_u16_le(r.last_modified_time);
+    out.put_u16_le(r.last_modified_date);
+    out.put_u32_le(r.crc32);
+    out.put_u32_le(u32_or_marker(r.compressed_size));
+    out.put_u32_le(u32_or_marker(r.uncompressed_size));
+    out.put_u16_le(r.filename_length);
+    out.put_u16_le(r.extra_field_length);
+    out.put_u16_le(r.file_comment_length);
+    out.put_u16_le(u16_or_marker(r.disk));
+    out.put_u16_le(r.internal_file_attributes);
+    out.put_u32_le(r.external_file_attributes);
+    out.put_u32_le(u32_or_marker(r.local_file_header_offset));
 }
 
 constexpr uint32_t local_file_header::signature_magic;
@@ -74,38 +210,262 @@ constexpr uint32_t local_file_header::min_size_bytes;
 
 void read(util::in_stream& in, local_file_header& r)
 {
-    read(in, r.signature);
-    read(in, r.min_version);
-    read(in, r.flags);
-    read(in, r.compression_method);
-    read(in, r.last_modified_time);
-    read(in, r.last_modified_date);
-    read(in, r.crc32);
-    read(in, r.compressed_size);
-    read(in, r.uncompressed_size);
-    read(in, r.filename_length);
-    read(in, r.extra_field_length);
+    record_reader<local_file_header::min_size_bytes> rr{in};
+    rr(r.signature);
+    rr(r.min_version);
+    rr(r.flags);
+    rr(r.compression_method);
+    rr(r.last_modified_time);
+    rr(r.last_modified_date);
+    rr(r.crc32);
+    r.compressed_size = rr.u32();
+    r.uncompressed_size = rr.u32();
+    rr(r.filename_length);
+    rr(r.extra_field_length);
 }
 
-// TODO: This can be probably be done more cleverly
-uint64_t find_end_of_central_directory_record(util::in_stream& in, end_of_central_directory_record& r)
+void write(util::out_stream& out, const local_file_header& r)
 {
+    out.put_u32_le(r.signature);
+    out.put_u16_le(r.min_version);
+    out.put_u16_le(r.flags);
+    out.put_u16_le(static_cast<uint16_t>(r.compression_method));
+    out.put_u16_le(r.last_modified_time);
+    out.put_u16_le(r.last_modified_date);
+    out.put_u32_le(r.crc32);
+    const bool zip64 = local_needs_zip64(r);
+    out.put_u32_le(zip64 ? zip64_marker_u32 : static_cast<uint32_t>(r.compressed_size));
+    out.put_u32_le(zip64 ? zip64_marker_u32 : static_cast<uint32_t>(r.uncompressed_size));
+    out.put_u16_le(r.filename_length);
+    out.put_u16_le(r.extra_field_length);
+}
+
+namespace {
+
+// Finds the data of the zip64 extended information extra field, returns false if the extra field is malformed
+bool find_zip64_extra_field(util::array_view<uint8_t> extra_field, util::array_view<uint8_t>& data)
+{
+    data = util::array_view<uint8_t>{};
+    util::in_mem_stream in{extra_field};
+    while (in.tell() + 4 <= extra_field.size()) {
+        const auto id   = in.get_u16_le();
+        const auto size = in.get_u16_le();
+        const auto pos  = static_cast<size_t>(in.tell());
+        if (pos + size > extra_field.size()) {
+            return false;
+        }
+        if (id == zip64_extra_field_id) {
+            data = util::make_array_view(extra_field.begin() + pos, size);
+            return true;
+        }
+        in.seek(size, util::seekdir::cur);
+    }
+    return true;
+}
+
+// The zip64 extra field only contains the values whose fixed size field holds the marker (in this order)
+template<typename T, typename M>
+bool read_zip64_value(util::in_mem_stream& in, T& value, M marker)
+{
+    if (value != marker) {
+        return true;
+    }
+    if (in.peek().size() < sizeof(T)) {
+        return false;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        v |= static_cast<uint64_t>(in.get()) << (8 * i);
+    }
+    value = static_cast<T>(v);
+    return true;
+}
+
+} // unnamed namespace
+
+bool read_zip64_extra_field(util::array_view<uint8_t> extra_field, central_directory_file_header& r)
+{
+    util::array_view<uint8_t> data;
+    if (!find_zip64_extra_field(extra_field, data)) {
+        return false;
+    }
+    util::in_mem_stream in{data};
+    return read_zip64_value(in, r.uncompressed_size, zip64_marker_u32)
+        && read_zip64_value(in, r.compressed_size, zip64_marker_u32)
+        && read_zip64_value(in, r.local_file_header_offset, zip64_marker_u32)
+        && read_zip64_value(in, r.disk, zip64_marker_u16);
+}
+
+namespace {
+
+class extra_field_writer {
+public:
+    void operator()(uint64_t value, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            data_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    std::vector<uint8_t> finish() {
+        if (data_.empty()) {
+            return data_;
+        }
+        std::vector<uint8_t> res;
+        res.reserve(4 + data_.size());
+        res.push_back(static_cast<uint8_t>(zip64_extra_field_id));
+        res.push_back(static_cast<uint8_t>(zip64_extra_field_id >> 8));
+        res.push_back(static_cast<uint8_t>(data_.size()));
+        res.push_back(static_cast<uint8_t>(data_.size() >> 8));
+        res.insert(res.end(), data_.begin(), data_.end());
+        return res;
+    }
+
+private:
+    std::vector<uint8_t> data_;
+};
+
+} // unnamed namespace
+
+std::vector<uint8_t> make_zip64_extra_field(const central_directory_file_header& r)
+{
+    extra_field_writer w;
+    if (r.uncompressed_size >= zip64_marker_u32) w(r.uncompressed_size, 8);
+    if (r.compressed_size >= zip64_marker_u32) w(r.compressed_size, 8);
+    if (r.local_file_header_offset >= zip64_marker_u32) w(r.local_file_header_offset, 8);
+    if (r.disk >= zip64_marker_u16) w(r.disk, 4);
+    return w.finish();
+}
+
+std::vector<uint8_t> make_zip64_extra_field(const local_file_header& r)
+{
+    extra_field_writer w;
+    if (local_needs_zip64(r)) {
+        w(r.uncompressed_size, 8);
+        w(r.compressed_size, 8);
+    }
+    return w.finish();
+}
+
+namespace {
+
+// Returns the position of the last occurrence of the little-endian signature that starts at or before
+// last_pos and at or after first_pos, or SIZE_MAX if not found. Eight bytes are checked for the first
+// signature byte at a time.
+size_t find_signature_backwards(const uint8_t* data, size_t first_pos, size_t last_pos, uint32_t signature)
+{
+    static constexpr uint64_t ones  = 0x0101010101010101ULL;
+    static constexpr uint64_t highs = 0x8080808080808080ULL;
+    const uint64_t pattern = ones * (signature & 0xff);
+
+    size_t pos = last_pos + 1;
+    while (pos > first_pos) {
+        if (pos - first_pos >= 8) {
+            uint64_t word;
+            std::memcpy(&word, data + pos - 8, sizeof(word));
+            const uint64_t x = word ^ pattern;
+            if (!((x - ones) & ~x & highs)) {
+                pos -= 8; // No byte in the word can start the signature
+                continue;
+            }
+        }
+        --pos;
+        if (data[pos] == (signature & 0xff) && util::load_u32_le(data + pos) == signature) {
+            return pos;
+        }
+    }
+    return SIZE_MAX;
+}
+
+uint64_t find_end_of_central_directory_record(util::in_stream& in, end_of_central_directory_record& r, zip64_end_of_central_directory_record* r64)
+{
+    static constexpr uint32_t eocd_size = end_of_central_directory_record::min_size_bytes;
+    static constexpr uint32_t locator_size = zip64_end_of_central_directory_locator::size_bytes;
+    static constexpr uint32_t zip64_eocd_size = zip64_end_of_central_directory_record::min_size_bytes;
+    // The record is followed by a comment of at most 0xffff bytes, also include room for the
+    // zip64 locator and record that normally precede it
+    static constexpr uint64_t max_tail_size = 0xffff + eocd_size + locator_size + zip64_eocd_size;
+
+    if (r64) {
+        r64->signature = 0;
+    }
+
     const auto file_size = in.stream_size();
-    if (file_size < end_of_central_directory_record::min_size_bytes) {
+    if (in.error() || file_size < eocd_size) {
         return invalid_file_pos;
     }
 
-    for (uint64_t pos = file_size - end_of_central_directory_record::min_size_bytes + 1; !in.error() && pos-- && pos + 0xffff >= file_size;) {
-        in.seek(pos, util::seekdir::beg);
-        read(in, r);
-        assert(in.tell() == pos + end_of_central_directory_record::min_size_bytes);
-        if (r.signature == end_of_central_directory_record::signature_magic &&
-            pos + r.comment_length + end_of_central_directory_record::min_size_bytes == file_size) {
-            return pos;
+    const auto tail_start = file_size - std::min(file_size, max_tail_size);
+    const auto tail_size  = static_cast<size_t>(file_size - tail_start);
+
+    // Read the whole tail with one read (or use it in place if the stream is memory-resident)
+    std::vector<uint8_t> tail_buffer;
+    util::array_view<uint8_t> mapped;
+    const uint8_t* tail;
+    if (in.try_map(mapped)) {
+        tail = mapped.begin() + tail_start;
+        in.seek(file_size, util::seekdir::beg);
+    } else {
+        tail_buffer.resize(tail_size);
+        in.seek(tail_start, util::seekdir::beg);
+        in.read(tail_buffer.data(), tail_size);
+        if (in.error()) {
+            return invalid_file_pos;
         }
+        tail = tail_buffer.data();
     }
 
-    return invalid_file_pos;
+    const size_t min_pos = tail_size > 0xffff + eocd_size ? tail_size - (0xffff + eocd_size) : 0;
+    for (size_t pos = tail_size - eocd_size;;) {
+        pos = find_signature_backwards(tail, min_pos, pos, end_of_central_directory_record::signature_magic);
+        if (pos == SIZE_MAX) {
+            return invalid_file_pos;
+        }
+
+        util::in_mem_stream record{tail + pos, eocd_size};
+        read(record, r);
+        if (pos + r.comment_length + eocd_size != tail_size) {
+            // Probably part of the comment, keep looking
+            if (pos-- == min_pos) {
+                return invalid_file_pos;
+            }
+            continue;
+        }
+
+        const auto record_pos = tail_start + pos;
+
+        if (r64 && pos >= locator_size && util::load_u32_le(tail + pos - locator_size) == zip64_end_of_central_directory_locator::signature_magic) {
+            util::in_mem_stream locator_stream{tail + pos - locator_size, locator_size};
+            zip64_end_of_central_directory_locator locator;
+            read(locator_stream, locator);
+            const auto offset = locator.end_of_central_directory_offset;
+            if (offset >= tail_start && offset + zip64_eocd_size <= record_pos - locator_size) {
+                // Normally the zip64 record is also part of the tail
+                util::in_mem_stream zip64_record{tail + (offset - tail_start), zip64_eocd_size};
+                read(zip64_record, *r64);
+            } else if (offset + zip64_eocd_size <= record_pos - locator_size) {
+                in.seek(offset, util::seekdir::beg);
+                read(in, *r64);
+            }
+            if (in.error() || r64->signature != zip64_end_of_central_directory_record::signature_magic) {
+                return invalid_file_pos;
+            }
+        }
+
+        in.seek(record_pos + eocd_size, util::seekdir::beg);
+        return record_pos;
+    }
+}
+
+} // unnamed namespace
+
+uint64_t find_end_of_central_directory_record(util::in_stream& in, end_of_central_directory_record& r)
+{
+    return find_end_of_central_directory_record(in, r, nullptr);
+}
+
+uint64_t find_end_of_central_directory_record(util::in_stream& in, end_of_central_directory_record& r, zip64_end_of_central_directory_record& r64)
+{
+    return find_end_of_central_directory_record(in, r, &r64);
 }
 
 } } // namespace skirmish::zip
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define SKIRMISH_UTIL_ZIP_INTERNALS_H
 
 #include "stream.h"
+#include <vector>
 
 namespace skirmish { namespace zip {
 
@@ -23,6 +24,44 @@ struct end_of_central_directory_record {
 };
 
 void read(util::in_stream& in, end_of_central_directory_record& r);
+void write(util::out_stream& out, const end_of_central_directory_record& r);
+
+// Zip64 end of central directory locator (immediately precedes the EOCD in ZIP64 archives)
+struct zip64_end_of_central_directory_locator {
+    static constexpr uint32_t signature_magic = 0x07064b50;
+    static constexpr uint32_t size_bytes      = 20;
+
+    // Offset	Bytes	Description
+    uint32_t signature;                             // 0	    4	    Zip64 end of central directory locator signature = 0x07064b50
+    uint32_t central_disk;                          // 4	    4	    Disk where the zip64 end of central directory record starts
+    uint64_t end_of_central_directory_offset;       // 8	    8	    Offset of the zip64 end of central directory record, relative to start of archive
+    uint32_t total_disks;                           // 16	    4	    Total number of disks
+};
+
+void read(util::in_stream& in, zip64_end_of_central_directory_locator& r);
+void write(util::out_stream& out, const zip64_end_of_central_directory_locator& r);
+
+// Zip64 end of central directory record
+struct zip64_end_of_central_directory_record {
+    static constexpr uint32_t signature_magic = 0x06064b50;
+    static constexpr uint32_t min_size_bytes  = 56;
+
+    // Offset	Bytes	Description
+    uint32_t signature;                             // 0	    4	    Zip64 end of central directory signature = 0x06064b50
+    uint64_t record_size;                           // 4	    8	    Size of the remaining record (excluding the first 12 bytes)
+    uint16_t version;                               // 12	    2	    Version made by
+    uint16_t min_version;                           // 14	    2	    Version needed to extract (minimum)
+    uint32_t disk_number;                           // 16	    4	    Number of this disk
+    uint32_t central_disk;                          // 20	    4	    Disk where central directory starts
+    uint64_t central_directory_records_this_disk;   // 24	    8	    Number of central directory records on this disk
+    uint64_t central_directory_records_this_total;  // 32	    8	    Total number of central directory records
+    uint64_t central_directory_size_bytes;          // 40	    8	    Size of central directory (bytes)
+    uint64_t central_directory_offset;              // 48	    8	    Offset of start of central directory, relative to start of archive
+                                                    // 56	    n	    Extensible data sector
+};
+
+void read(util::in_stream& in, zip64_end_of_central_directory_record& r);
+void write(util::out_stream& out, const zip64_end_of_central_directory_record& r);
 
 enum class compression_methods : uint16_t { stored = 0, deflated = 8 };
 std::ostream& operator<<(std::ostream& os, compression_methods cm);
@@ -40,21 +79,23 @@ struct central_directory_file_header {
     uint16_t last_modified_time;            // 12	    2	    File last modification time
     uint16_t last_modified_date;            // 14	    2	    File last modification date
     uint32_t crc32;                         // 16	    4	    CRC-32
-    uint32_t compressed_size;               // 20	    4	    Compressed size
-    uint32_t uncompressed_size;             // 24	    4	    Uncompressed size
+    uint64_t compressed_size;               // 20	    4	    Compressed size (or 0xffffffff if in the zip64 extra field)
+    uint64_t uncompressed_size;             // 24	    4	    Uncompressed size (or 0xffffffff if in the zip64 extra field)
     uint16_t filename_length;               // 28	    2	    File name length (n)
     uint16_t extra_field_length;            // 30	    2	    Extra field length (m)
     uint16_t file_comment_length;           // 32	    2	    File comment length (k)
-    uint16_t disk;                          // 34	    2	    Disk number where file starts
+    uint32_t disk;                          // 34	    2	    Disk number where file starts (or 0xffff if in the zip64 extra field)
     uint16_t internal_file_attributes;      // 36	    2	    Internal file attributes
     uint32_t external_file_attributes;      // 38	    4	    External file attributes
-    uint32_t local_file_header_offset;      // 42	    4	    Relative offset of local file header. This is the number of bytes between the start of the first disk on which the file occurs, and the start of the local file header. This allows software reading the central directory to locate the position of the file inside the .ZIP file.
+    uint64_t local_file_header_offset;      // 42	    4	    Relative offset of local file header (or 0xffffffff if in the zip64 extra field). This is the number of bytes between the start of the first disk on which the file occurs, and the start of the local file header. This allows software reading the central directory to locate the position of the file inside the .ZIP file.
                                             // 46	    n	    File name
                                             // 46+n	    m	    Extra field
                                             // 46+n+m	k	    File comment
 };
 
 void read(util::in_stream& in, central_directory_file_header& r);
+// Values that don't fit their fixed size field are written as the zip64 marker
+void write(util::out_stream& out, const central_directory_file_header& r);
 
 //Local file header
 struct local_file_header {
@@ -68,8 +109,8 @@ struct local_file_header {
     uint16_t last_modified_time;            // 10	    2	    File last modification time
     uint16_t last_modified_date;            // 12	    2	    File last modification date
     uint32_t crc32;                         // 14	    4	    CRC-32
-    uint32_t compressed_size;               // 18	    4	    Compressed size
-    uint32_t uncompressed_size;             // 22	    4	    Uncompressed size
+    uint64_t compressed_size;               // 18	    4	    Compressed size (or 0xffffffff if in the zip64 extra field)
+    uint64_t uncompressed_size;             // 22	    4	    Uncompressed size (or 0xffffffff if in the zip64 extra field)
     uint16_t filename_length;               // 26	    2	    File name length (n)
     uint16_t extra_field_length;            // 28	    2	    Extra field length (m)
                                             // 30	    n	    File name
@@ -77,12 +118,36 @@ struct local_file_header {
 };
 
 void read(util::in_stream& in, local_file_header& r);
+// If either size doesn't fit its fixed size field both are written as the zip64 marker
+void write(util::out_stream& out, const local_file_header& r);
+
+// Values stored in the fixed size fields when the real value is found in the zip64 structures
+static constexpr uint16_t zip64_marker_u16 = 0xffff;
+static constexpr uint32_t zip64_marker_u32 = 0xffffffff;
+
+// Header id of the Zip64 extended information extra field
+static constexpr uint16_t zip64_extra_field_id = 0x0001;
+
+// Replaces the fields of r that hold the zip64 marker with the values from the zip64 extended
+// information extra field (if present). Returns false if the extra field data is malformed.
+bool read_zip64_extra_field(util::array_view<uint8_t> extra_field, central_directory_file_header& r);
+
+// Returns the zip64 extended information extra field matching what write() stores as markers
+// (empty if all values fit their fixed size fields)
+std::vector<uint8_t> make_zip64_extra_field(const central_directory_file_header& r);
+std::vector<uint8_t> make_zip64_extra_field(const local_file_header& r);
 
 static constexpr auto invalid_file_pos = util::invalid_stream_size;
 
-// TODO: This can be probably be done more cleverly
+// Finds the end of central directory record by reading the tail of the archive (up to the maximum comment
+// length) with a single read. Returns the position of the record and leaves the stream just after it
+// or returns invalid_file_pos if no record was found.
 uint64_t find_end_of_central_directory_record(util::in_stream& in, end_of_central_directory_record& r);
 
+// As above, but also looks for the zip64 locator preceding the record and reads the zip64 end of central
+// directory record it points to. r64.signature is set to 0 if the archive doesn't have one.
+uint64_t find_end_of_central_directory_record(util::in_stream& in, end_of_central_directory_record& r, zip64_end_of_central_directory_record& r64);
+
 } } // namespace skirmish::zip
 
 #endif
\ No newline at end of file
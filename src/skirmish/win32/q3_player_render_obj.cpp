@@ -3,37 +3,35 @@
 #include <skirmish/math/types.h>
 #include <skirmish/math/3dmath.h>
 #include <skirmish/util/file_system.h>
+#include <skirmish/util/thread_pool.h>
 #include <skirmish/util/tga.h>
 #include <skirmish/md3/md3.h>
+#include <skirmish/md3/animation.h>
+#include <skirmish/md3/tags.h>
 
 #include <skirmish/win32/d3d11_renderer.h>
 
+#include <tuple>
+
 namespace skirmish {
 
 namespace { 
+// Note: md3::surface_mesh and md3::tag_table are created with positions already in world units
 world_pos to_world(const md3::vec3& v) {
-    return md3::quake_to_meters_f * world_pos{v.x, v.y, v.z};
-}
-
-world_pos to_world_normal(const md3::vec3& v) {
     return world_pos{v.x, v.y, v.z};
 }
 
-std::vector<simple_vertex> vertices_from_frame(const md3::surface_with_data& surf, unsigned frame)
+// The animated positions are written over pos (the mesh positions are already in world units)
+using animated_model = md3::animated_model<simple_vertex>;
+
+simple_vertex make_vertex(const md3::surface_mesh& mesh, uint32_t index)
 {
-    std::vector<simple_vertex> vs;
-    assert(surf.hdr.num_vertices < 65535);
-    assert(frame < surf.hdr.num_frames);
-    const uint32_t offset = frame*surf.hdr.num_vertices;
-    for (uint32_t i = 0; i < surf.hdr.num_vertices; ++i) {
-        vs.push_back(simple_vertex{to_world(surf.frames[offset+i].position()), surf.texcoords[i].s, -surf.texcoords[i].t});
-    }
-    return vs;
+    assert(mesh.num_vertices() < 65535);
+    return simple_vertex{world_pos{}, mesh.s()[index], -mesh.t()[index]};
 }
 
-std::unique_ptr<d3d11_simple_obj> make_obj_from_md3_surface(d3d11_renderer& renderer, const md3::surface_with_data& surf)
+std::unique_ptr<d3d11_simple_obj> make_obj_from_md3_surface(d3d11_renderer& renderer, const md3::surface_with_data& surf, const util::array_view<simple_vertex>& vs)
 {
-    std::vector<simple_vertex> vs = vertices_from_frame(surf, 0);
     std::vector<uint16_t>  ts;
 
     for (uint32_t i = 0; i < surf.hdr.num_triangles; ++i) {
@@ -46,61 +44,84 @@ std::unique_ptr<d3d11_simple_obj> make_obj_from_md3_surface(d3d11_renderer& rend
         ts.push_back(static_cast<uint16_t>(surf.triangles[i].a));
     }
 
-    return std::make_unique<d3d11_simple_obj>(renderer, util::make_array_view(vs), util::make_array_view(ts));
+    return std::make_unique<d3d11_simple_obj>(renderer, vs, util::make_array_view(ts));
 }
 
 using render_obj_vec = std::vector<std::unique_ptr<d3d11_simple_obj>>;
 
-struct animation_instant {
-    animation_instant(uint32_t start_frame, uint32_t end_frame, float sub_time) : start_frame(start_frame), end_frame(end_frame), sub_time(sub_time) {
-        assert(sub_time >= 0.0f && sub_time <= 1.0f);
-    }
+using md3::animation_instant;
 
-    uint32_t start_frame, end_frame;
-    float sub_time;
+// Everything needed to create an md3_render_obj that doesn't touch the GPU
+struct md3_assets {
+    struct texture {
+        std::vector<uint32_t> rgba;
+        uint32_t              width = 0;
+        uint32_t              height = 0;
+    };
+
+    md3::file                       file;
+    std::vector<md3::surface_mesh>  meshes;   // One per surface (positions in world units)
+    md3::skin_info_type             skin_info;
+    std::vector<texture>            textures; // One per surface (empty if the surface isn't skinned)
 };
 
-animation_instant calc_animation_instant(const md3::animation_info& info, double seconds_since_start)
+md3_assets load_md3_assets(util::file_system& fs, const std::string& base_name)
 {
-    // XXX: We don't respect the fact that many animations don't actually loop
-    const auto animation_pos = fmod(seconds_since_start * info.frames_per_second, info.num_frames);
-    const auto frame = static_cast<uint32_t>(animation_pos);
-    assert(frame < info.num_frames);
-    const auto next_frame = (frame + 1) % info.num_frames;
-    return { info.first_frame + frame, info.first_frame + next_frame, static_cast<float>(fmod(animation_pos, 1.0)) };
-}
+    md3_assets assets;
+    auto skin_filename = base_name;
+    skin_filename += "_default.skin";
 
-class md3_render_obj {
-public:
-    explicit md3_render_obj(d3d11_renderer& renderer, util::file_system& fs, const std::string& base_name) {
-        auto skin_filename = base_name;
-        skin_filename += "_default.skin";
+    auto md3_filename = base_name;
+    md3_filename += ".md3";
+    //std::cout << "Loading " << md3_filename << "\n";
 
-        auto md3_filename = base_name;
-        md3_filename += ".md3";
-        //std::cout << "Loading " << md3_filename << "\n";
+    if (!read(*fs.open(md3_filename), assets.file)) {
+        throw std::runtime_error("Error loading md3 file");
+    }
+    for (const auto& surf : assets.file.surfaces) {
+        assets.meshes.emplace_back(surf, md3::quake_to_meters_f);
+    }
 
-        if (!read(*fs.open(md3_filename), file_)) {
-            throw std::runtime_error("Error loading md3 file");
+    //std::cout << "Loading " << skin_filename << "\n";
+    assets.skin_info = md3::read_skin(*fs.open(skin_filename));
+
+    for (const auto& surf : assets.file.surfaces) {
+        assets.textures.emplace_back();
+        auto it = assets.skin_info.find(surf.hdr.name);
+        if (it != assets.skin_info.end()) {
+            const auto& texture_filename = it->second;
+            //std::cout << " Loading texture: " << texture_filename << std::endl;
+            tga::image img;
+            if (!tga::read(*fs.open(texture_filename), img)) {
+                throw std::runtime_error("Could not load TGA " + texture_filename);
+            }
+            //std::cout << "  " << img.width << " x " << img.height << std::endl;
+            auto& tex  = assets.textures.back();
+            tex.rgba   = tga::to_rgba(img);
+            tex.width  = img.width;
+            tex.height = img.height;
         }
+    }
+    return assets;
+}
 
-        //std::cout << "Loading " << skin_filename << "\n";
-        skin_info_ = md3::read_skin(*fs.open(skin_filename));
-
-        for (const auto& surf : file_.surfaces) {
+class md3_render_obj {
+public:
+    explicit md3_render_obj(d3d11_renderer& renderer, md3_assets&& assets)
+        : file_(std::move(assets.file))
+        , model_(std::move(assets.meshes), &make_vertex)
+        , tags_(file_, md3::quake_to_meters_f)
+        , skin_info_(std::move(assets.skin_info)) {
+        assert(assets.textures.size() == file_.surfaces.size());
+        assert(model_.surface_count() == file_.surfaces.size());
+        for (size_t i = 0; i < file_.surfaces.size(); ++i) {
+            const auto& surf = file_.surfaces[i];
             //std::cout << " Surface " << surf.hdr.name << " " << surf.hdr.num_vertices << " vertices " <<  surf.hdr.num_triangles << " triangles\n";
-            surfaces_.push_back(make_obj_from_md3_surface(renderer, surf));
-
-            auto it = skin_info_.find(surf.hdr.name);
-            if (it != skin_info_.end()) {
-                const auto& texture_filename = it->second;
-                //std::cout << " Loading texture: " << texture_filename << std::endl;
-                tga::image img;
-                if (!tga::read(*fs.open(texture_filename), img)) {
-                    throw std::runtime_error("Could not load TGA " + texture_filename);
-                }
-                //std::cout << "  " << img.width << " x " << img.height << std::endl;
-                d3d11_texture tex(renderer, util::make_array_view(tga::to_rgba(img)), img.width, img.height);
+            surfaces_.push_back(make_obj_from_md3_surface(renderer, surf, model_.vertices(i)));
+
+            const auto& tex_data = assets.textures[i];
+            if (!tex_data.rgba.empty()) {
+                d3d11_texture tex(renderer, util::make_array_view(tex_data.rgba), tex_data.width, tex_data.height);
                 surfaces_.back()->set_texture(tex);
             }
             renderer.add_renderable(*surfaces_.back());
@@ -111,15 +132,8 @@ public:
         return file_;
     }
 
-    const md3::tag& tag(const std::string& name, uint32_t frame) const {
-        assert(frame < file_.hdr.num_frames);
-        for (unsigned i = 0; i < file_.hdr.num_tags; ++i) {
-            const auto& t = file_.tags[frame * file_.hdr.num_tags + i];
-            if (t.name == name) {
-                return t;
-            }
-        }
-        throw std::runtime_error("Tag " + name + " not found for frame " + std::to_string(frame));
+    const md3::tag_table& tags() const {
+        return tags_;
     }
 
     void set_transform(const world_matrix& transform) {
@@ -128,87 +142,131 @@ public:
         }
     }
 
+    // The morphing doesn't allocate (checked by test_md3), update_vertices copies into the existing vertex buffer
     void update_animation(const animation_instant& ai) {
         assert(ai.start_frame < file_.hdr.num_frames);
         assert(ai.end_frame < file_.hdr.num_frames);
-        assert(file_.surfaces.size() == surfaces_.size());
+        assert(model_.surface_count() == surfaces_.size());
+        model_.update(ai);
         for (size_t surfnum = 0; surfnum < surfaces_.size(); ++surfnum) {
-            auto f0 = vertices_from_frame(file_.surfaces[surfnum], ai.start_frame);
-            auto f1 = vertices_from_frame(file_.surfaces[surfnum], ai.end_frame);
-            assert(f0.size() == f1.size());
-            for (size_t vertnum = 0; vertnum < f0.size(); ++vertnum) {
-                f0[vertnum].pos = lerp(f0[vertnum].pos, f1[vertnum].pos, ai.sub_time);
-                // S and T don't change between frames
-            }
-            surfaces_[surfnum]->update_vertices(util::make_array_view(f0));
+            surfaces_[surfnum]->update_vertices(model_.vertices(surfnum));
         }
     }
 
 private:
-    md3::file           file_;
-    md3::skin_info_type skin_info_;
-    render_obj_vec      surfaces_;
+    md3::file                       file_;
+    animated_model                  model_;
+    md3::tag_table                  tags_;
+    md3::skin_info_type             skin_info_;
+    render_obj_vec                  surfaces_;
 };
 
 
-world_matrix lerp(const md3::tag& a, const md3::tag& b, float t)
+// Transform from the space of whatever is attached to the tag to the space of the model it belongs to
+world_matrix tag_transform(const md3::tag_frame& tf)
 {
-    // Linear interpolation of the individual axes and the renormalizing was good enough for quake
-    // but we might want to do slerp on quaternions later on
-    const auto origin = lerp(to_world(a.origin), to_world(b.origin), t);
-    const auto x      = normalized(lerp(to_world_normal(a.x_axis), to_world_normal(b.x_axis), t));
-    const auto y      = normalized(lerp(to_world_normal(a.y_axis), to_world_normal(b.y_axis), t));
-    const auto z      = normalized(lerp(to_world_normal(a.z_axis), to_world_normal(b.z_axis), t));
-    return world_matrix{
-        x.x(), y.x(), z.x(), origin.x(),
-        x.y(), y.y(), z.y(), origin.y(),
-        x.z(), y.z(), z.z(), origin.z(),
-        0,     0,     0,          1
-    };
+    return world_matrix::factory::rotation_translation(tf.rotation, to_world(tf.origin));
 }
 
-world_matrix animate_tag(const md3_render_obj& obj, const animation_instant& ai, const char* tag)
+} // unnamed namespace
+
+class q3_player_assets::impl {
+public:
+    md3_assets                  head;
+    md3_assets                  torso;
+    md3_assets                  legs;
+    md3::animation_info_array   animation_info;
+};
+
+q3_player_assets q3_player_render_obj::load(util::file_system& fs, const std::string& base_path)
 {
-    return lerp(obj.tag(tag, ai.start_frame), obj.tag(tag, ai.end_frame), ai.sub_time);
+    q3_player_assets assets;
+    assets.impl_->head           = load_md3_assets(fs, base_path + "/head");
+    assets.impl_->torso          = load_md3_assets(fs, base_path + "/upper");
+    assets.impl_->legs           = load_md3_assets(fs, base_path + "/lower");
+    assets.impl_->animation_info = md3::read_animation_cfg(*fs.open(base_path + "/animation.cfg"));
+    return assets;
 }
 
-} // unnamed namespace
-
 class q3_player_render_obj::impl {
 public:
-    explicit impl(d3d11_renderer& renderer, util::file_system& fs, const std::string& base_path)
-        : head_ (renderer, fs, base_path + "/head")
-        , torso_(renderer, fs, base_path + "/upper")
-        , legs_ (renderer, fs, base_path + "/lower")
-        , animation_info_(md3::read_animation_cfg(*fs.open(base_path + "/animation.cfg"))) {
+    explicit impl(d3d11_renderer& renderer, q3_player_assets::impl&& assets)
+        : head_ (renderer, std::move(assets.head))
+        , torso_(renderer, std::move(assets.torso))
+        , legs_ (renderer, std::move(assets.legs))
+        , animation_info_(assets.animation_info)
+        , torso_tag_(legs_.tags().index("tag_torso"))
+        , head_tag_(torso_.tags().index("tag_head")) {
     }
 
     void update(double t, const world_matrix& legs_transform) {
-        const auto torso_ai = calc_animation_instant(animation_info_[md3::TORSO_ATTACK], t);
-        const auto legs_ai  = calc_animation_instant(animation_info_[md3::LEGS_WALKCR], t);
+        const auto torso_ai = md3::calc_animation_instant(animation_info_[md3::TORSO_ATTACK], t);
+        const auto legs_ai  = md3::calc_animation_instant(animation_info_[md3::LEGS_WALKCR], t);
 
         torso_.update_animation(torso_ai);
         legs_.update_animation(legs_ai);
 
-        auto torso_transform = legs_transform * animate_tag(legs_, legs_ai, torso_tag);
-        auto head_transform  = torso_transform * animate_tag(torso_, torso_ai, head_tag);
+        // All tags of the attachment chain are interpolated together, then each matrix of the chain is computed once
+        const md3::tag_sample samples[] = {
+            legs_.tags().sample(torso_tag_, legs_ai.start_frame, legs_ai.end_frame, legs_ai.sub_time),
+            torso_.tags().sample(head_tag_, torso_ai.start_frame, torso_ai.end_frame, torso_ai.sub_time),
+        };
+        md3::tag_frame tags[2];
+        md3::interpolate_tags(samples, 2, tags);
+
+        const auto torso_transform = legs_transform * tag_transform(tags[0]);
+        const auto head_transform  = torso_transform * tag_transform(tags[1]);
         head_.set_transform(head_transform);
         torso_.set_transform(torso_transform);
         legs_.set_transform(legs_transform);
     }
 
 private:
-    static constexpr const char* const head_tag  = "tag_head";
-    static constexpr const char* const torso_tag = "tag_torso";
-
     md3_render_obj              head_;
     md3_render_obj              torso_;
     md3_render_obj              legs_;
     md3::animation_info_array   animation_info_;
+    uint32_t                    torso_tag_; // Index of tag_torso in legs_
+    uint32_t                    head_tag_;  // Index of tag_head in torso_
 };
 
+q3_player_assets::q3_player_assets() : impl_(new impl{})
+{
+}
+
+q3_player_assets::q3_player_assets(q3_player_assets&& other) = default;
+
+q3_player_assets& q3_player_assets::operator=(q3_player_assets&& other) = default;
+
+q3_player_assets::~q3_player_assets() = default;
+
+std::future<q3_player_assets> q3_player_render_obj::load_async(util::thread_pool& pool, util::file_system& fs, const std::string& base_path)
+{
+    // Each body part is loaded (md3, skin and textures) by its own task. The combining task is submitted
+    // last so the pool always gets to the parts before it can block waiting on them.
+    auto head  = pool.submit([&fs, base_path] { return load_md3_assets(fs, base_path + "/head"); });
+    auto torso = pool.submit([&fs, base_path] { return load_md3_assets(fs, base_path + "/upper"); });
+    auto legs  = pool.submit([&fs, base_path] { return load_md3_assets(fs, base_path + "/lower"); });
+    auto anims = pool.submit([&fs, base_path] { return md3::read_animation_cfg(*fs.open(base_path + "/animation.cfg")); });
+
+    auto parts = std::make_shared<std::tuple<decltype(head), decltype(torso), decltype(legs), decltype(anims)>>(std::move(head), std::move(torso), std::move(legs), std::move(anims));
+    return pool.submit([parts] {
+        q3_player_assets assets;
+        assets.impl_->head           = std::get<0>(*parts).get();
+        assets.impl_->torso          = std::get<1>(*parts).get();
+        assets.impl_->legs           = std::get<2>(*parts).get();
+        assets.impl_->animation_info = std::get<3>(*parts).get();
+        return assets;
+    });
+}
+
+q3_player_render_obj::q3_player_render_obj(d3d11_renderer& renderer, q3_player_assets&& assets)
+    : impl_(new impl{renderer, std::move(*assets.impl_)})
+{
+}
+
 q3_player_render_obj::q3_player_render_obj(d3d11_renderer& renderer, util::file_system& fs, const std::string& base_path)
-    : impl_(new impl{renderer, fs, base_path})
+    : q3_player_render_obj(renderer, load(fs, base_path))
 {
 }
 
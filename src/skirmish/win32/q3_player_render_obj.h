@@ -3,11 +3,38 @@
 
 #include <skirmish/util/file_system.h>
 #include <skirmish/win32/d3d11_renderer.h>
+#include <future>
 
 namespace skirmish {
 
+namespace util {
+class thread_pool;
+} // namespace util
+
+// Decoded (CPU side) model, skin and texture data for a player
+class q3_player_assets {
+public:
+    q3_player_assets();
+    q3_player_assets(q3_player_assets&& other);
+    q3_player_assets& operator=(q3_player_assets&& other);
+    ~q3_player_assets();
+
+private:
+    friend class q3_player_render_obj;
+    class impl;
+    std::unique_ptr<impl> impl_;
+};
+
 class q3_player_render_obj {
 public:
+    // Parses the md3 files, skins and animation config and decodes the textures on the pool.
+    // fs must stay alive until the returned future is ready.
+    static std::future<q3_player_assets> load_async(util::thread_pool& pool, util::file_system& fs, const std::string& base_path);
+
+    // Only creates the GPU resources, call from the render thread
+    q3_player_render_obj(d3d11_renderer& renderer, q3_player_assets&& assets);
+
+    // Loads everything synchronously on the calling thread
     q3_player_render_obj(d3d11_renderer& renderer, util::file_system& fs, const std::string& base_path);
     ~q3_player_render_obj();
 
@@ -16,6 +43,8 @@ public:
 private:
     class impl;
     std::unique_ptr<impl> impl_;
+
+    static q3_player_assets load(util::file_system& fs, const std::string& base_path);
 };
 
 } // namespace skirmish
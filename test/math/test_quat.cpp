@@ -0,0 +1,80 @@
+#include "catch.hpp"
+#include <skirmish/math/3dmath.h>
+#include <skirmish/math/constants.h>
+#include "matvecio.h"
+
+using namespace skirmish;
+struct my_tag;
+using v3  = vec<3, float, my_tag>;
+using q   = quat<float, my_tag>;
+using m33 = mat<3, 3, float, my_tag>;
+using m44 = mat<4, 4, float, my_tag>;
+
+namespace {
+
+#define REQUIRE_VEC3_EQ(a, b) do { const auto va = (a); const auto vb = (b);\
+    REQUIRE(va[0] == Approx(vb[0])); REQUIRE(va[1] == Approx(vb[1])); REQUIRE(va[2] == Approx(vb[2])); } while (0)
+
+// q and -q represent the same rotation
+bool same_rotation(const q& a, const q& b) {
+    return fabs(fabs(dot(a, b)) - 1.0f) < 1e-5f;
+}
+
+q axis_angle(const v3& axis, float angle) {
+    const auto n = normalized(axis);
+    const auto s = sinf(angle / 2);
+    return {n[0] * s, n[1] * s, n[2] * s, cosf(angle / 2)};
+}
+
+} // unnamed namespace
+
+TEST_CASE("Quaternion rotation") {
+    const auto rz90 = axis_angle(v3{0, 0, 1}, pi_f / 2);
+    REQUIRE_VEC3_EQ(rotate(rz90, v3{1, 0, 0}), (v3{0, 1, 0}));
+    REQUIRE_VEC3_EQ(rotate(q::identity(), v3{1, 2, 3}), (v3{1, 2, 3}));
+
+    // Composition
+    const auto rx90 = axis_angle(v3{1, 0, 0}, pi_f / 2);
+    const v3 v{1, 2, 3};
+    REQUIRE_VEC3_EQ(rotate(rx90 * rz90, v), rotate(rx90, rotate(rz90, v)));
+}
+
+TEST_CASE("Quaternion matrix conversion") {
+    const v3 axes[] = { {1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {1, 2, 3}, {-3, 1, 0.5f} };
+    const float angles[] = { 0.0f, 0.3f, pi_f / 2, 2.5f, pi_f - 0.01f, pi_f };
+    const v3 v{0.25f, -2.0f, 1.5f};
+    for (const auto& axis : axes) {
+        for (const auto angle : angles) {
+            const auto rq = axis_angle(axis, angle);
+            const auto m  = m33::factory::rotation(rq);
+            REQUIRE_VEC3_EQ(m * v, rotate(rq, v));
+            REQUIRE(same_rotation(make_quat(m), rq));
+        }
+    }
+    REQUIRE(same_rotation(make_quat(m33::factory::rotation_x(0.5f)), axis_angle(v3{1, 0, 0}, 0.5f)));
+
+    const auto rt = m44::factory::rotation_translation(axis_angle(v3{0, 0, 1}, pi_f / 2), v3{1, 2, 3});
+    const auto p = rt * vec<4, float, my_tag>{1, 0, 0, 1};
+    REQUIRE_VEC3_EQ(p, (v3{1, 3, 3}));
+    REQUIRE(p[3] == 1.0f);
+}
+
+TEST_CASE("Quaternion interpolation") {
+    const auto a = axis_angle(v3{0, 0, 1}, 0.2f);
+    const auto b = axis_angle(v3{0, 0, 1}, 1.0f);
+
+    REQUIRE(same_rotation(slerp(a, b, 0.0f), a));
+    REQUIRE(same_rotation(slerp(a, b, 1.0f), b));
+    REQUIRE(same_rotation(slerp(a, b, 0.25f), axis_angle(v3{0, 0, 1}, 0.4f)));
+    REQUIRE(same_rotation(nlerp(a, b, 0.0f), a));
+    REQUIRE(same_rotation(nlerp(a, b, 1.0f), b));
+    REQUIRE(same_rotation(nlerp(a, b, 0.5f), axis_angle(v3{0, 0, 1}, 0.6f)));
+
+    // Both take the shortest arc when the signs differ
+    const q neg_b{-b.x, -b.y, -b.z, -b.w};
+    REQUIRE(same_rotation(slerp(a, neg_b, 0.25f), axis_angle(v3{0, 0, 1}, 0.4f)));
+    REQUIRE(same_rotation(nlerp(a, neg_b, 0.5f), axis_angle(v3{0, 0, 1}, 0.6f)));
+
+    const auto n = nlerp(a, b, 0.3f);
+    REQUIRE(dot(n, n) == Approx(1));
+}
@@ -0,0 +1,34 @@
+#include "counting_allocator.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<unsigned long long> count{0};
+
+} // unnamed namespace
+
+unsigned long long allocation_count()
+{
+    return count.load();
+}
+
+void* operator new(std::size_t size)
+{
+    ++count;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
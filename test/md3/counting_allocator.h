@@ -0,0 +1,10 @@
+#ifndef SKIRMISH_TEST_COUNTING_ALLOCATOR_H
+#define SKIRMISH_TEST_COUNTING_ALLOCATOR_H
+
+// counting_allocator.cpp replaces the global operator new/delete of the test executable it's linked into.
+// Kept in its own translation unit so the replacements are never inlined next to the code using them.
+
+// Number of calls to operator new so far
+unsigned long long allocation_count();
+
+#endif
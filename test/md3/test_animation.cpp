@@ -0,0 +1,178 @@
+#include <skirmish/md3/animation.h>
+#include <skirmish/md3/tags.h>
+#include <skirmish/math/3dmath.h>
+#include "catch.hpp"
+#include "counting_allocator.h"
+#include <cstring>
+
+using namespace skirmish;
+using namespace skirmish::md3;
+
+namespace {
+
+struct test_vertex {
+    float pos[3];
+    float s, t;
+};
+
+surface_with_data make_surface(uint32_t num_vertices, uint32_t num_frames)
+{
+    surface_with_data surf{};
+    surf.hdr.num_vertices = num_vertices;
+    surf.hdr.num_frames   = num_frames;
+    for (uint32_t i = 0; i < num_vertices * num_frames; ++i) {
+        vertex v{};
+        v.x = static_cast<int16_t>(i);
+        v.y = static_cast<int16_t>(-static_cast<int>(i));
+        v.z = static_cast<int16_t>(i * 3);
+        surf.frames.push_back(v);
+    }
+    for (uint32_t i = 0; i < num_vertices; ++i) {
+        surf.texcoords.push_back(texcoord{static_cast<float>(i), 0.5f});
+    }
+    return surf;
+}
+
+std::vector<surface_mesh> make_meshes()
+{
+    std::vector<surface_mesh> meshes;
+    meshes.emplace_back(make_surface(13, 4));
+    meshes.emplace_back(make_surface(1, 4));
+    meshes.emplace_back(make_surface(0, 4));
+    return meshes;
+}
+
+test_vertex make_test_vertex(const surface_mesh& mesh, uint32_t index)
+{
+    return test_vertex{{0, 0, 0}, mesh.s()[index], mesh.t()[index]};
+}
+
+} // unnamed namespace
+
+TEST_CASE("calc_animation_instant") {
+    animation_info info{};
+    info.first_frame       = 10;
+    info.num_frames        = 4;
+    info.frames_per_second = 2;
+
+    auto ai = calc_animation_instant(info, 0.0);
+    REQUIRE(ai.start_frame == 10);
+    REQUIRE(ai.end_frame == 11);
+    REQUIRE(ai.sub_time == 0.0f);
+
+    ai = calc_animation_instant(info, 1.25);
+    REQUIRE(ai.start_frame == 12);
+    REQUIRE(ai.end_frame == 13);
+    REQUIRE(ai.sub_time == Approx(0.5f));
+
+    // Wraps around to the first frame
+    ai = calc_animation_instant(info, 1.75);
+    REQUIRE(ai.start_frame == 13);
+    REQUIRE(ai.end_frame == 10);
+    REQUIRE(ai.sub_time == Approx(0.5f));
+}
+
+TEST_CASE("animated_model") {
+    animated_model<test_vertex> model{make_meshes(), &make_test_vertex};
+    REQUIRE(model.surface_count() == 3);
+
+    auto check = [&model](uint32_t frame0, uint32_t frame1, float t) {
+        for (size_t surf = 0; surf < model.surface_count(); ++surf) {
+            const auto& mesh = model.mesh(surf);
+            const auto  vs   = model.vertices(surf);
+            REQUIRE(vs.size() == mesh.num_vertices());
+            const auto p0 = mesh.positions(frame0);
+            const auto p1 = mesh.positions(frame1);
+            for (uint32_t i = 0; i < mesh.num_vertices(); ++i) {
+                REQUIRE(vs[i].pos[0] == Approx(p0.x[i] + t * (p1.x[i] - p0.x[i])));
+                REQUIRE(vs[i].pos[1] == Approx(p0.y[i] + t * (p1.y[i] - p0.y[i])));
+                REQUIRE(vs[i].pos[2] == Approx(p0.z[i] + t * (p1.z[i] - p0.z[i])));
+                REQUIRE(vs[i].s == mesh.s()[i]);
+                REQUIRE(vs[i].t == mesh.t()[i]);
+            }
+        }
+    };
+
+    // Starts out at the first frame
+    check(0, 0, 0.0f);
+
+    model.update(animation_instant{1, 3, 0.25f});
+    check(1, 3, 0.25f);
+
+    model.update(animation_instant{3, 0, 1.0f});
+    check(3, 0, 1.0f);
+}
+
+TEST_CASE("animated_model update doesn't allocate") {
+    animated_model<test_vertex> model{make_meshes(), &make_test_vertex};
+    animation_info info{};
+    info.num_frames        = 4;
+    info.frames_per_second = 15;
+
+    model.update(calc_animation_instant(info, 0.0)); // Warm up (e.g. the dispatch of morph)
+    const auto data_before = model.vertices(0).data();
+
+    const auto count_before = allocation_count();
+    for (int i = 0; i < 100; ++i) {
+        model.update(calc_animation_instant(info, i / 60.0));
+    }
+    const auto allocations = allocation_count() - count_before;
+
+    REQUIRE(allocations == 0);
+    REQUIRE(model.vertices(0).data() == data_before);
+}
+
+TEST_CASE("animation update path doesn't allocate") {
+    // The GPU-independent part of q3_player_render_obj::update: morphing two models and
+    // interpolating the tags attaching them, then building the transforms
+    struct world_tag;
+    using matrix = mat<4, 4, float, world_tag>;
+
+    file f{};
+    f.hdr.num_tags   = 1;
+    f.hdr.num_frames = 4;
+    for (uint32_t frame = 0; frame < 4; ++frame) {
+        tag t{};
+        std::strcpy(t.name, "tag_torso");
+        t.origin = vec3{static_cast<float>(frame), 0, 0};
+        t.x_axis = vec3{1, 0, 0};
+        t.y_axis = vec3{0, 1, 0};
+        t.z_axis = vec3{0, 0, 1};
+        f.tags.push_back(t);
+    }
+    const tag_table tags{f};
+    const auto torso_tag = tags.index("tag_torso");
+
+    animated_model<test_vertex> legs{make_meshes(), &make_test_vertex};
+    animated_model<test_vertex> torso{make_meshes(), &make_test_vertex};
+    animation_info info{};
+    info.num_frames        = 4;
+    info.frames_per_second = 15;
+
+    auto update = [&](double t) {
+        const auto ai = calc_animation_instant(info, t);
+        legs.update(ai);
+        torso.update(ai);
+        const tag_sample samples[] = {
+            tags.sample(torso_tag, ai.start_frame, ai.end_frame, ai.sub_time),
+            tags.sample(torso_tag, ai.end_frame, ai.start_frame, ai.sub_time),
+        };
+        tag_frame frames[2];
+        interpolate_tags(samples, 2, frames);
+        const auto torso_transform = matrix::identity() * matrix::factory::rotation_translation(frames[0].rotation, vec<3, float, world_tag>{frames[0].origin.x, frames[0].origin.y, frames[0].origin.z});
+        const auto head_transform  = torso_transform * matrix::factory::rotation_translation(frames[1].rotation, vec<3, float, world_tag>{frames[1].origin.x, frames[1].origin.y, frames[1].origin.z});
+        return head_transform[0][3];
+    };
+
+    update(0.0); // Warm up (e.g. the dispatch of morph and interpolate_tags)
+
+    const auto count_before = allocation_count();
+    float sum = 0;
+    for (int i = 0; i < 100; ++i) {
+        sum += update(i / 60.0);
+    }
+    const auto allocations = allocation_count() - count_before;
+
+    REQUIRE(allocations == 0);
+    REQUIRE(sum > 0);
+}
@@ -0,0 +1,42 @@
+#include <skirmish/md3/mesh.h>
+#include "catch.hpp"
+#include "test_surface.h"
+#include <cmath>
+
+using namespace skirmish::md3;
+
+TEST_CASE("decode_normal") {
+    const auto up = decode_normal(0, 0);
+    REQUIRE(up.x == Approx(0));
+    REQUIRE(up.y == Approx(0));
+    REQUIRE(up.z == Approx(1));
+    for (int nz = 0; nz < 256; nz += 5) {
+        for (int na = 0; na < 256; na += 7) {
+            const auto n = decode_normal(static_cast<uint8_t>(nz), static_cast<uint8_t>(na));
+            REQUIRE(std::sqrt(n.x*n.x + n.y*n.y + n.z*n.z) == Approx(1));
+        }
+    }
+}
+
+TEST_CASE("surface_mesh") {
+    const auto surf = make_surface(5, 3);
+    const surface_mesh mesh{surf, 2.0f};
+    REQUIRE(mesh.num_vertices() == 5);
+    REQUIRE(mesh.num_frames() == 3);
+    for (uint32_t frame = 0; frame < 3; ++frame) {
+        const auto p = mesh.positions(frame);
+        const auto n = mesh.normals(frame);
+        for (uint32_t i = 0; i < 5; ++i) {
+            const auto& v = surf.frames[frame * 5 + i];
+            REQUIRE(p.x[i] == 2.0f * v.position().x);
+            REQUIRE(p.y[i] == 2.0f * v.position().y);
+            REQUIRE(p.z[i] == 2.0f * v.position().z);
+            const auto normal = decode_normal(v.nz, v.na);
+            REQUIRE(n.x[i] == normal.x);
+            REQUIRE(n.y[i] == normal.y);
+            REQUIRE(n.z[i] == normal.z);
+        }
+    }
+    REQUIRE(mesh.s()[3] == 3.0f);
+    REQUIRE(mesh.t()[3] == -3.0f);
+}
@@ -0,0 +1,50 @@
+#include <skirmish/md3/morph.h>
+#include "catch.hpp"
+#include "test_surface.h"
+
+using namespace skirmish::md3;
+
+namespace {
+
+const morph_implementation all_implementations[] = { morph_implementation::scalar, morph_implementation::sse, morph_implementation::avx };
+
+} // unnamed namespace
+
+TEST_CASE("morph implementations agree") {
+    // Vertex counts that exercise both the vector loops and the scalar tails
+    for (uint32_t num_vertices : { 1, 3, 4, 7, 8, 9, 17, 100 }) {
+        const surface_mesh mesh{make_surface(num_vertices, 2)};
+        // Interleaved like a vertex buffer: position, normal, two untouched floats
+        const size_t stride = 8;
+        std::vector<float> expected(num_vertices * stride, -1.0f);
+        morph(morph_implementation::scalar, mesh, 0, 1, 0.25f, morph_output{&expected[0], &expected[3], stride});
+        for (uint32_t i = 0; i < num_vertices; ++i) {
+            const auto a = mesh.positions(0), b = mesh.positions(1);
+            REQUIRE(expected[i * stride + 0] == Approx(a.x[i] + (b.x[i] - a.x[i]) * 0.25f));
+            REQUIRE(expected[i * stride + 1] == Approx(a.y[i] + (b.y[i] - a.y[i]) * 0.25f));
+            REQUIRE(expected[i * stride + 2] == Approx(a.z[i] + (b.z[i] - a.z[i]) * 0.25f));
+            const auto na = mesh.normals(0), nb = mesh.normals(1);
+            REQUIRE(expected[i * stride + 5] == Approx(na.z[i] + (nb.z[i] - na.z[i]) * 0.25f));
+            REQUIRE(expected[i * stride + 6] == -1.0f);
+            REQUIRE(expected[i * stride + 7] == -1.0f);
+        }
+
+        for (const auto impl : all_implementations) {
+            if (!morph_supported(impl)) continue;
+            INFO("Implementation " << static_cast<int>(impl) << " vertices " << num_vertices);
+            std::vector<float> out(num_vertices * stride, -1.0f);
+            morph(impl, mesh, 0, 1, 0.25f, morph_output{&out[0], &out[3], stride});
+            REQUIRE(out == expected);
+
+            // Positions only
+            std::vector<float> positions(num_vertices * 3);
+            morph(impl, mesh, 1, 0, 1.0f, morph_output{&positions[0], nullptr, 3});
+            const auto a = mesh.positions(0);
+            for (uint32_t i = 0; i < num_vertices; ++i) {
+                REQUIRE(positions[i * 3 + 0] == a.x[i]);
+                REQUIRE(positions[i * 3 + 1] == a.y[i]);
+                REQUIRE(positions[i * 3 + 2] == a.z[i]);
+            }
+        }
+    }
+}
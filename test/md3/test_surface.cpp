@@ -0,0 +1,25 @@
+#include "test_surface.h"
+
+using namespace skirmish::md3;
+
+surface_with_data make_surface(uint32_t num_vertices, uint32_t num_frames)
+{
+    surface_with_data surf{};
+    surf.hdr.num_vertices = num_vertices;
+    surf.hdr.num_frames   = num_frames;
+    uint32_t x = 1;
+    auto next = [&x] { x = x * 1103515245 + 12345; return x >> 16; };
+    for (uint32_t i = 0; i < num_vertices * num_frames; ++i) {
+        vertex v;
+        v.x  = static_cast<int16_t>(next());
+        v.y  = static_cast<int16_t>(next());
+        v.z  = static_cast<int16_t>(next());
+        v.nz = static_cast<uint8_t>(next());
+        v.na = static_cast<uint8_t>(next());
+        surf.frames.push_back(v);
+    }
+    for (uint32_t i = 0; i < num_vertices; ++i) {
+        surf.texcoords.push_back(texcoord{static_cast<float>(i), -static_cast<float>(i)});
+    }
+    return surf;
+}
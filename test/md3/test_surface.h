@@ -0,0 +1,9 @@
+#ifndef SKIRMISH_TEST_SURFACE_H
+#define SKIRMISH_TEST_SURFACE_H
+
+#include <skirmish/md3/md3.h>
+
+// A surface with pseudo-random vertices (the same for every call with the same sizes)
+skirmish::md3::surface_with_data make_surface(uint32_t num_vertices, uint32_t num_frames);
+
+#endif
@@ -0,0 +1,106 @@
+#include <skirmish/md3/tags.h>
+#include <skirmish/math/constants.h>
+#include "catch.hpp"
+#include <cmath>
+#include <cstring>
+
+using namespace skirmish;
+using namespace skirmish::md3;
+
+namespace {
+
+// Tag t of frame f has its origin at (f, t, 1) and is rotated (f + t) * 0.5 radians about z
+file make_file(uint32_t num_tags, uint32_t num_frames)
+{
+    file f{};
+    f.hdr.num_tags   = num_tags;
+    f.hdr.num_frames = num_frames;
+    for (uint32_t frame = 0; frame < num_frames; ++frame) {
+        for (uint32_t t = 0; t < num_tags; ++t) {
+            tag tg{};
+            std::strcpy(tg.name, t ? "tag_head" : "tag_torso");
+            const auto angle = (frame + t) * 0.5f;
+            tg.origin = vec3{static_cast<float>(frame), static_cast<float>(t), 1.0f};
+            tg.x_axis = vec3{std::cos(angle), std::sin(angle), 0};
+            tg.y_axis = vec3{-std::sin(angle), std::cos(angle), 0};
+            tg.z_axis = vec3{0, 0, 1};
+            f.tags.push_back(tg);
+        }
+    }
+    return f;
+}
+
+model_quat rotation_z(float angle)
+{
+    return model_quat{0, 0, std::sin(angle / 2), std::cos(angle / 2)};
+}
+
+// q and -q represent the same rotation
+bool same_rotation(const model_quat& a, const model_quat& b)
+{
+    return std::fabs(std::fabs(dot(a, b)) - 1.0f) < 1e-5f;
+}
+
+const interpolate_tags_implementation all_implementations[] = { interpolate_tags_implementation::scalar, interpolate_tags_implementation::sse };
+
+} // unnamed namespace
+
+TEST_CASE("tag_table") {
+    const tag_table tags{make_file(2, 3), 0.5f};
+    REQUIRE(tags.num_tags() == 2);
+    REQUIRE(tags.num_frames() == 3);
+    REQUIRE(tags.name(0) == "tag_torso");
+    REQUIRE(tags.name(1) == "tag_head");
+    REQUIRE(tags.index("tag_torso") == 0);
+    REQUIRE(tags.index("tag_head") == 1);
+    REQUIRE_THROWS_WITH(tags.index("tag_weapon"), "Tag tag_weapon not found");
+
+    for (uint32_t t = 0; t < 2; ++t) {
+        for (uint32_t frame = 0; frame < 3; ++frame) {
+            const auto& tf = tags.frame(t, frame);
+            REQUIRE(&tf == tags.frames(t) + frame);
+            REQUIRE(tf.origin.x == 0.5f * frame);
+            REQUIRE(tf.origin.y == 0.5f * t);
+            REQUIRE(tf.origin.z == 0.5f);
+            REQUIRE(same_rotation(tf.rotation, rotation_z((frame + t) * 0.5f)));
+        }
+    }
+}
+
+TEST_CASE("tag_table invalid tag count") {
+    auto f = make_file(2, 3);
+    f.tags.pop_back();
+    REQUIRE_THROWS_WITH(tag_table{f}, "Invalid number of tags in md3 file");
+}
+
+TEST_CASE("interpolate_tags implementations agree") {
+    const tag_table tags{make_file(2, 8)};
+
+    // Enough samples to exercise both the 4-wide loop and the remainder, including a pair of
+    // frames whose quaternions have opposite signs
+    std::vector<tag_sample> samples;
+    for (uint32_t i = 0; i < 11; ++i) {
+        samples.push_back(tags.sample(i % 2, i % 8, (i * 3 + 1) % 8, i / 10.0f));
+    }
+    tag_frame flipped = tags.frame(0, 1);
+    flipped.rotation = model_quat{-flipped.rotation.x, -flipped.rotation.y, -flipped.rotation.z, -flipped.rotation.w};
+    samples.push_back(tag_sample{&tags.frame(0, 0), &flipped, 0.5f});
+
+    for (const auto impl : all_implementations) {
+        if (!interpolate_tags_supported(impl)) continue;
+        INFO("Implementation " << static_cast<int>(impl));
+        std::vector<tag_frame> out(samples.size());
+        interpolate_tags(impl, samples.data(), samples.size(), out.data());
+        for (size_t i = 0; i < samples.size(); ++i) {
+            INFO("Sample " << i);
+            const auto& s = samples[i];
+            REQUIRE(dot(out[i].rotation, out[i].rotation) == Approx(1));
+            REQUIRE(same_rotation(out[i].rotation, nlerp(s.a->rotation, s.b->rotation, s.t)));
+            REQUIRE(out[i].origin.x == Approx(s.a->origin.x + (s.b->origin.x - s.a->origin.x) * s.t));
+            REQUIRE(out[i].origin.y == Approx(s.a->origin.y + (s.b->origin.y - s.a->origin.y) * s.t));
+            REQUIRE(out[i].origin.z == Approx(s.a->origin.z + (s.b->origin.z - s.a->origin.z) * s.t));
+        }
+        // Halfway between 0 and 0.5 radians regardless of the sign of the second quaternion
+        REQUIRE(same_rotation(out.back().rotation, rotation_z(0.25f)));
+    }
+}
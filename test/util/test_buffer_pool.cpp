@@ -0,0 +1,63 @@
+#include <skirmish/util/buffer_pool.h>
+#include "catch.hpp"
+#include <memory>
+#include <vector>
+
+using namespace skirmish::util;
+
+TEST_CASE("buffer pool") {
+    buffer_pool pool{2};
+    const uint8_t* first_data;
+    {
+        auto b = pool.acquire(100);
+        REQUIRE(b.size() == 100);
+        REQUIRE(b.data() != nullptr);
+        first_data = b.data();
+    }
+    REQUIRE(pool.stats().allocations == 1);
+    REQUIRE(pool.stats().reuses == 0);
+
+    // Released buffers are handed out again for the same size
+    {
+        auto b = pool.acquire(100);
+        REQUIRE(b.data() == first_data);
+        auto other_size = pool.acquire(200);
+        REQUIRE(other_size.data() != first_data);
+    }
+    REQUIRE(pool.stats().allocations == 2);
+    REQUIRE(pool.stats().reuses == 1);
+
+    // At most 2 free buffers per size are kept
+    {
+        std::vector<buffer_pool::buffer> buffers;
+        for (int i = 0; i < 4; ++i) {
+            buffers.push_back(pool.acquire(100));
+        }
+        REQUIRE(pool.stats().allocations == 5);
+    }
+    {
+        std::vector<buffer_pool::buffer> buffers;
+        for (int i = 0; i < 4; ++i) {
+            buffers.push_back(pool.acquire(100));
+        }
+        REQUIRE(pool.stats().allocations == 7);
+        REQUIRE(pool.stats().reuses == 4);
+    }
+
+    // Moving transfers ownership
+    auto a = pool.acquire(10);
+    const auto data = a.data();
+    buffer_pool::buffer b{std::move(a)};
+    REQUIRE(b.data() == data);
+    REQUIRE(a.data() == nullptr);
+    REQUIRE(a.size() == 0);
+    a = std::move(b);
+    REQUIRE(a.data() == data);
+}
+
+TEST_CASE("buffer pool can be destroyed before its buffers") {
+    auto pool = std::make_unique<buffer_pool>();
+    auto b = pool->acquire(42);
+    pool.reset();
+    b.data()[41] = 1;
+}
@@ -0,0 +1,50 @@
+#include <skirmish/util/crc32.h>
+#include "catch.hpp"
+#include <vector>
+#include <string>
+
+using namespace skirmish::util;
+
+namespace {
+
+const crc32_implementation all_implementations[] = { crc32_implementation::table, crc32_implementation::slicing_by_8, crc32_implementation::pclmul };
+
+} // unnamed namespace
+
+TEST_CASE("crc32 check values") {
+    const std::string check = "123456789";
+    REQUIRE(crc32(0, nullptr, 0) == 0);
+    REQUIRE(crc32(0, check.data(), check.size()) == 0xCBF43926);
+    for (const auto impl : all_implementations) {
+        if (!crc32_supported(impl)) continue;
+        INFO("Implementation " << static_cast<int>(impl));
+        REQUIRE(crc32(impl, 0, check.data(), check.size()) == 0xCBF43926);
+        const std::string fox = "The quick brown fox jumps over the lazy dog";
+        REQUIRE(crc32(impl, 0, fox.data(), fox.size()) == 0x414FA339);
+    }
+}
+
+TEST_CASE("crc32 implementations agree") {
+    std::vector<uint8_t> data(4096 + 64);
+    uint32_t x = 1;
+    for (auto& b : data) {
+        x = x * 1103515245 + 12345;
+        b = static_cast<uint8_t>(x >> 16);
+    }
+
+    // All lengths around the block sizes of the faster implementations and odd alignments
+    for (size_t offset = 0; offset < 16; offset += 3) {
+        for (size_t size : { 0, 1, 7, 8, 15, 16, 63, 64, 65, 79, 80, 127, 128, 129, 1000, 4096 }) {
+            const auto expected = crc32(crc32_implementation::table, 0, data.data() + offset, size);
+            for (const auto impl : all_implementations) {
+                if (!crc32_supported(impl)) continue;
+                INFO("Implementation " << static_cast<int>(impl) << " offset " << offset << " size " << size);
+                REQUIRE(crc32(impl, 0, data.data() + offset, size) == expected);
+                // Updating in two pieces gives the same result
+                const auto half = size / 2;
+                REQUIRE(crc32(impl, crc32(impl, 0, data.data() + offset, half), data.data() + offset + half, size - half) == expected);
+            }
+            REQUIRE(crc32(0, data.data() + offset, size) == expected);
+        }
+    }
+}
@@ -1,5 +1,8 @@
 #include <skirmish/util/deflate_stream.h>
+#include <skirmish/util/thread_pool.h>
 #include "catch.hpp"
+#include <vector>
+#include <algorithm>
 
 using namespace skirmish::util;
 
@@ -21,4 +24,230 @@ TEST_CASE("deflate test2") {
     uncompressed_stream.read(output, sizeof(output));
     REQUIRE(std::string(output, output+sizeof(output)) == "Line 1\nLine 2\n");
     REQUIRE(uncompressed_stream.crc32() == 0x87E4F545);
-}
\ No newline at end of file
+}
+
+namespace {
+
+uint32_t crc32_bitwise(const std::vector<uint8_t>& data)
+{
+    uint32_t crc = 0xffffffff;
+    for (auto c : data) {
+        crc ^= c;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+class bit_writer {
+public:
+    void put_bits(uint32_t value, int count) {
+        for (int i = 0; i < count; ++i) {
+            if (!bit_pos_) data_.push_back(0);
+            data_.back() |= ((value >> i) & 1) << bit_pos_;
+            bit_pos_ = (bit_pos_ + 1) & 7;
+        }
+    }
+
+    // Huffman codes are stored starting with the most significant bit
+    void put_code(uint32_t code, int count) {
+        for (int i = count - 1; i >= 0; --i) {
+            put_bits((code >> i) & 1, 1);
+        }
+    }
+
+    void align() {
+        bit_pos_ = 0;
+    }
+
+    std::vector<uint8_t>& data() { return data_; }
+
+private:
+    std::vector<uint8_t> data_;
+    int                  bit_pos_ = 0;
+};
+
+// Compresses data into a raw deflate stream alternating between literal-only fixed Huffman blocks
+// (which leave the next block starting in the middle of a byte) and stored blocks
+std::vector<uint8_t> make_deflate_blocks(const std::vector<uint8_t>& data, size_t block_size)
+{
+    bit_writer out;
+    for (size_t pos = 0, block = 0; pos < data.size(); pos += block_size, ++block) {
+        const auto size  = std::min(block_size, data.size() - pos);
+        const auto final = pos + size == data.size() ? 1 : 0;
+        if (block & 1) {
+            out.put_bits(final, 1);
+            out.put_bits(0, 2);
+            out.align();
+            out.put_bits(static_cast<uint32_t>(size), 16);
+            out.put_bits(static_cast<uint32_t>(~size & 0xffff), 16);
+            out.data().insert(out.data().end(), data.begin() + pos, data.begin() + pos + size);
+        } else {
+            out.put_bits(final, 1);
+            out.put_bits(1, 2);
+            for (size_t i = 0; i < size; ++i) {
+                const uint32_t c = data[pos + i];
+                if (c < 144) {
+                    out.put_code(0x30 + c, 8);
+                } else {
+                    out.put_code(0x190 + c - 144, 9);
+                }
+            }
+            out.put_code(0, 7); // End of block
+        }
+    }
+    return out.data();
+}
+
+} // unnamed namespace
+
+TEST_CASE("deflate seeking") {
+    std::vector<uint8_t> data(200000);
+    uint32_t x = 1;
+    for (auto& d : data) {
+        x = x * 1103515245 + 12345;
+        d = static_cast<uint8_t>(x >> 16);
+    }
+    const auto compressed = make_deflate_blocks(data, 7000);
+
+    in_mem_stream compressed_stream{compressed.data(), compressed.size()};
+    in_deflate_stream uncompressed_stream{compressed_stream, compressed.size(), data.size(), 16384};
+    REQUIRE(uncompressed_stream.stream_size() == data.size());
+    REQUIRE(uncompressed_stream.tell() == 0);
+
+    std::vector<uint8_t> output(data.size());
+    uncompressed_stream.read(output.data(), output.size());
+    REQUIRE(uncompressed_stream.error() == std::error_code());
+    REQUIRE(output == data);
+    REQUIRE(uncompressed_stream.tell() == data.size());
+    REQUIRE(uncompressed_stream.crc32() == crc32_bitwise(data));
+
+    // Backward seeks restart from the closest checkpoint
+    for (const uint64_t pos : { 150000, 3, 100001, 0, 199999, 42000, 65536 }) {
+        uncompressed_stream.seek(pos, seekdir::beg);
+        REQUIRE(uncompressed_stream.tell() == pos);
+        const auto count = std::min(static_cast<size_t>(20000), static_cast<size_t>(data.size() - pos));
+        std::vector<uint8_t> part(count);
+        uncompressed_stream.read(part.data(), part.size());
+        REQUIRE(uncompressed_stream.error() == std::error_code());
+        REQUIRE(std::equal(part.begin(), part.end(), data.begin() + static_cast<size_t>(pos)));
+    }
+
+    uncompressed_stream.seek(-10, seekdir::end);
+    REQUIRE(uncompressed_stream.get() == data[data.size() - 10]);
+    uncompressed_stream.seek(-1000, seekdir::cur);
+    REQUIRE(uncompressed_stream.tell() == data.size() - 1009);
+    REQUIRE(uncompressed_stream.get() == data[data.size() - 1009]);
+    REQUIRE(uncompressed_stream.crc32() == crc32_bitwise(data));
+}
+
+namespace {
+
+// Text-like data with plenty of repetition (also across chunk boundaries)
+std::vector<uint8_t> make_compressible_data(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    uint32_t x = 1;
+    for (size_t i = 0; i < size; ++i) {
+        x = x * 1103515245 + 12345;
+        data[i] = i >= 1000 && (x >> 16) % 4 ? data[i - 1000 + (x >> 24) % 8] : static_cast<uint8_t>('a' + (x >> 16) % 26);
+    }
+    return data;
+}
+
+void check_round_trip(const std::vector<uint8_t>& data, const std::vector<uint8_t>& compressed, const out_deflate_stream& deflater)
+{
+    REQUIRE(deflater.error() == std::error_code());
+    REQUIRE(deflater.uncompressed_size() == data.size());
+    REQUIRE(deflater.compressed_size() == compressed.size());
+    REQUIRE(deflater.crc32() == crc32_bitwise(data));
+    REQUIRE(compressed.size() < data.size() * 3 / 4);
+
+    in_mem_stream compressed_stream{compressed.data(), compressed.size()};
+    in_deflate_stream uncompressed_stream{compressed_stream, compressed.size(), data.size()};
+    std::vector<uint8_t> output(data.size());
+    uncompressed_stream.read(output.data(), output.size());
+    REQUIRE(uncompressed_stream.error() == std::error_code());
+    REQUIRE(output == data);
+    REQUIRE(uncompressed_stream.crc32() == deflater.crc32());
+}
+
+} // unnamed namespace
+
+TEST_CASE("deflate compression") {
+    const auto data = make_compressible_data(300000);
+
+    out_vector_stream compressed_stream;
+    out_deflate_stream deflater{compressed_stream};
+    // Mix small and large writes
+    deflater.write(data.data(), 10);
+    deflater.put(data[10]);
+    deflater.write(data.data() + 11, data.size() - 11);
+    REQUIRE(deflater.tell() == data.size());
+    deflater.finish();
+    deflater.flush();
+    REQUIRE(deflater.error() == std::error_code());
+    check_round_trip(data, compressed_stream.release(), deflater);
+
+    // Writing after finishing fails
+    deflater.put(0);
+    deflater.flush();
+    REQUIRE(deflater.error() != std::error_code());
+}
+
+TEST_CASE("deflate compression empty") {
+    out_vector_stream compressed_stream;
+    out_deflate_stream deflater{compressed_stream, 9, deflate_strategy::huffman_only};
+    deflater.finish();
+    REQUIRE(deflater.error() == std::error_code());
+    REQUIRE(deflater.uncompressed_size() == 0);
+    REQUIRE(deflater.crc32() == 0);
+    const auto compressed = compressed_stream.release();
+    REQUIRE(compressed.size() == deflater.compressed_size());
+    REQUIRE(!compressed.empty());
+}
+
+TEST_CASE("parallel deflate compression") {
+    const auto data = make_compressible_data(300000);
+    thread_pool pool{4};
+
+    for (const size_t chunk_size : { 4096, 65536, 1 << 20 }) {
+        out_vector_stream compressed_stream;
+        out_deflate_stream deflater{compressed_stream, pool, out_deflate_stream::default_level, deflate_strategy::default_strategy, chunk_size};
+        for (size_t pos = 0; pos < data.size(); pos += 5000) {
+            deflater.write(data.data() + pos, std::min(static_cast<size_t>(5000), data.size() - pos));
+        }
+        deflater.finish();
+        check_round_trip(data, compressed_stream.release(), deflater);
+    }
+}
+
+TEST_CASE("parallel deflate compression with small chunks") {
+    // Random data repeating every 20000 bytes only compresses if matches reach further back than one chunk
+    std::vector<uint8_t> block(20000);
+    uint32_t x = 1;
+    for (auto& b : block) {
+        x = x * 1103515245 + 12345;
+        b = static_cast<uint8_t>(x >> 16);
+    }
+    std::vector<uint8_t> data;
+    for (int i = 0; i < 10; ++i) {
+        data.insert(data.end(), block.begin(), block.end());
+    }
+
+    out_vector_stream serial_stream;
+    out_deflate_stream serial{serial_stream};
+    serial.write(data.data(), data.size());
+    serial.finish();
+    REQUIRE(serial.error() == std::error_code());
+
+    thread_pool pool{4};
+    out_vector_stream compressed_stream;
+    out_deflate_stream deflater{compressed_stream, pool, out_deflate_stream::default_level, deflate_strategy::default_strategy, 4096};
+    deflater.write(data.data(), data.size());
+    deflater.finish();
+    REQUIRE(deflater.compressed_size() < serial.compressed_size() * 3 / 2);
+    check_round_trip(data, compressed_stream.release(), deflater);
+}
+
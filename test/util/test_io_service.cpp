@@ -0,0 +1,121 @@
+#include <skirmish/util/io_service.h>
+#include <skirmish/util/file_system.h>
+#include <skirmish/util/file_stream.h>
+#include "catch.hpp"
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+using namespace skirmish::util;
+
+namespace {
+
+std::string read_file(const path& filename)
+{
+    in_file_stream in{filename};
+    std::string contents(static_cast<size_t>(in.stream_size()), '\0');
+    in.read(&contents[0], contents.size());
+    REQUIRE(in.error() == std::error_code());
+    return contents;
+}
+
+struct read_result {
+    int             calls = 0;
+    std::error_code error;
+    std::string     data;
+};
+
+std::vector<read_result> read_batch(io_service& io, const std::vector<read_request>& requests)
+{
+    std::vector<read_result> results(requests.size());
+    io.read(requests, [&](size_t index, const std::error_code& error, array_view<uint8_t> data) {
+        auto& r = results.at(index);
+        ++r.calls;
+        r.error = error;
+        r.data.assign(data.begin(), data.end());
+    });
+    return results;
+}
+
+std::vector<io_backend> available_backends()
+{
+    std::vector<io_backend> backends{io_backend::thread_pool};
+    if (io_service{}.backend() == io_backend::io_uring) {
+        backends.push_back(io_backend::io_uring);
+    }
+    return backends;
+}
+
+} // unnamed namespace
+
+TEST_CASE("io_service") {
+    const auto zip_filename = std::string{TEST_DATA_DIR} + "/test_data.zip";
+    const auto txt_filename = std::string{TEST_DATA_DIR} + "/test.txt";
+    const auto zip_contents = read_file(zip_filename);
+    const auto txt_contents = read_file(txt_filename);
+    REQUIRE(zip_contents.size() > 100);
+
+    for (const auto backend : available_backends()) {
+        io_service io{backend, 2};
+        REQUIRE(io.backend() == backend);
+
+        std::vector<read_request> requests;
+        requests.push_back({txt_filename, 0, invalid_stream_size});
+        requests.push_back({txt_filename, 7, 6});
+        requests.push_back({zip_filename, 0, zip_contents.size()});
+        requests.push_back({zip_filename, 10, 0});
+        requests.push_back({zip_filename, zip_contents.size(), invalid_stream_size});
+        requests.push_back({zip_filename, 1, zip_contents.size()});
+        requests.push_back({std::string{TEST_DATA_DIR} + "/does_not_exist.txt", 0, invalid_stream_size});
+        // More reads than fit in the submission queue at once
+        for (size_t i = 0; i < 500; ++i) {
+            requests.push_back({zip_filename, i % 100, 13});
+        }
+
+        const auto results = read_batch(io, requests);
+        for (const auto& r : results) {
+            REQUIRE(r.calls == 1);
+        }
+        REQUIRE(results[0].error == std::error_code());
+        REQUIRE(results[0].data == txt_contents);
+        REQUIRE(results[1].data == "Line 2");
+        REQUIRE(results[2].data == zip_contents);
+        REQUIRE(results[3].error == std::error_code());
+        REQUIRE(results[3].data.empty());
+        REQUIRE(results[4].error == std::error_code());
+        REQUIRE(results[4].data.empty());
+        REQUIRE(results[5].error == std::make_error_code(std::errc::broken_pipe));
+        REQUIRE(results[6].error == std::make_error_code(std::errc::no_such_file_or_directory));
+        for (size_t i = 0; i < 500; ++i) {
+            REQUIRE(results[7 + i].error == std::error_code());
+            REQUIRE(results[7 + i].data == zip_contents.substr(i % 100, 13));
+        }
+
+        // Exceptions from the handler are passed on once the batch is done, the other requests still get their call
+        size_t calls = 0;
+        REQUIRE_THROWS_WITH(io.read(requests, [&calls](size_t, const std::error_code&, array_view<uint8_t>) {
+            if (++calls % 3 == 0) throw std::runtime_error(calls == 3 ? "handler failed" : "later failure");
+        }), "handler failed");
+        REQUIRE(calls == requests.size());
+
+        // The service is still usable afterwards
+        REQUIRE(read_batch(io, {{txt_filename, 0, 4}})[0].data == "Line");
+
+        // Only regular files can be read
+        REQUIRE(read_batch(io, {{std::string{TEST_DATA_DIR}, 0, invalid_stream_size}})[0].error == std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+}
+
+TEST_CASE("native fs batch read") {
+    native_file_system fs{TEST_DATA_DIR};
+    std::vector<std::string> contents(2);
+    fs.read_batch({{"test.txt", 0, invalid_stream_size}, {"test.txt", 5, 1}}, [&](size_t index, const std::error_code& error, array_view<uint8_t> data) {
+        REQUIRE(!error);
+        // Completions can be parsed in place
+        in_mem_stream in{data};
+        contents[index].resize(data.size());
+        in.read(&contents[index][0], data.size());
+    });
+    REQUIRE(contents[0] == "Line 1\nLine 2\n");
+    REQUIRE(contents[1] == "1");
+}
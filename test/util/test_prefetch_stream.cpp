@@ -0,0 +1,102 @@
+#include <skirmish/util/prefetch_stream.h>
+#include <skirmish/util/deflate_stream.h>
+#include "catch.hpp"
+#include <vector>
+#include <algorithm>
+
+using namespace skirmish::util;
+
+namespace {
+
+std::vector<uint8_t> make_data(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    uint32_t x = 1;
+    for (size_t i = 0; i < size; ++i) {
+        x = x * 1103515245 + 12345;
+        data[i] = i % 3 ? static_cast<uint8_t>(x >> 16) : static_cast<uint8_t>(i);
+    }
+    return data;
+}
+
+} // unnamed namespace
+
+TEST_CASE("prefetch stream") {
+    const auto data = make_data(100000);
+    in_mem_stream inner{data.data(), data.size()};
+    in_prefetch_stream in{inner, 1000, 3};
+    REQUIRE(in.stream_size() == data.size());
+    REQUIRE(in.tell() == 0);
+
+    std::vector<uint8_t> output(data.size());
+    output[0] = in.get();
+    in.read(&output[1], 1234);
+    in.read(&output[1235], data.size() - 1235);
+    REQUIRE(in.error() == std::error_code());
+    REQUIRE(output == data);
+    REQUIRE(in.tell() == data.size());
+
+    // Seeking backwards, forwards within and beyond the data read ahead
+    for (const uint64_t pos : { 50000, 50500, 51700, 0, 99999, 20000, 60000, 100000 }) {
+        in.seek(pos, seekdir::beg);
+        REQUIRE(in.tell() == pos);
+        const auto count = std::min(static_cast<size_t>(700), static_cast<size_t>(data.size() - pos));
+        std::vector<uint8_t> part(count);
+        in.read(part.data(), part.size());
+        REQUIRE(in.error() == std::error_code());
+        REQUIRE(std::equal(part.begin(), part.end(), data.begin() + static_cast<size_t>(pos)));
+        REQUIRE(in.tell() == pos + count);
+    }
+    in.seek(-10, seekdir::end);
+    REQUIRE(in.get() == data[data.size() - 10]);
+    in.seek(-1, seekdir::cur);
+    REQUIRE(in.get() == data[data.size() - 10]);
+
+    // Reading past the end fails like the inner stream would
+    in.seek(0, seekdir::end);
+    in.get();
+    REQUIRE(in.error() == std::make_error_code(std::errc::broken_pipe));
+}
+
+TEST_CASE("prefetch stream starts at the position of the inner stream") {
+    const auto data = make_data(5000);
+    auto inner = std::make_unique<in_mem_stream>(data.data(), data.size());
+    inner->seek(100, seekdir::beg);
+    in_prefetch_stream in{std::move(inner), 64, 2};
+    REQUIRE(in.tell() == 100);
+    std::vector<uint8_t> output(data.size() - 100);
+    in.read(output.data(), output.size());
+    REQUIRE(in.error() == std::error_code());
+    REQUIRE(std::equal(output.begin(), output.end(), data.begin() + 100));
+}
+
+TEST_CASE("prefetch stream of a deflate stream") {
+    const auto data = make_data(300000);
+    out_vector_stream compressed_stream;
+    out_deflate_stream deflater{compressed_stream};
+    deflater.write(data.data(), data.size());
+    deflater.finish();
+    const auto compressed = compressed_stream.release();
+
+    in_mem_stream compressed_in{compressed.data(), compressed.size()};
+    in_prefetch_stream in{std::make_unique<in_deflate_stream>(compressed_in, compressed.size(), data.size())};
+    REQUIRE(in.stream_size() == data.size());
+    std::vector<uint8_t> output(data.size());
+    for (size_t pos = 0; pos < data.size(); pos += 4) {
+        const auto value = in.get_u32_le();
+        std::copy(reinterpret_cast<const uint8_t*>(&value), reinterpret_cast<const uint8_t*>(&value) + 4, &output[pos]);
+    }
+    REQUIRE(in.error() == std::error_code());
+#if !SKIRMISH_BIG_ENDIAN
+    REQUIRE(output == data);
+#endif
+    in.seek(12345, seekdir::beg);
+    REQUIRE(in.get() == data[12345]);
+}
+
+TEST_CASE("prefetch stream of a failed stream") {
+    in_mem_stream inner{nullptr, 0};
+    in_prefetch_stream in{inner};
+    in.get();
+    REQUIRE(in.error() == std::make_error_code(std::errc::broken_pipe));
+}
@@ -1,8 +1,10 @@
 #include <skirmish/util/stream.h>
 #include <skirmish/util/file_stream.h>
+#include <skirmish/util/stream_reader.h>
 #include "catch.hpp"
 #include <vector>
 #include <iterator>
+#include <cstdio>
 
 using namespace skirmish::util;
 using bytevec = std::vector<std::uint8_t>;
@@ -123,4 +125,197 @@ TEST_CASE("little endian") {
 
     const uint8_t float_val[] = { 0x00, 0x00, 0x10, 0xC0 };
     REQUIRE(in_mem_stream(float_val).get_float_le() == -2.25f);
-}
\ No newline at end of file
+}
+
+TEST_CASE("read_array_le") {
+    const uint8_t data[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x00, 0x00, 0x10, 0xC0, 0xff };
+    in_mem_stream in{data};
+    uint16_t u16s[2];
+    in.read_array_le(u16s, 2);
+    REQUIRE(u16s[0] == 0x0201);
+    REQUIRE(u16s[1] == 0x0403);
+    uint32_t u32;
+    in.read_array_le(&u32, 1);
+    REQUIRE(u32 == 0x08070605);
+    float f;
+    in.read_array_le(&f, 1);
+    REQUIRE(f == -2.25f);
+    REQUIRE(in.tell() == 12);
+    REQUIRE(in.error() == std::error_code());
+
+    // Reading past the end fails
+    int16_t i16s[2];
+    in.read_array_le(i16s, 2);
+    REQUIRE(in.error() != std::error_code());
+}
+
+TEST_CASE("input mmap stream") {
+    in_mmap_stream invalid_file_name{"this_file_does_not_exist"};
+    REQUIRE(invalid_file_name.error() != std::error_code());
+
+    const auto fname = (std::string{TEST_DATA_DIR} + "/" + "test.txt");
+    const uint64_t expected_file_size = 14;
+    in_mmap_stream test_txt{fname.c_str()};
+    REQUIRE(test_txt.error() == std::error_code());
+    REQUIRE(test_txt.stream_size() == expected_file_size);
+    // The whole file is available up front
+    REQUIRE(test_txt.peek().size() == expected_file_size);
+    REQUIRE(std::string(test_txt.peek().begin(), test_txt.peek().end()) == "Line 1\nLine 2\n");
+    REQUIRE(test_txt.tell() == 0);
+    REQUIRE(test_txt.get() == 'L');
+    REQUIRE(test_txt.tell() == 1);
+    test_txt.seek(5, seekdir::beg);
+    REQUIRE(test_txt.tell() == 5);
+    REQUIRE(test_txt.get() == '1');
+    REQUIRE(test_txt.peek().size() == expected_file_size - 6);
+    test_txt.seek(-2, seekdir::end);
+    REQUIRE(test_txt.get() == '2');
+    test_txt.seek(-6, seekdir::cur);
+    char buffer[6];
+    test_txt.read(buffer, sizeof(buffer));
+    REQUIRE(std::string(buffer, buffer+sizeof(buffer)) == "Line 2");
+    REQUIRE(test_txt.get() == '\n');
+    REQUIRE(test_txt.tell() == expected_file_size);
+    REQUIRE(test_txt.error() == std::error_code());
+    REQUIRE(test_txt.get() == 0);
+    REQUIRE(test_txt.error() != std::error_code());
+}
+
+TEST_CASE("output memory stream") {
+    uint8_t buffer[8];
+    out_mem_stream out{buffer, sizeof(buffer)};
+    REQUIRE(out.tell() == 0);
+    REQUIRE(out.space_available() == sizeof(buffer));
+    out.put(0x42);
+    out.put_u16_le(0x1234);
+    REQUIRE(out.tell() == 3);
+    out.flush();
+    REQUIRE(out.tell() == 3);
+    out.put_u32_le(0xdeadbeef);
+    out.put(1);
+    REQUIRE(out.error() == std::error_code());
+    REQUIRE(out.space_available() == 0);
+    REQUIRE((bytevec(out.data().begin(), out.data().end())) == (bytevec{0x42, 0x34, 0x12, 0xef, 0xbe, 0xad, 0xde, 0x01}));
+    out.flush();
+    REQUIRE(out.error() == std::error_code());
+
+    // Writing past the end fails
+    out.put(2);
+    REQUIRE(out.error() != std::error_code());
+    REQUIRE(buffer[7] == 0x01);
+}
+
+TEST_CASE("output vector stream") {
+    out_vector_stream out{1};
+    bytevec expected;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        out.put_u32_le((i & 0xff) * 0x01010101);
+        for (int j = 0; j < 4; ++j) expected.push_back(static_cast<uint8_t>(i));
+    }
+    const float floats[] = { -2.25f, 1.0f };
+    out.write_array_le(floats, 2);
+    for (auto b : { 0x00, 0x00, 0x10, 0xC0, 0x00, 0x00, 0x80, 0x3F }) expected.push_back(static_cast<uint8_t>(b));
+    const uint16_t u16s[] = { 0x0102, 0x0304 };
+    out.write_array_le(u16s, 2);
+    for (auto b : { 0x02, 0x01, 0x04, 0x03 }) expected.push_back(static_cast<uint8_t>(b));
+
+    REQUIRE(out.error() == std::error_code());
+    REQUIRE(out.tell() == expected.size());
+    REQUIRE((bytevec(out.data().begin(), out.data().end())) == expected);
+
+    REQUIRE(out.release() == expected);
+    REQUIRE(out.tell() == 0);
+    out.write("abc", 3);
+    REQUIRE(out.release() == (bytevec{'a', 'b', 'c'}));
+}
+
+TEST_CASE("output file stream") {
+    const auto filename = temp_directory_path() / "skirmish_test_out_file_stream.bin";
+    bytevec expected;
+    {
+        out_file_stream out{filename};
+        REQUIRE(out.error() == std::error_code());
+        for (int i = 0; i < 100000; ++i) {
+            out.put(static_cast<uint8_t>(i * 7));
+            expected.push_back(static_cast<uint8_t>(i * 7));
+        }
+        REQUIRE(out.tell() == expected.size());
+
+        // An explicit flush makes everything written so far visible in the file
+        out.flush();
+        REQUIRE(out.error() == std::error_code());
+        REQUIRE(in_file_stream{filename}.stream_size() == expected.size());
+
+        out.put(0x42);
+        expected.push_back(0x42);
+    }
+    {
+        in_file_stream in{filename};
+        REQUIRE(in.stream_size() == expected.size());
+        bytevec contents(expected.size());
+        in.read(contents.data(), contents.size());
+        REQUIRE(in.error() == std::error_code());
+        REQUIRE(contents == expected);
+    }
+    std::remove(filename.string().c_str());
+
+    out_file_stream invalid{"this_directory_does_not_exist/file.bin"};
+    REQUIRE(invalid.error() != std::error_code());
+}
+
+TEST_CASE("stream reader") {
+    const uint8_t data[] = { 0xbe, 0x0a, 0xde, 0xfe, 0x01, 0x02, 0x00, 0x00, 0x10, 0xC0, 'a', 'b', '\n', 'c' };
+    in_mem_stream s{data};
+    {
+        stream_reader<in_mem_stream> r{s};
+        REQUIRE(r.get_u32_le() == 0xfede0abe);
+        REQUIRE(r.get() == 0x01);
+        REQUIRE(r.tell() == 5);
+        REQUIRE(r.get() == 0x02);
+        REQUIRE(r.get_float_le() == -2.25f);
+        std::string str;
+        REQUIRE(r.read_until('\n', str));
+        REQUIRE(str == "ab");
+        REQUIRE(!r.at_end());
+        r.skip(1);
+        REQUIRE(r.at_end());
+        REQUIRE(r.error() == std::error_code());
+        r.seek(4, seekdir::beg);
+        REQUIRE(r.get_u16_le() == 0x0201);
+    }
+    // The position is handed back to the stream
+    REQUIRE(s.tell() == 6);
+    REQUIRE(s.get() == 0x00);
+
+    {
+        stream_reader<> r{s};
+        r.skip(7);
+        REQUIRE(r.error() == std::error_code());
+        REQUIRE(r.get() == 0);
+        REQUIRE(r.error() != std::error_code());
+    }
+}
+
+TEST_CASE("stream reader across buffer boundaries") {
+    const auto fname = (std::string{TEST_DATA_DIR} + "/" + "test.txt");
+    in_file_stream test_txt{fname.c_str(), 3};
+    REQUIRE(test_txt.error() == std::error_code());
+    stream_reader<in_file_stream> r{test_txt};
+    REQUIRE(r.get_u32_le() == load_u32_le(reinterpret_cast<const uint8_t*>("Line")));
+    std::string str;
+    REQUIRE(r.read_until('\n', str));
+    REQUIRE(str == " 1");
+    char buffer[5];
+    r.read(buffer, sizeof(buffer));
+    REQUIRE(std::string(buffer, buffer+sizeof(buffer)) == "Line ");
+    REQUIRE(r.tell() == 12);
+    REQUIRE(!r.at_end());
+    str.clear();
+    REQUIRE(r.read_until('\n', str));
+    REQUIRE(str == "2");
+    REQUIRE(r.at_end());
+    str.clear();
+    REQUIRE(!r.read_until('\n', str));
+    REQUIRE(str.empty());
+    REQUIRE(r.error() != std::error_code());
+}
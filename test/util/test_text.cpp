@@ -1,5 +1,7 @@
 #include <skirmish/util/text.h>
 #include <skirmish/util/stream.h>
+#include <skirmish/util/stream_reader.h>
+#include <skirmish/util/file_stream.h>
 #include "catch.hpp"
 
 using namespace skirmish::util;
@@ -11,6 +13,7 @@ TEST_CASE("trim") {
     REQUIRE(trim("  \n\r\tbl ah \tblah") == "bl ah \tblah");
     REQUIRE(trim("bl ah \tblah  \n\t") == "bl ah \tblah");
     REQUIRE(trim("    bl ah \tblah  \n\t") == "bl ah \tblah");
+    REQUIRE(trim(" a ") == "a");
 }
 
 TEST_CASE("read_line") {
@@ -37,4 +40,146 @@ TEST_CASE("read_line") {
     REQUIRE(!read_line(s, line));   
     REQUIRE(line == "");
     REQUIRE(s.error() != std::error_code());
-}
\ No newline at end of file
+}
+
+TEST_CASE("read_line with stream reader") {
+    const char data[] = "Line One\nLine Two\r\n\n123";
+    in_mem_stream s{make_array_view(data, data+sizeof(data)-1)};
+    stream_reader<in_mem_stream> r{s};
+
+    std::string line;
+    REQUIRE(read_line(r, line));
+    REQUIRE(line == "Line One");
+    REQUIRE(read_line(r, line));
+    REQUIRE(line == "Line Two\r");
+    REQUIRE(read_line(r, line));
+    REQUIRE(line == "");
+    REQUIRE(!r.at_end());
+    REQUIRE(!read_line(r, line));
+    REQUIRE(line == "123");
+    REQUIRE(r.error() != std::error_code());
+}
+
+template<typename T>
+bool parse_whole(const std::string& s, T& value)
+{
+    const auto next = parse_number(s.data(), s.data() + s.size(), value);
+    return next != s.data() && next == s.data() + s.size();
+}
+
+TEST_CASE("parse_number") {
+    float f = 42;
+    REQUIRE(parse_whole("0", f));
+    REQUIRE(f == 0.0f);
+    REQUIRE(parse_whole("-2.25", f));
+    REQUIRE(f == -2.25f);
+    REQUIRE(parse_whole("+.5", f));
+    REQUIRE(f == 0.5f);
+    REQUIRE(parse_whole("3.", f));
+    REQUIRE(f == 3.0f);
+    REQUIRE(parse_whole("1.25e-3", f));
+    REQUIRE(f == 1.25e-3f);
+    REQUIRE(parse_whole("0.1", f));
+    REQUIRE(f == 0.1f);
+    REQUIRE(parse_whole("-0.0168008", f));
+    REQUIRE(f == -0.0168008f);
+    REQUIRE(parse_whole("1E10", f));
+    REQUIRE(f == 1e10f);
+    REQUIRE(parse_whole("3.14159265358979323846264338327950288", f));
+    REQUIRE(f == 3.14159265358979323846264338327950288f);
+    REQUIRE(parse_whole("1e-40", f));
+    REQUIRE(f == 1e-40f);
+    // Rounded to the nearest float directly, not via the nearest double (which is exactly halfway between two floats)
+    REQUIRE(parse_whole("1.440179914879991e-06", f));
+    REQUIRE(f == 1.440179914879991e-06f);
+    REQUIRE(parse_whole("9.576912702868867e-07", f));
+    REQUIRE(f == 9.576912702868867e-07f);
+    REQUIRE(parse_whole("1.000000059604644776", f));
+    REQUIRE(f == 1.000000059604644776f);
+
+    // Parsing stops after the number
+    const std::string partial = "12.5e+1abc";
+    REQUIRE(parse_number(partial.data(), partial.data() + partial.size(), f) == partial.data() + 7);
+    REQUIRE(f == 125.0f);
+    const std::string no_exponent = "7e";
+    REQUIRE(parse_number(no_exponent.data(), no_exponent.data() + no_exponent.size(), f) == no_exponent.data() + 1);
+    REQUIRE(f == 7.0f);
+
+    // Failures leave the value alone
+    f = 42;
+    REQUIRE(!parse_whole("", f));
+    REQUIRE(!parse_whole("-", f));
+    REQUIRE(!parse_whole(".", f));
+    REQUIRE(!parse_whole(" 1", f));
+    REQUIRE(!parse_whole("1e39", f));
+    REQUIRE(f == 42);
+
+    uint32_t u32 = 42;
+    REQUIRE(parse_whole("4294967295", u32));
+    REQUIRE(u32 == 4294967295U);
+    REQUIRE(!parse_whole("4294967296", u32));
+    REQUIRE(!parse_whole("-1", u32));
+    REQUIRE(u32 == 4294967295U);
+    unsigned long long u64;
+    REQUIRE(parse_whole("+18446744073709551615", u64));
+    REQUIRE(u64 == 18446744073709551615ULL);
+    REQUIRE(!parse_whole("18446744073709551616", u64));
+}
+
+TEST_CASE("line_tokenizer") {
+    const char data[] = "v 1 -2.5\t3\r\n\n  f 1/2 # x\nlast";
+    in_mem_stream s{make_array_view(data, data+sizeof(data)-1)};
+    line_tokenizer<in_mem_stream> t{s};
+
+    REQUIRE(t.next_line());
+    REQUIRE(t.line_string() == "v 1 -2.5\t3\r");
+    auto tok = t.next_token();
+    REQUIRE(std::string(tok.begin(), tok.end()) == "v");
+    float x, y, z;
+    REQUIRE(t.next_number(x));
+    REQUIRE(t.next_number(y));
+    REQUIRE(t.next_number(z));
+    REQUIRE(x == 1.0f);
+    REQUIRE(y == -2.5f);
+    REQUIRE(z == 3.0f);
+    REQUIRE(!t.next_number(z));
+    REQUIRE(t.next_token().size() == 0);
+
+    REQUIRE(t.next_line());
+    REQUIRE(t.line().size() == 0);
+    REQUIRE(t.next_token().size() == 0);
+
+    REQUIRE(t.next_line());
+    tok = t.next_token();
+    REQUIRE(std::string(tok.begin(), tok.end()) == "f");
+    uint32_t a;
+    REQUIRE(t.next_number(a));
+    REQUIRE(a == 1);
+    REQUIRE(!t.next_number(a));
+    tok = t.next_token();
+    REQUIRE(std::string(tok.begin(), tok.end()) == "/2");
+    tok = t.next_token();
+    REQUIRE(std::string(tok.begin(), tok.end()) == "#");
+
+    // The last line doesn't need a terminator
+    REQUIRE(t.next_line());
+    REQUIRE(t.line_string() == "last");
+    REQUIRE(!t.next_line());
+    REQUIRE(t.error() == std::error_code());
+}
+
+TEST_CASE("line_tokenizer across buffer boundaries") {
+    const auto fname = (std::string{TEST_DATA_DIR} + "/" + "test.txt");
+    in_file_stream test_txt{fname.c_str(), 4};
+    line_tokenizer<in_file_stream> t{test_txt};
+    for (uint32_t expected = 1; expected <= 2; ++expected) {
+        REQUIRE(t.next_line());
+        auto tok = t.next_token();
+        REQUIRE(std::string(tok.begin(), tok.end()) == "Line");
+        uint32_t n;
+        REQUIRE(t.next_number(n));
+        REQUIRE(n == expected);
+    }
+    REQUIRE(!t.next_line());
+    REQUIRE(t.error() == std::error_code());
+}
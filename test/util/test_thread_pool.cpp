@@ -0,0 +1,40 @@
+#include <skirmish/util/thread_pool.h>
+#include "catch.hpp"
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace skirmish::util;
+
+TEST_CASE("thread pool") {
+    thread_pool pool{4};
+    REQUIRE(pool.thread_count() == 4);
+
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 100; ++i) {
+        results.push_back(pool.submit([i] { return i * i; }));
+    }
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE(results[i].get() == i * i);
+    }
+
+    auto failing = pool.submit([]() -> int { throw std::runtime_error("failed"); });
+    REQUIRE_THROWS(failing.get());
+}
+
+TEST_CASE("thread pool finishes queued work on destruction") {
+    std::atomic<int> count{0};
+    {
+        thread_pool pool{2};
+        for (int i = 0; i < 50; ++i) {
+            pool.submit([&count] { ++count; });
+        }
+    }
+    REQUIRE(count == 50);
+}
+
+TEST_CASE("thread pool default thread count") {
+    thread_pool pool;
+    REQUIRE(pool.thread_count() >= 1);
+    REQUIRE(pool.submit([] { return 42; }).get() == 42);
+}
@@ -2,13 +2,103 @@
 #include <skirmish/util/zip_internals.h>
 #include <skirmish/util/zip.h>
 #include <skirmish/util/file_stream.h>
+#include <skirmish/util/buffer_pool.h>
 #include "catch.hpp"
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <map>
 #include <cassert>
 
 using namespace skirmish::zip;
 using namespace skirmish::util;
 
+namespace {
+
+uint32_t crc32_bitwise(const std::string& data)
+{
+    uint32_t crc = 0xffffffff;
+    for (unsigned char c : data) {
+        crc ^= c;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// Builds a minimal zip archive with the files stored uncompressed. With zip64 set all sizes
+// and offsets are stored in the zip64 structures.
+std::vector<uint8_t> make_stored_zip(const std::vector<std::pair<std::string, std::string>>& files, bool zip64 = false)
+{
+    std::vector<uint8_t> zip, central_dir;
+    auto put_u16 = [](std::vector<uint8_t>& v, uint32_t x) { v.push_back(x & 0xff); v.push_back((x >> 8) & 0xff); };
+    auto put_u32 = [&](std::vector<uint8_t>& v, uint32_t x) { put_u16(v, x & 0xffff); put_u16(v, x >> 16); };
+    auto put_u64 = [&](std::vector<uint8_t>& v, uint64_t x) { put_u32(v, x & 0xffffffff); put_u32(v, x >> 32); };
+    auto put_str = [](std::vector<uint8_t>& v, const std::string& s) { v.insert(v.end(), s.begin(), s.end()); };
+    auto small   = [zip64](uint64_t x) { return zip64 ? zip64_marker_u32 : static_cast<uint32_t>(x); };
+    const uint32_t version = zip64 ? 45 : 10;
+
+    for (const auto& f : files) {
+        const uint64_t offset = zip.size();
+        const auto crc    = crc32_bitwise(f.second);
+        const uint64_t size = f.second.size();
+        const auto name_length = static_cast<uint32_t>(f.first.size());
+
+        put_u32(zip, local_file_header::signature_magic);
+        put_u16(zip, version); put_u16(zip, 0); put_u16(zip, 0); put_u16(zip, 0); put_u16(zip, 0);
+        put_u32(zip, crc); put_u32(zip, small(size)); put_u32(zip, small(size));
+        put_u16(zip, name_length); put_u16(zip, zip64 ? 20 : 0);
+        put_str(zip, f.first);
+        if (zip64) {
+            put_u16(zip, zip64_extra_field_id); put_u16(zip, 16); put_u64(zip, size); put_u64(zip, size);
+        }
+        put_str(zip, f.second);
+
+        put_u32(central_dir, central_directory_file_header::signature_magic);
+        put_u16(central_dir, version); put_u16(central_dir, version); put_u16(central_dir, 0); put_u16(central_dir, 0); put_u16(central_dir, 0); put_u16(central_dir, 0);
+        put_u32(central_dir, crc); put_u32(central_dir, small(size)); put_u32(central_dir, small(size));
+        put_u16(central_dir, name_length); put_u16(central_dir, zip64 ? 28 : 0); put_u16(central_dir, 0); put_u16(central_dir, 0); put_u16(central_dir, 0);
+        put_u32(central_dir, 0); put_u32(central_dir, small(offset));
+        put_str(central_dir, f.first);
+        if (zip64) {
+            put_u16(central_dir, zip64_extra_field_id); put_u16(central_dir, 24); put_u64(central_dir, size); put_u64(central_dir, size); put_u64(central_dir, offset);
+        }
+    }
+
+    const uint64_t central_dir_offset = zip.size();
+    zip.insert(zip.end(), central_dir.begin(), central_dir.end());
+    if (zip64) {
+        const uint64_t zip64_record_offset = zip.size();
+        put_u32(zip, zip64_end_of_central_directory_record::signature_magic);
+        put_u64(zip, zip64_end_of_central_directory_record::min_size_bytes - 12);
+        put_u16(zip, version); put_u16(zip, version); put_u32(zip, 0); put_u32(zip, 0);
+        put_u64(zip, files.size()); put_u64(zip, files.size());
+        put_u64(zip, central_dir.size()); put_u64(zip, central_dir_offset);
+        put_u32(zip, zip64_end_of_central_directory_locator::signature_magic);
+        put_u32(zip, 0); put_u64(zip, zip64_record_offset); put_u32(zip, 1);
+    }
+    put_u32(zip, end_of_central_directory_record::signature_magic);
+    put_u16(zip, 0); put_u16(zip, 0);
+    put_u16(zip, zip64 ? zip64_marker_u16 : static_cast<uint32_t>(files.size())); put_u16(zip, zip64 ? zip64_marker_u16 : static_cast<uint32_t>(files.size()));
+    put_u32(zip, small(central_dir.size())); put_u32(zip, small(central_dir_offset));
+    put_u16(zip, 0);
+    return zip;
+}
+
+// Stream that hides its memory so archives have to read through in_zip_range_stream
+class in_unmapped_stream : public in_mem_stream {
+public:
+    explicit in_unmapped_stream(array_view<uint8_t> data) : in_mem_stream(data) {}
+
+private:
+    virtual bool do_try_map(array_view<uint8_t>&) const override {
+        return false;
+    }
+};
+
+} // unnamed namespace
+
 TEST_CASE("empty.zip") {
     in_file_stream empty_zip{(std::string{TEST_DATA_DIR} + "/" + "empty.zip").c_str()};
     REQUIRE(empty_zip.stream_size() == end_of_central_directory_record::min_size_bytes);
@@ -116,6 +206,17 @@ TEST_CASE("test.zip") {
     REQUIRE(file_stream->tell() == 14);
     REQUIRE(file_stream->error() == std::error_code());
     REQUIRE(std::string(buffer, buffer+sizeof(buffer)) == "Line 1\nLine 2\n");
+
+    // Deflated files can be seeked backwards
+    file_stream->seek(-7, seekdir::end);
+    REQUIRE(file_stream->tell() == 7);
+    file_stream->read(buffer, 6);
+    REQUIRE(std::string(buffer, buffer+6) == "Line 2");
+    file_stream->seek(5, seekdir::beg);
+    REQUIRE(file_stream->get() == '1');
+    file_stream->seek(-6, seekdir::cur);
+    REQUIRE(file_stream->get() == 'L');
+    REQUIRE(file_stream->error() == std::error_code());
 }
 
 TEST_CASE("find_end_of_central_directory_record doesn't seek too far") {
@@ -126,6 +227,97 @@ TEST_CASE("find_end_of_central_directory_record doesn't seek too far") {
     REQUIRE(zip.tell() >= 0x10000);
 }
 
+TEST_CASE("find_end_of_central_directory_record with a long comment") {
+    auto zip = make_stored_zip({{"a.txt", "hello"}});
+    // The comment contains something that looks like an end of central directory record
+    std::vector<uint8_t> comment(0xffff, 'x');
+    const uint8_t fake_signature[] = { 'P', 'K', 5, 6 };
+    std::copy(std::begin(fake_signature), std::end(fake_signature), comment.begin() + 100);
+    std::copy(std::begin(fake_signature), std::end(fake_signature), comment.end() - 30);
+    zip[zip.size() - 2] = 0xff;
+    zip[zip.size() - 1] = 0xff;
+    const uint64_t expected_pos = zip.size() - end_of_central_directory_record::min_size_bytes;
+    zip.insert(zip.end(), comment.begin(), comment.end());
+
+    in_mem_stream zip_stream{make_array_view(zip)};
+    end_of_central_directory_record r;
+    REQUIRE(find_end_of_central_directory_record(zip_stream, r) == expected_pos);
+    REQUIRE(r.comment_length == 0xffff);
+    REQUIRE(r.central_directory_records_this_total == 1);
+    REQUIRE(zip_stream.tell() == expected_pos + end_of_central_directory_record::min_size_bytes);
+
+    in_zip_archive za{zip_stream};
+    REQUIRE(za.file_list() == (std::vector<path>{"a.txt"}));
+}
+
+TEST_CASE("find_end_of_central_directory_record finds the zip64 record") {
+    std::vector<uint8_t> zip(100, 0);
+    auto put = [&zip](uint64_t x, int bytes) { for (int i = 0; i < bytes; ++i) zip.push_back(static_cast<uint8_t>(x >> (8 * i))); };
+
+    const uint64_t zip64_record_pos = zip.size();
+    put(zip64_end_of_central_directory_record::signature_magic, 4);
+    put(zip64_end_of_central_directory_record::min_size_bytes - 12, 8);
+    put(45, 2); put(45, 2);
+    put(0, 4); put(0, 4);
+    put(0x100000000ULL, 8); put(0x100000000ULL, 8);
+    put(0x123456789ULL, 8); put(0x987654321ULL, 8);
+
+    put(zip64_end_of_central_directory_locator::signature_magic, 4);
+    put(0, 4); put(zip64_record_pos, 8); put(1, 4);
+
+    const uint64_t expected_pos = zip.size();
+    put(end_of_central_directory_record::signature_magic, 4);
+    put(0xffff, 2); put(0xffff, 2); put(0xffff, 2); put(0xffff, 2);
+    put(0xffffffff, 4); put(0xffffffff, 4);
+    put(0, 2);
+
+    in_mem_stream zip_stream{make_array_view(zip)};
+    end_of_central_directory_record r;
+    zip64_end_of_central_directory_record r64;
+    REQUIRE(find_end_of_central_directory_record(zip_stream, r, r64) == expected_pos);
+    REQUIRE(r.central_directory_offset == 0xffffffff);
+    REQUIRE(r64.signature == zip64_end_of_central_directory_record::signature_magic);
+    REQUIRE(r64.central_directory_records_this_disk == 0x100000000ULL);
+    REQUIRE(r64.central_directory_records_this_total == 0x100000000ULL);
+    REQUIRE(r64.central_directory_size_bytes == 0x123456789ULL);
+    REQUIRE(r64.central_directory_offset == 0x987654321ULL);
+    REQUIRE(zip_stream.tell() == expected_pos + end_of_central_directory_record::min_size_bytes);
+
+    // Archives without a zip64 locator leave r64 empty
+    auto plain_zip = make_stored_zip({});
+    in_mem_stream plain_stream{make_array_view(plain_zip)};
+    REQUIRE(find_end_of_central_directory_record(plain_stream, r, r64) == 0);
+    REQUIRE(r64.signature == 0);
+}
+
+TEST_CASE("zip64 archives") {
+    const std::string big(70000, 'z');
+    auto zip = make_stored_zip({{"a.txt", "hello"}, {"big.bin", big}, {"dir/c.txt", "world"}}, true);
+
+    for (int mapped = 0; mapped < 2; ++mapped) {
+        std::unique_ptr<in_stream> zip_stream;
+        if (mapped) {
+            zip_stream = std::make_unique<in_mem_stream>(make_array_view(zip));
+        } else {
+            zip_stream = std::make_unique<in_unmapped_stream>(make_array_view(zip));
+        }
+        in_zip_archive za{std::move(zip_stream)};
+        REQUIRE(za.file_list() == (std::vector<path>{"a.txt", "big.bin", "dir/c.txt"}));
+
+        auto big_file = za.open("big.bin");
+        REQUIRE(big_file->stream_size() == big.size());
+        std::string contents(big.size(), '\0');
+        big_file->read(&contents[0], contents.size());
+        REQUIRE(big_file->error() == std::error_code());
+        REQUIRE(contents == big);
+
+        auto c_file = za.open("dir/c.txt");
+        char c_contents[5];
+        c_file->read(c_contents, sizeof(c_contents));
+        REQUIRE(std::string(c_contents, c_contents + sizeof(c_contents)) == "world");
+    }
+}
+
 TEST_CASE("test_data.zip") {
     in_file_stream zip{(std::string{TEST_DATA_DIR} + "/" + "test_data.zip").c_str()};
 
@@ -174,6 +366,453 @@ TEST_CASE("test_data.zip") {
     REQUIRE(file_stream->error() != std::error_code());
 }
 
+TEST_CASE("stored files in memory-resident archives are mapped") {
+    const auto zip_data = make_stored_zip({{"a.txt", "Hello"}, {"dir/b.tga", "Stored texture data"}});
+    in_mem_stream zip{make_array_view(zip_data)};
+    in_zip_archive za{zip};
+    REQUIRE(za.file_list() == (std::vector<path>{"a.txt", "dir/b.tga"}));
+
+    array_view<uint8_t> contents;
+    REQUIRE(za.try_map("dir/b.tga", contents));
+    REQUIRE(std::string(contents.begin(), contents.end()) == "Stored texture data");
+    REQUIRE(contents.begin() >= zip_data.data());
+    REQUIRE(contents.end() <= zip_data.data() + zip_data.size());
+
+    // Mapped entries don't share the archive cursor, so several can be open at once
+    auto a = za.open("a.txt");
+    auto b = za.open("dir/b.tga");
+    REQUIRE(a->peek().size() == 5);
+    REQUIRE(b->peek().begin() == contents.begin());
+    char buffer[5];
+    a->read(buffer, sizeof(buffer));
+    REQUIRE(std::string(buffer, buffer+sizeof(buffer)) == "Hello");
+    REQUIRE(a->error() == std::error_code());
+
+    // Deflated entries and streams that aren't memory-resident can't be mapped
+    in_file_stream test_zip{(std::string{TEST_DATA_DIR} + "/" + "test.zip").c_str()};
+    in_zip_archive deflated{test_zip};
+    REQUIRE(!deflated.try_map("test.txt", contents));
+}
+
+TEST_CASE("multiple files open at once") {
+    in_file_stream zip{(std::string{TEST_DATA_DIR} + "/" + "test_data.zip").c_str()};
+    in_zip_archive za{zip};
+
+    auto txt = za.open("test_data/test.txt");
+    auto inner_zip = za.open("test_data/test.zip");
+    auto txt2 = za.open("test_data/test.txt");
+
+    // Interleave reads from the different streams
+    std::string a, b;
+    for (int i = 0; i < 14; ++i) {
+        a.push_back(static_cast<char>(txt->get()));
+        b.push_back(static_cast<char>(txt2->get()));
+        inner_zip->get();
+    }
+    REQUIRE(a == "Line 1\nLine 2\n");
+    REQUIRE(b == a);
+    REQUIRE(txt->error() == std::error_code());
+    REQUIRE(txt2->error() == std::error_code());
+    REQUIRE(inner_zip->tell() == 14);
+    REQUIRE(inner_zip->error() == std::error_code());
+}
+
+TEST_CASE("concurrent reads from several threads") {
+    in_file_stream zip{(std::string{TEST_DATA_DIR} + "/" + "test_data.zip").c_str()};
+    in_zip_archive za{zip};
+
+    std::vector<std::string> results(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&za, &results, i] {
+            for (int iter = 0; iter < 100; ++iter) {
+                auto f = za.open("test_data/test.txt");
+                std::string contents(14, '\0');
+                f->read(&contents[0], contents.size());
+                if (f->error() || contents != "Line 1\nLine 2\n") {
+                    return;
+                }
+            }
+            results[i] = "ok";
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    REQUIRE(results == std::vector<std::string>(results.size(), "ok"));
+}
+
+TEST_CASE("reopening entries reuses pooled buffers") {
+    in_file_stream zip{std::string{TEST_DATA_DIR} + "/test_data.zip"};
+    in_zip_archive za{zip};
+    auto read_entry = [&za](size_t buffer_size) {
+        auto f = za.open("test_data/test.txt", buffer_size);
+        std::string contents(static_cast<size_t>(f->stream_size()), '\0');
+        f->read(&contents[0], contents.size());
+        REQUIRE(f->error() == std::error_code());
+        return contents;
+    };
+
+    REQUIRE(read_entry(1000) == "Line 1\nLine 2\n");
+    REQUIRE(read_entry(3) == "Line 1\nLine 2\n");
+    const auto stats = buffer_pool::shared().stats();
+    for (int i = 0; i < 10; ++i) {
+        REQUIRE(read_entry(i & 1 ? 1000 : 3) == "Line 1\nLine 2\n");
+    }
+    REQUIRE(buffer_pool::shared().stats().allocations == stats.allocations);
+    REQUIRE(buffer_pool::shared().stats().reuses > stats.reuses);
+}
+
+TEST_CASE("entry cache") {
+    auto cache = std::make_shared<entry_cache>(150);
+    REQUIRE(cache->capacity() == 150);
+
+    in_file_stream zip{(std::string{TEST_DATA_DIR} + "/" + "test_data.zip").c_str()};
+    in_zip_archive za{zip, cache};
+
+    auto read_all = [](in_stream& s) {
+        std::string contents(static_cast<size_t>(s.stream_size()), '\0');
+        s.read(&contents[0], contents.size());
+        REQUIRE(s.error() == std::error_code());
+        return contents;
+    };
+
+    REQUIRE(read_all(*za.open("test_data/test.txt")) == "Line 1\nLine 2\n");
+    auto stats = cache->stats();
+    REQUIRE(stats.hits == 0);
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.size_bytes == 14);
+    REQUIRE(stats.entry_count == 1);
+
+    REQUIRE(read_all(*za.open("test_data/TEST.txt")) == "Line 1\nLine 2\n");
+    stats = cache->stats();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.misses == 1);
+
+    // Doesn't fit together with test.txt, so the least recently used entry is evicted
+    auto inner_zip = za.open("test_data/test.zip");
+    REQUIRE(inner_zip->stream_size() == 145);
+    stats = cache->stats();
+    REQUIRE(stats.misses == 2);
+    REQUIRE(stats.evictions == 1);
+    REQUIRE(stats.size_bytes == 145);
+    REQUIRE(stats.entry_count == 1);
+
+    // Streams stay valid after their entry is evicted
+    REQUIRE(read_all(*za.open("test_data/test.txt")) == "Line 1\nLine 2\n");
+    stats = cache->stats();
+    REQUIRE(stats.misses == 3);
+    REQUIRE(stats.evictions == 2);
+    in_zip_archive inner_za{*inner_zip};
+    REQUIRE(inner_za.file_list() == (std::vector<path>{"test.txt"}));
+
+    // Entries are per archive
+    {
+        in_file_stream zip2{(std::string{TEST_DATA_DIR} + "/" + "test_data.zip").c_str()};
+        in_zip_archive za2{zip2, cache};
+        REQUIRE(read_all(*za2.open("test_data/test.txt")) == "Line 1\nLine 2\n");
+        stats = cache->stats();
+        REQUIRE(stats.misses == 4);
+        REQUIRE(stats.entry_count == 2);
+    }
+    // and dropped when the archive is destroyed
+    stats = cache->stats();
+    REQUIRE(stats.entry_count == 1);
+    REQUIRE(stats.size_bytes == 14);
+
+    cache->clear();
+    stats = cache->stats();
+    REQUIRE(stats.entry_count == 0);
+    REQUIRE(stats.size_bytes == 0);
+    REQUIRE(stats.hits == 1);
+}
+
+TEST_CASE("extract_all") {
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int i = 0; i < 50; ++i) {
+        files.emplace_back("file" + std::to_string(i) + ".txt", std::string(i * 997, static_cast<char>('a' + i % 26)));
+    }
+
+    for (int mapped = 0; mapped < 2; ++mapped) {
+        const auto zip = make_stored_zip(files);
+        std::unique_ptr<in_stream> zip_stream;
+        if (mapped) {
+            zip_stream = std::make_unique<in_mem_stream>(make_array_view(zip));
+        } else {
+            zip_stream = std::make_unique<in_unmapped_stream>(make_array_view(zip));
+        }
+        in_zip_archive za{std::move(zip_stream)};
+
+        std::mutex mutex;
+        std::map<std::string, std::string> extracted;
+        bool in_order = true;
+        za.extract_all([&](const path& filename, uint64_t offset, array_view<uint8_t> data) {
+            std::lock_guard<std::mutex> lock{mutex};
+            auto& contents = extracted[path_to_u8string(filename)];
+            in_order &= contents.size() == offset;
+            contents.insert(contents.end(), data.begin(), data.end());
+        }, 4);
+
+        REQUIRE(in_order);
+        REQUIRE(extracted.size() == files.size());
+        for (const auto& f : files) {
+            REQUIRE(extracted[f.first] == f.second);
+        }
+    }
+
+    // Deflated entries
+    in_file_stream zip{(std::string{TEST_DATA_DIR} + "/" + "test_data.zip").c_str()};
+    in_zip_archive za{zip};
+    std::mutex mutex;
+    std::map<std::string, std::string> extracted;
+    za.extract_all([&](const path& filename, uint64_t, array_view<uint8_t> data) {
+        std::lock_guard<std::mutex> lock{mutex};
+        extracted[path_to_u8string(filename)].append(data.begin(), data.end());
+    });
+    REQUIRE(extracted.size() == 3);
+    REQUIRE(extracted["test_data/test.txt"] == "Line 1\nLine 2\n");
+    REQUIRE(extracted["test_data/empty.zip"].size() == 22);
+    REQUIRE(extracted["test_data/test.zip"].size() == 145);
+}
+
+TEST_CASE("extract_all checks CRC32") {
+    auto zip = make_stored_zip({{"a.txt", "hello"}, {"b.txt", "world"}});
+    // Corrupt the checksum of b.txt in both the local and central header
+    const uint32_t local_header_offset = local_file_header::min_size_bytes + 5 + 5;
+    const uint32_t central_dir_offset  = zip[zip.size() - 6] | (zip[zip.size() - 5] << 8);
+    const uint32_t central_header_offset = central_dir_offset + central_directory_file_header::min_size_bytes + 5;
+    zip[local_header_offset + 14] ^= 1;
+    zip[central_header_offset + 16] ^= 1;
+
+    in_zip_archive za{std::make_unique<in_mem_stream>(make_array_view(zip))};
+    REQUIRE_THROWS_WITH(za.extract_all([](const path&, uint64_t, array_view<uint8_t>) {}, 2), "CRC32 mismatch for b.txt in zip archive");
+}
+
+namespace {
+
+std::string read_all(in_zip_archive& za, const std::string& filename)
+{
+    auto f = za.open(filename);
+    std::string contents(static_cast<size_t>(f->stream_size()), '\0');
+    f->read(&contents[0], contents.size());
+    REQUIRE(f->error() == std::error_code());
+    return contents;
+}
+
+} // unnamed namespace
+
+TEST_CASE("CRC32 check policy") {
+    auto zip = make_stored_zip({{"a.txt", "hello"}, {"b.txt", "world, hello"}});
+    // Corrupt the contents of b.txt
+    zip[2 * local_file_header::min_size_bytes + 5 + 5 + 5 + 3] ^= 1;
+
+    auto read_b = [&](crc_check check, size_t buffer_size) {
+        in_zip_archive za{std::make_unique<in_unmapped_stream>(make_array_view(zip)), nullptr, check};
+        auto f = za.open("b.txt", buffer_size);
+        std::string contents(static_cast<size_t>(f->stream_size()), '\0');
+        f->read(&contents[0], contents.size());
+        REQUIRE(read_all(za, "a.txt") == "hello");
+        return f->error();
+    };
+    REQUIRE(read_b(crc_check::always, in_zip_archive::default_buffer_size) != std::error_code());
+    REQUIRE(read_b(crc_check::always, 5) != std::error_code());
+    REQUIRE(read_b(crc_check::first_open, 5) != std::error_code());
+    REQUIRE(read_b(crc_check::never, 5) == std::error_code());
+
+    in_zip_archive unchecked{std::make_unique<in_mem_stream>(make_array_view(zip)), nullptr, crc_check::never};
+    REQUIRE_NOTHROW(unchecked.extract_all([](const path&, uint64_t, array_view<uint8_t>) {}, 2));
+}
+
+TEST_CASE("CRC32 check policy for mapped entries") {
+    auto zip = make_stored_zip({{"a.txt", "hello"}, {"b.txt", "world, hello"}});
+    zip[2 * local_file_header::min_size_bytes + 5 + 5 + 5 + 3] ^= 1;
+    array_view<uint8_t> contents;
+
+    for (const auto check : { crc_check::always, crc_check::first_open }) {
+        in_zip_archive za{std::make_unique<in_mem_stream>(make_array_view(zip)), nullptr, check};
+        REQUIRE(read_all(za, "a.txt") == "hello");
+        REQUIRE_THROWS_WITH(za.open("b.txt"), "CRC32 mismatch for b.txt in zip archive");
+        REQUIRE_THROWS_WITH(za.try_map("b.txt", contents), "CRC32 mismatch for b.txt in zip archive");
+        REQUIRE(za.try_map("a.txt", contents));
+    }
+
+    in_zip_archive unchecked{std::make_unique<in_mem_stream>(make_array_view(zip)), nullptr, crc_check::never};
+    REQUIRE(unchecked.try_map("b.txt", contents));
+    REQUIRE(read_all(unchecked, "b.txt") == "wormd, hello");
+}
+
+TEST_CASE("out_zip_archive") {
+    std::string text;
+    for (int i = 0; text.size() < 100000; ++i) {
+        text += "Line " + std::to_string(i % 100) + "\n";
+    }
+    std::string noise(5000, '\0');
+    uint32_t x = 1;
+    for (auto& c : noise) {
+        x = x * 1103515245 + 12345;
+        c = static_cast<char>(x >> 16);
+    }
+    const std::string stream_contents = "from a stream";
+    std::string file_contents;
+    {
+        in_file_stream in{std::string{TEST_DATA_DIR} + "/test_data.zip"};
+        file_contents.resize(static_cast<size_t>(in.stream_size()));
+        in.read(&file_contents[0], file_contents.size());
+    }
+
+    out_vector_stream out;
+    out.write("junk", 4); // The archive doesn't have to start at the beginning of the stream
+    out.release();
+    {
+        out_zip_archive oz{out, 3};
+        oz.add("text.txt", std::vector<uint8_t>(text.begin(), text.end()));
+        oz.add("noise.bin", std::vector<uint8_t>(noise.begin(), noise.end()));
+        oz.add("dir/stored.txt", std::vector<uint8_t>(text.begin(), text.end()), entry_compression::stored);
+        oz.add("dir/deflated.bin", std::vector<uint8_t>(noise.begin(), noise.end()), entry_compression::deflated);
+        oz.add("empty.txt", std::vector<uint8_t>{});
+        in_mem_stream in{stream_contents.data(), stream_contents.size()};
+        in.get(); // Only the remaining part is added
+        oz.add("stream.txt", in);
+        oz.add_file("copy.zip", std::string{TEST_DATA_DIR} + "/test_data.zip");
+        for (int i = 0; i < 100; ++i) {
+            oz.add("many/" + std::to_string(i), std::vector<uint8_t>(i, static_cast<uint8_t>(i)));
+        }
+        oz.finish();
+    }
+    const auto zip = out.release();
+
+    in_zip_archive za{std::make_unique<in_mem_stream>(make_array_view(zip))};
+    const auto file_list = za.file_list();
+    REQUIRE(file_list.size() == 107);
+    REQUIRE(read_all(za, "text.txt") == text);
+    REQUIRE(read_all(za, "noise.bin") == noise);
+    REQUIRE(read_all(za, "dir/stored.txt") == text);
+    REQUIRE(read_all(za, "dir/deflated.bin") == noise);
+    REQUIRE(read_all(za, "empty.txt") == "");
+    REQUIRE(read_all(za, "stream.txt") == stream_contents.substr(1));
+    REQUIRE(read_all(za, "copy.zip") == file_contents);
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE(read_all(za, "many/" + std::to_string(i)) == std::string(i, static_cast<char>(i)));
+    }
+
+    // Only stored entries can be mapped
+    array_view<uint8_t> contents;
+    REQUIRE(!za.try_map("text.txt", contents));
+    REQUIRE(za.try_map("noise.bin", contents)); // Incompressible
+    REQUIRE(za.try_map("dir/stored.txt", contents));
+    REQUIRE(!za.try_map("dir/deflated.bin", contents));
+    REQUIRE(za.try_map("empty.txt", contents));
+
+    // The output is the same regardless of the number of threads
+    out_vector_stream out2;
+    out_zip_archive oz{out2, 1};
+    oz.add("text.txt", std::vector<uint8_t>(text.begin(), text.end()));
+    oz.finish();
+    const auto zip2 = out2.release();
+    REQUIRE(std::vector<uint8_t>(zip.begin(), zip.begin() + zip2.size() - 22 - 46 - 8) == std::vector<uint8_t>(zip2.begin(), zip2.end() - 22 - 46 - 8));
+}
+
+TEST_CASE("out_zip_archive switches to zip64 for many entries") {
+    out_vector_stream out;
+    out_zip_archive oz{out, 2};
+    const size_t count = 0x10000;
+    for (size_t i = 0; i < count; ++i) {
+        oz.add(std::to_string(i), std::vector<uint8_t>(1, static_cast<uint8_t>(i)), entry_compression::stored);
+    }
+    oz.finish();
+    const auto zip = out.release();
+
+    in_mem_stream zip_stream{make_array_view(zip)};
+    end_of_central_directory_record r;
+    zip64_end_of_central_directory_record r64;
+    REQUIRE(find_end_of_central_directory_record(zip_stream, r, r64) != invalid_file_pos);
+    REQUIRE(r.central_directory_records_this_total == zip64_marker_u16);
+    REQUIRE(r64.signature == zip64_end_of_central_directory_record::signature_magic);
+    REQUIRE(r64.central_directory_records_this_total == count);
+
+    in_zip_archive za{zip_stream};
+    REQUIRE(za.file_list().size() == count);
+    REQUIRE(za.open("65535")->get() == 0xff);
+}
+
+TEST_CASE("out_zip_archive errors") {
+    out_vector_stream out;
+    out_zip_archive oz{out, 1};
+    REQUIRE_THROWS(oz.add("", std::vector<uint8_t>{}));
+    oz.add_file("missing.txt", "this_file_does_not_exist.txt");
+    REQUIRE_THROWS(oz.finish());
+    // The failed entry is dropped rather than left to throw std::future_error
+    REQUIRE_NOTHROW(oz.finish());
+}
+
+TEST_CASE("deflated entries read one after another") {
+    // Each entry gets an inflate state recycled from the previous one, so anything left over from
+    // an earlier entry (including one abandoned halfway) would corrupt the following ones
+    std::vector<std::pair<std::string, std::string>> files;
+    uint32_t x = 1;
+    for (int i = 0; i < 6; ++i) {
+        std::string contents;
+        while (contents.size() < static_cast<size_t>(1000 << i)) {
+            x = x * 1103515245 + 12345;
+            contents += "Entry " + std::to_string(i) + " line " + std::to_string((x >> 16) % 50) + "\n";
+        }
+        files.emplace_back("file" + std::to_string(i) + ".txt", contents);
+    }
+
+    out_vector_stream out;
+    {
+        out_zip_archive oz{out, 1};
+        for (const auto& f : files) {
+            oz.add(f.first, std::vector<uint8_t>(f.second.begin(), f.second.end()), entry_compression::deflated);
+        }
+        oz.finish();
+    }
+    const auto zip = out.release();
+
+    in_zip_archive za{std::make_unique<in_mem_stream>(make_array_view(zip))};
+    for (int round = 0; round < 3; ++round) {
+        for (const auto& f : files) {
+            REQUIRE(read_all(za, f.first) == f.second);
+            auto partial = za.open(f.first);
+            char buf[100];
+            partial->read(buf, sizeof(buf));
+            REQUIRE(partial->error() == std::error_code());
+            REQUIRE(std::string(buf, sizeof(buf)) == f.second.substr(0, sizeof(buf)));
+        }
+    }
+}
+
+TEST_CASE("file lookup is case-insensitive") {
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int i = 0; i < 1000; ++i) {
+        files.push_back({"models/players/Mario/file" + std::to_string(i) + ".TGA", std::to_string(i)});
+    }
+    const auto zip_data = make_stored_zip(files);
+    in_mem_stream zip{make_array_view(zip_data)};
+    in_zip_archive za{zip};
+    REQUIRE(za.file_list().size() == files.size());
+
+    for (int i = 0; i < 1000; i += 37) {
+        auto f = za.open("models/players/mario/FILE" + std::to_string(i) + ".tga");
+        const auto expected = std::to_string(i);
+        REQUIRE(f->stream_size() == expected.size());
+        REQUIRE(std::string(f->peek().begin(), f->peek().end()) == expected);
+    }
+    REQUIRE_THROWS(za.open("models/players/mario/file1000.tga"));
+    REQUIRE_THROWS(za.open("models/players/mario/file1.tg"));
+    REQUIRE_THROWS(za.open(""));
+
+    // Names are compared in their UTF-8 form
+    const auto utf8_data = make_stored_zip({{"Caf\xc3\xa9/Men\xc3\xbc.txt", "1"}});
+    in_mem_stream utf8_zip{make_array_view(utf8_data)};
+    in_zip_archive utf8_za{utf8_zip};
+    REQUIRE(utf8_za.open("caf\xc3\xa9/MEN\xc3\xbc.TXT")->stream_size() == 1);
+
+    const auto duplicate_data = make_stored_zip({{"a.txt", "1"}, {"A.TXT", "2"}});
+    in_mem_stream duplicate_zip{make_array_view(duplicate_data)};
+    REQUIRE_THROWS(in_zip_archive{duplicate_zip});
+}
+
 #if 0
 #include <iostream>
 #include <fstream>